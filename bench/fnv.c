@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <string.h>
+#include "minishell_builtin.h"
+
+/*
+ * A loadable builtin for bench/run.sh: fnv [-v var] word... prints the
+ * 64-bit FNV-1a hash of each word in hex, or assigns the last one to var.
+ *	cc -shared -fPIC -I include bench/fnv.c -o fnv.so
+ *	enable -f ./fnv.so fnv
+ */
+
+static unsigned long long	fnv1a(const char *str)
+{
+	unsigned long long	hash;
+
+	hash = 14695981039346656037ULL;
+	while (*str)
+	{
+		hash ^= (unsigned char)*str++;
+		hash *= 1099511628211ULL;
+	}
+	return (hash);
+}
+
+static int	fnv(int argc, char **argv, const t_shell_api *shell)
+{
+	char	hex[17];
+	char	*var;
+	int		i;
+
+	var = NULL;
+	i = 1;
+	if (argc > 2 && strcmp(argv[1], "-v") == 0)
+	{
+		var = argv[2];
+		i = 3;
+	}
+	if (i >= argc)
+	{
+		dprintf(shell->err, "fnv: usage: fnv [-v var] word...\n");
+		return (2);
+	}
+	while (i < argc)
+	{
+		snprintf(hex, sizeof(hex), "%016llx", fnv1a(argv[i++]));
+		if (!var)
+			dprintf(shell->out, "%s\n", hex);
+	}
+	if (var && shell->set_var(var, hex) != 0)
+	{
+		dprintf(shell->err, "fnv: %s: not a valid identifier\n", var);
+		return (1);
+	}
+	return (0);
+}
+
+t_loadable	fnv_builtin = {MINISHELL_BUILTIN_ABI, fnv, NULL};
@@ -0,0 +1,274 @@
+#!/bin/sh
+# Micro benchmarks for minishell, run with `make bench`.
+#   bench/run.sh [benchmark...]   (default: all of them)
+# Each benchmark times a script at N iterations and at 0 iterations and
+# reports the difference per iteration, so startup cost drops out.
+
+SHELL_BIN=${SHELL_BIN:-./minishell}
+N=${N:-100000}
+# Iterations for benchmarks that fork a process each time
+N_FORK=${N_FORK:-2000}
+
+now_ns()
+{
+	date +%s%N
+}
+
+# time_script <iterations> <script>: nanoseconds for one run
+time_script()
+{
+	start=$(now_ns)
+	ITER=$1 "$SHELL_BIN" --norc -c "$2" > /dev/null
+	end=$(now_ns)
+	echo $((end - start))
+}
+
+# per_iteration <name> <script using $ITER> [iterations]
+per_iteration()
+{
+	n=${3:-$N}
+	base=$(time_script 0 "$2")
+	full=$(time_script "$n" "$2")
+	printf '%-24s %8d iterations %8d ns/iter\n' "$1" "$n" \
+		$(((full - base) / n))
+}
+
+bench_for_loop()
+{
+	per_iteration for_loop \
+		'for i in $(seq $ITER); do ((n++)); done'
+}
+
+bench_while_loop()
+{
+	per_iteration while_loop \
+		'while ((i < ITER)); do ((i++)); done'
+}
+
+bench_loop_body()
+{
+	per_iteration loop_body \
+		'for i in $(seq $ITER); do if ((i % 2)); then ((odd++)); else ((even++)); fi; done'
+}
+
+bench_assign()
+{
+	per_iteration assign \
+		'for i in $(seq $ITER); do x=$i; y=$x; done'
+}
+
+bench_array_push()
+{
+	per_iteration array_push \
+		'for i in $(seq $ITER); do a+=($i); done'
+}
+
+# Per element: filling an array from a substitution, then "${a[@]}"
+bench_array_expand()
+{
+	per_iteration array_expand \
+		'a=($(seq $ITER)); echo "${a[@]}"; echo "${a[@]}"'
+}
+
+# Per line: mapfile from a pipe
+bench_mapfile()
+{
+	per_iteration mapfile \
+		'seq $ITER | mapfile -t lines'
+}
+
+# read from a file (block reads given back with lseek) and from a pipe
+# (a byte per read call)
+bench_read()
+{
+	file=$(mktemp)
+	per_iteration read_file \
+		"seq \$ITER > $file; while read -r line; do :; done < $file"
+	per_iteration read_pipe \
+		'seq $ITER | while read -r line; do :; done'
+	rm -f "$file"
+}
+
+# cat and tee on a CAT_MB megabyte file, the builtins against the
+# external commands: file to file, file to pipe and pipe to files
+bench_cat()
+{
+	dir=$(mktemp -d)
+	head -c $((${CAT_MB:-256} * 1048576)) /dev/zero > "$dir/in"
+	for cmd in cat /bin/cat; do
+		for script in "$cmd in > out" "$cmd in | $cmd > out" \
+			"$cmd in | ${cmd%cat}tee out1 > out2"; do
+			start=$(now_ns)
+			"$SHELL_BIN" --norc -c "cd $dir && $script"
+			end=$(now_ns)
+			printf '%-34s %6d MB %8d MB/s\n' "$script" "${CAT_MB:-256}" \
+				$((${CAT_MB:-256} * 1000000000 / (end - start)))
+		done
+	done
+	rm -rf "$dir"
+}
+
+# Pipeline throughput against PIPESIZE: PIPE_MB megabytes through three
+# external stages that read and write through user space
+bench_pipe_size()
+{
+	file=$(mktemp)
+	head -c $((${PIPE_MB:-1024} * 1048576)) /dev/zero > "$file"
+	for size in 64k 256k 1m; do
+		start=$(now_ns)
+		"$SHELL_BIN" --norc -c "PIPESIZE=$size
+			/bin/cat $file | /bin/cat | /bin/cat > /dev/null"
+		end=$(now_ns)
+		printf '%-24s %8d MB %8d MB/s\n' "pipe_size_$size" "${PIPE_MB:-1024}" \
+			$((${PIPE_MB:-1024} * 1000000000 / (end - start)))
+	done
+	rm -f "$file"
+}
+
+# Builtins against the external commands they replace
+bench_test()
+{
+	per_iteration test_builtin \
+		'for i in $(seq $ITER); do [ $i -gt 0 ] && [ -f /etc/passwd ]; done'
+	per_iteration test_external \
+		'for i in $(seq $ITER); do /usr/bin/[ $i -gt 0 ] && /usr/bin/[ -f /etc/passwd ]; done' \
+		"$N_FORK"
+}
+
+bench_printf()
+{
+	per_iteration printf_builtin \
+		'for i in $(seq $ITER); do printf "%05d %s\n" $i x; done'
+	per_iteration printf_external \
+		'for i in $(seq $ITER); do /usr/bin/printf "%05d %s\n" $i x; done' \
+		"$N_FORK"
+}
+
+# Per command: timeout in the shell against the external one, which
+# forks one more process; then a four stage pipeline, waited on together
+bench_timeout()
+{
+	per_iteration timeout_builtin \
+		'for i in $(seq $ITER); do timeout 10 /bin/true; done' "$N_FORK"
+	per_iteration timeout_external \
+		'for i in $(seq $ITER); do /usr/bin/timeout 10 /bin/true; done' \
+		"$N_FORK"
+	per_iteration pipeline_wait \
+		'for i in $(seq $ITER); do true | true | true | true; done' "$N_FORK"
+}
+
+# Per pipeline: three external stages behind a PATH of 32 missing
+# directories, looked up once in the shell through the hash table
+bench_plan()
+{
+	per_iteration pipeline_plan \
+		'PATH=$(printf "/nonexistent/%d:" $(seq 32))$PATH
+		for i in $(seq $ITER); do seq 1 | tr 1 2 | wc -c; done' "$N_FORK"
+}
+
+# Shell startup with an rc file of RC_FUNCS functions, from the compiled
+# cache, against a start without any rc file
+bench_rc_startup()
+{
+	home=$(mktemp -d)
+	i=0
+	while [ $i -lt "${RC_FUNCS:-2000}" ]; do
+		echo "f$i() { for a in \"\$@\"; do export V$i=\$a; done; }"
+		i=$((i + 1))
+	done > "$home/.minishellrc"
+	HOME=$home "$SHELL_BIN" -c 'f0' > /dev/null
+	for opt in "" --norc; do
+		start=$(now_ns)
+		i=0
+		while [ $i -lt 100 ]; do
+			HOME=$home "$SHELL_BIN" $opt -c 'f0' > /dev/null 2>&1
+			i=$((i + 1))
+		done
+		end=$(now_ns)
+		printf '%-24s %8d functions %8d ns/start\n' "rc_startup${opt:+_norc}" \
+			"${RC_FUNCS:-2000}" $(((end - start) / 100))
+	done
+	rm -rf "$home"
+}
+
+# Per item: the parallel builtin against xargs -P starting a shell per item
+bench_parallel()
+{
+	per_iteration parallel_builtin \
+		'seq $ITER | parallel -j 4 true' "$N_FORK"
+	per_iteration parallel_xargs \
+		'seq $ITER | xargs -P 4 -n 1 sh -c true' "$N_FORK"
+}
+
+# Loading a history file of HIST_LINES lines and searching all of it
+bench_history()
+{
+	file=$(mktemp)
+	awk -v n="${HIST_LINES:-1000000}" \
+		'BEGIN { for (i = 1; i <= n; i++) print "echo command " i " | wc" }' \
+		> "$file"
+	start=$(now_ns)
+	i=0
+	while [ $i -lt 10 ]; do
+		HISTFILE=$file HISTSIZE=-1 "$SHELL_BIN" --norc \
+			-c 'history -r; history -g "command 4242 "' > /dev/null
+		i=$((i + 1))
+	done
+	end=$(now_ns)
+	printf '%-24s %8d lines %12d ns/search\n' history_search \
+		"${HIST_LINES:-1000000}" $(((end - start) / 10))
+	rm -f "$file"
+}
+
+# A command line sent to a warm --server shell holding an rc file of
+# RC_FUNCS functions, against starting a shell for it
+bench_server()
+{
+	home=$(mktemp -d)
+	i=0
+	while [ $i -lt "${RC_FUNCS:-2000}" ]; do
+		echo "f$i() { for a in \"\$@\"; do export V$i=\$a; done; }"
+		i=$((i + 1))
+	done > "$home/.minishellrc"
+	HOME=$home "$SHELL_BIN" --server "$home/sock" < /dev/null &
+	server=$!
+	while [ ! -S "$home/sock" ]; do sleep 0.1; done
+	for mode in client start; do
+		start=$(now_ns)
+		i=0
+		while [ $i -lt 100 ]; do
+			if [ $mode = client ]; then
+				"$SHELL_BIN" --client "$home/sock" f0 > /dev/null 2>&1
+			else
+				HOME=$home "$SHELL_BIN" -c 'f0' > /dev/null 2>&1
+			fi
+			i=$((i + 1))
+		done
+		end=$(now_ns)
+		printf '%-24s %8d functions %8d ns/command\n' "server_$mode" \
+			"${RC_FUNCS:-2000}" $(((end - start) / 100))
+	done
+	kill $server
+	wait $server
+	rm -rf "$home"
+}
+
+# Hashing a word per line in a builtin loaded with enable -f, against
+# forking cksum for it
+bench_loadable()
+{
+	lib=$(mktemp -d)
+	cc -shared -fPIC -I include bench/fnv.c -o "$lib/fnv.so" || return
+	per_iteration loadable_builtin \
+		"enable -f $lib/fnv.so fnv; "'for i in $(seq $ITER); do fnv -v h "line $i"; done'
+	per_iteration loadable_fork \
+		'for i in $(seq $ITER); do h=$(echo "line $i" | cksum); done' "$N_FORK"
+	rm -rf "$lib"
+}
+
+ALL="for_loop while_loop loop_body assign array_push array_expand mapfile
+	read cat pipe_size test printf timeout plan rc_startup server parallel
+	history loadable"
+for name in ${*:-$ALL}; do
+	"bench_$name"
+done
@@ -1,24 +1,60 @@
 #ifndef MINISHELL_H
 # define MINISHELL_H
 
+# ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+# endif
+
 # include <stdio.h>
 # include <stdlib.h>
+# include <stdarg.h>
+# include <stddef.h>
 # include <unistd.h>
 # include <string.h>
 # include <sys/wait.h>
 # include <sys/stat.h>
+# include <sys/mman.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <sys/resource.h>
+# include <sched.h>
 # include <signal.h>
 # include <dirent.h>
 # include <errno.h>
 # include <fcntl.h>
 # include <ctype.h>
+# include <limits.h>
+# include <poll.h>
+# include <time.h>
+# include <dlfcn.h>
+# ifdef __linux__
+#  include <link.h>
+#  include <sys/syscall.h>
+#  include <sys/sendfile.h>
+#  include <sys/inotify.h>
+# endif
 # include <readline/readline.h>
 # include <readline/history.h>
+# include "minishell_builtin.h"
 
 # define MAX_PATH 1024
 # define MAX_ARGS 1024
 # define MAX_ENV 1024
 
+/* Descriptors below SHELL_FD_BASE belong to the user (exec 3>file etc.),
+ * the shell keeps its own descriptors at or above it, close-on-exec */
+# define SHELL_FD_BASE 10
+
+/* Function table size and call depth limit */
+# define FUNC_BUCKETS 1024
+# define FUNC_NEST_MAX 1000
+
+/* Buckets of the table of remembered command paths */
+# define HASH_BUCKETS 1024
+
+/* Shell fd table flags */
+# define FD_USER 1
+
 /* Token types */
 typedef enum e_token_type
 {
@@ -28,52 +64,471 @@ typedef enum e_token_type
 	TOKEN_REDIRECT_OUT,
 	TOKEN_REDIRECT_APPEND,
 	TOKEN_REDIRECT_HEREDOC,
+	TOKEN_DUP_IN,
+	TOKEN_DUP_OUT,
+	TOKEN_IO_NUMBER,
+	TOKEN_PROCSUB_IN,
+	TOKEN_PROCSUB_OUT,
+	TOKEN_ARITH,
 	TOKEN_AND,
 	TOKEN_OR,
 	TOKEN_LPAREN,
 	TOKEN_RPAREN,
+	TOKEN_SEMI,
+	TOKEN_DSEMI,
+	TOKEN_NEWLINE,
 	TOKEN_EOF,
 	TOKEN_ERROR
 }	t_token_type;
 
-/* Token structure */
+/* Token structure; the delimiter word of a heredoc carries the body read
+ * after its line */
 typedef struct s_token
 {
 	t_token_type		type;
 	char				*value;
+	char				*heredoc;
 	struct s_token		*next;
 }	t_token;
 
-/* Command structure */
+/* Word template segment types */
+typedef enum e_seg_type
+{
+	SEG_LITERAL,
+	SEG_TILDE,
+	SEG_VAR,
+	SEG_PARAM,
+	SEG_COMMAND,
+	SEG_ARITH,
+	SEG_PROCSUB_IN,
+	SEG_PROCSUB_OUT
+}	t_seg_type;
+
+/* Piece of a compiled word; quoted ones are never field split */
+typedef struct s_segment
+{
+	t_seg_type			type;
+	int					quoted;
+	char				*text;
+	struct s_segment	*next;
+}	t_segment;
+
+/* Word compiled once at parse time and expanded at every execution.
+ * literal is set when the word needs no expansion at all */
+typedef struct s_word
+{
+	t_segment			*segments;
+	char				*literal;
+	struct s_word		*next;
+}	t_word;
+
+/* Growable NULL-terminated string vector */
+typedef struct s_argv
+{
+	char				**items;
+	int					count;
+	int					cap;
+}	t_argv;
+
+/* Redirection types */
+typedef enum e_redir_type
+{
+	REDIR_IN,
+	REDIR_OUT,
+	REDIR_APPEND,
+	REDIR_HEREDOC,
+	REDIR_DUP_IN,
+	REDIR_DUP_OUT
+}	t_redir_type;
+
+/* Redirection structure, applied in command line order. target is
+ * expanded from word before every execution; a heredoc's word is its body */
+typedef struct s_redir
+{
+	t_redir_type		type;
+	int					fd;
+	t_word				*word;
+	char				*target;
+	int					opened;
+	struct s_redir		*next;
+}	t_redir;
+
+/* Saved descriptor, used to undo redirections of builtins */
+typedef struct s_fdsave
+{
+	int					fd;
+	int					saved;
+	struct s_fdsave		*next;
+}	t_fdsave;
+
+/* Running process substitution of a command */
+typedef struct s_procsub
+{
+	int					fd;
+	pid_t				pid;
+	struct s_procsub	*next;
+}	t_procsub;
+
+/* Element of a=(...) or a[key]=value; key is NULL for a plain list item */
+typedef struct s_element
+{
+	t_word				*key;
+	t_word				*value;
+	int					append;
+	struct s_element	*next;
+}	t_element;
+
+/* Prefix assignment: word is NAME=value (or NAME+=value) for a scalar,
+ * NULL for an array assignment to name. append keeps the elements an
+ * array already has, as in a+=(...) and a[key]=value */
+typedef struct s_assign
+{
+	t_word				*word;
+	char				*name;
+	int					append;
+	t_element			*elements;
+	struct s_assign		*next;
+}	t_assign;
+
+/* Command structure, args is rebuilt from words at every execution,
+ * assigns (NAME=value prefixes) from assignments. A compound command
+ * (loop, if, group...) is a stage with node set */
 typedef struct s_cmd
 {
+	t_word				*words;
 	char				**args;
-	char				*input_file;
-	char				*output_file;
-	int					append_output;
-	int					heredoc;
-	char				*heredoc_delimiter;
+	t_assign			*assignments;
+	char				**assigns;
+	int					substituted;
+	t_redir				*redirs;
+	t_procsub			*procsubs;
+	char				*arith;
+	struct s_node		*node;
 	struct s_cmd		*next;
 }	t_cmd;
 
-/* Environment variable structure */
+/* Syntax tree node types */
+typedef enum e_node_type
+{
+	NODE_PIPELINE,
+	NODE_AND,
+	NODE_OR,
+	NODE_SEQ,
+	NODE_IF,
+	NODE_WHILE,
+	NODE_UNTIL,
+	NODE_FOR,
+	NODE_CASE,
+	NODE_GROUP,
+	NODE_SUBSHELL,
+	NODE_FUNCTION
+}	t_node_type;
+
+/* pattern | pattern) body ;; */
+typedef struct s_case_item
+{
+	t_word				*patterns;
+	struct s_node		*body;
+	struct s_case_item	*next;
+}	t_case_item;
+
+/*
+ * Syntax tree, parsed once and executed as often as needed.
+ * left/right: the operands of && || ;, the condition and body of if and
+ * loops, the body of for, groups and subshells. extra: the else branch.
+ * var and words: the variable and list of for, words is the case subject.
+ * A function definition has its name in var and its body in left.
+ */
+typedef struct s_node
+{
+	t_node_type			type;
+	int					negate;
+	t_cmd				*pipeline;
+	struct s_node		*left;
+	struct s_node		*right;
+	struct s_node		*extra;
+	char				*var;
+	t_word				*words;
+	t_case_item			*items;
+}	t_node;
+
+/* Growable string buffer */
+typedef struct s_buf
+{
+	char				*data;
+	size_t				len;
+	size_t				cap;
+}	t_buf;
+
+/* Bytecode operations; operands follow the opcode in the code array */
+typedef enum e_opcode
+{
+	OP_HALT,
+	OP_JUMP,
+	OP_BRANCH_OK,
+	OP_BRANCH_FAIL,
+	OP_NOT,
+	OP_STATUS,
+	OP_BEGIN,
+	OP_EXPAND,
+	OP_ASSIGN,
+	OP_ARRAY,
+	OP_ARRAY_ADD,
+	OP_ARRAY_KEY,
+	OP_REDIRECT,
+	OP_SPAWN,
+	OP_BUILTIN,
+	OP_ARITH,
+	OP_PIPE,
+	OP_WAIT,
+	OP_EXIT,
+	OP_SUBSHELL,
+	OP_PUSH_REDIR,
+	OP_POP_REDIR,
+	OP_LOOP,
+	OP_FOR_NEXT,
+	OP_LOOP_BODY,
+	OP_LOOP_END,
+	OP_CASE,
+	OP_MATCH,
+	OP_CASE_END,
+	OP_DEFUN,
+	OP_RETURN
+}	t_opcode;
+
+/*
+ * Compiled program: a flat code array whose string operands are offsets
+ * into one interned string pool. Words are index based as well (segs holds
+ * type, quoted, string triples, words first segment, count pairs) so the
+ * whole program is position independent; word_view and seg_view are the
+ * t_word templates built from them for the expansion code.
+ */
+typedef struct s_program
+{
+	int					*code;
+	int					len;
+	char				*strings;
+	int					strings_len;
+	int					*segs;
+	int					nsegs;
+	int					*words;
+	int					nwords;
+	t_word				*word_view;
+	t_segment			*seg_view;
+	void				*map;
+	size_t				map_len;
+	int					refs;
+}	t_program;
+
+/* Where a command was found on PATH, in directory dir of it, and how
+ * often it was used */
+typedef struct s_hashed
+{
+	char				*name;
+	char				*path;
+	int					dir;
+	int					hits;
+	struct s_hashed		*next;
+}	t_hashed;
+
+/* Every command on PATH, sorted by name for completion. The entries are
+ * the hash table's; the inotify descriptor watches the PATH directories
+ * for the shell that built it */
+typedef struct s_cmdindex
+{
+	t_hashed			**sorted;
+	int					count;
+	int					cap;
+	char				**dirs;
+	int					ndirs;
+	int					*watches;
+	int					notify;
+	int					watching;
+	int					built;
+	pid_t				owner;
+}	t_cmdindex;
+
+/*
+ * A pipeline stage prepared before anything is forked: the path of its
+ * command and its redirection files, opened in order (-1 for the N>&M
+ * ones). A non-zero status means the stage failed already and never
+ * starts; planned is 0 for stages left to the child.
+ */
+typedef struct s_stage
+{
+	char				*path;
+	int					*fds;
+	int					nfds;
+	int					status;
+	int					planned;
+}	t_stage;
+
+typedef struct s_plan
+{
+	t_stage				*stages;
+	int					count;
+}	t_plan;
+
+/* Shell function: entry point of its body in a compiled program */
+typedef struct s_func
+{
+	char				*name;
+	t_program			*prog;
+	int					pc;
+	struct s_func		*next;
+}	t_func;
+
+/* Builtin dispatch table entry */
+typedef struct s_builtin
+{
+	char				*name;
+	int					(*fn)(char **args);
+}	t_builtin;
+
+/* Special builtin: takes the whole command, redirections and prefixes
+ * included, and runs before the builtin table is looked at */
+typedef struct s_special
+{
+	char				*name;
+	int					(*fn)(t_cmd *cmd);
+}	t_special;
+
+/* Builtin loaded by enable -f, indexed after the table's */
+typedef struct s_loaded
+{
+	char				*name;
+	const t_loadable	*loadable;
+}	t_loaded;
+
+/* Variable a local hid, its array and attributes included, put back
+ * when the function returns; var is NULL when name was unset */
+typedef struct s_local
+{
+	char				*name;
+	struct s_env		*var;
+	struct s_local		*next;
+}	t_local;
+
+/* Call frame: positional parameters and the locals to restore. Frames
+ * live on the C stack of the call, args is the caller's argv */
+typedef struct s_frame
+{
+	char				**args;
+	char				**params;
+	int					count;
+	t_local				*locals;
+	struct s_frame		*prev;
+}	t_frame;
+
+/*
+ * Array variable. values[i] is element i of an indexed array, or the
+ * value stored under keys[i] in an associative one, whose index is an
+ * open addressing table of slot numbers + 1. NULL marks an unset slot.
+ */
+typedef struct s_array
+{
+	int					assoc;
+	char				**values;
+	char				**keys;
+	int					len;
+	int					cap;
+	int					count;
+	int					*index;
+	int					index_size;
+}	t_array;
+
+/* Environment variable structure, array is set for array variables */
 typedef struct s_env
 {
 	char				*key;
 	char				*value;
+	int					exported;
+	t_array				*array;
 	struct s_env		*next;
 }	t_env;
 
+/* The deadline of a running timeout, 0 without one; expired counts the
+ * times it passed, stopped is set once it stopped code in the shell */
+typedef struct s_timeout
+{
+	long long			at;
+	long long			kill_after;
+	int					signal;
+	int					expired;
+	int					stopped;
+}	t_timeout;
+
+/* The shell's descriptors that children inherit: process substitutions */
+typedef struct s_fdset
+{
+	int					*fds;
+	int					count;
+	int					cap;
+}	t_fdset;
+
+/* A history entry in its HISTFILE form, newlines escaped; the entries
+ * loaded at startup point into the mapped file */
+typedef struct s_histent
+{
+	char				*line;
+	size_t				len;
+}	t_histent;
+
+/* The history list is entries[first..end) */
+typedef struct s_history
+{
+	char				*map;
+	size_t				map_len;
+	t_histent			*entries;
+	int					first;
+	int					end;
+	int					cap;
+	int					cursor;
+	char				*typed;
+	t_buf				pending;
+	int					unsaved;
+	pid_t				owner;
+}	t_history;
+
 /* Main shell structure */
 typedef struct s_shell
 {
 	t_env				*env_list;
 	char				**env_array;
+	int					env_dirty;
 	int					exit_status;
 	int					stdin_backup;
 	int					stdout_backup;
 	pid_t				*pids;
 	int					num_processes;
+	unsigned char		fd_table[SHELL_FD_BASE];
+	t_fdset				inherited;
+	int					check_fds;
+	int					loop_depth;
+	int					breaking;
+	int					continuing;
+	volatile sig_atomic_t	interrupted;
+	int					continuation;
+	int					incomplete;
+	int					returning;
+	int					func_depth;
+	int					dump_bytecode;
+	int					no_rc;
+	pid_t				interactive;
+	int					expand_failed;
+	long				pipe_size;
+	t_timeout			timeout;
+	char				*name;
+	t_func				*functions[FUNC_BUCKETS];
+	t_hashed			*hashed[HASH_BUCKETS];
+	char				*hashed_for;
+	t_cmdindex			commands;
+	t_history			history;
+	t_loaded			*loaded;
+	int					loaded_count;
+	int					loaded_cap;
+	t_frame				top_frame;
+	t_frame				*frame;
 }	t_shell;
 
 /* Global shell variable */
@@ -85,22 +540,87 @@ t_token		*create_token(t_token_type type, char *value);
 void		add_token(t_token **tokens, t_token *new_token);
 void		free_tokens(t_token *tokens);
 char		*extract_word(char *input, int *i);
-char		*extract_quoted_string(char *input, int *i, char quote);
+int			skip_quoted(char *input, int i);
+char		*extract_parens(char *input, int *i);
+char		*extract_arithmetic(char *input, int *i);
+int			skip_parens(char *input, int i);
+int			skip_braces(char *input, int i);
+int			skip_brackets(char *input, int i);
 
 /* Parser functions */
-t_cmd		*parser(t_token *tokens);
+t_node		*parser(t_token *tokens);
+t_node		*create_node(t_node_type type);
+void		free_node(t_node *node);
 t_cmd		*create_cmd(void);
 void		add_cmd(t_cmd **cmds, t_cmd *new_cmd);
 void		free_cmds(t_cmd *cmds);
 int			parse_command(t_token **tokens, t_cmd *cmd);
 int			parse_redirections(t_token **tokens, t_cmd *cmd);
+t_redir		*create_redir(t_redir_type type, int fd, t_word *word);
+void		free_redirs(t_redir *redirs);
+void		free_assigns(t_assign *assigns);
+
+/* Word template functions */
+t_word		*compile_word(char *raw);
+t_word		*compile_assignment(char *raw);
+t_word		*compile_procsub(t_token *token);
+t_word		*compile_heredoc(char *body, int quoted);
+void		free_words(t_word *words);
+char		*remove_quotes(char *raw);
+
+/* Redirection functions */
+int			apply_redirections(t_redir *redirs, t_fdsave **saves);
+void		restore_redirections(t_fdsave *saves);
+int			open_target(t_redir *redir);
+void		close_user_fds(void);
+void		adopt_user_fds(void);
+int			shell_fd(int fd, int inherit);
+void		release_fd(int fd);
+void		prepare_exec(t_cmd *cmd);
+
+/* Substitution functions */
+char		*start_procsub(t_cmd *cmd, char *command, int output);
+void		close_procsubs(t_cmd *cmd);
+void		wait_procsubs(t_cmd *cmd);
+void		free_procsubs(t_procsub *procsubs);
+char		*command_substitution(char *command);
 
 /* Executor functions */
-int			executor(t_cmd *cmds);
-int			execute_single_cmd(t_cmd *cmd);
-int			execute_pipeline(t_cmd *cmds);
+t_node		*parse_line(char *input);
+int			execute_line(char *input);
+int			executor(t_node *node);
+int			execute_program(t_program *prog);
+int			run_command(t_cmd *cmd, int builtin);
+int			exec_command(t_cmd *cmd);
+int			run_external(char **args);
 int			execute_builtin(t_cmd *cmd);
-char		*find_command_path(char *cmd);
+char		*find_command_path(char *cmd, char **assigns);
+
+/* Bytecode compiler and virtual machine */
+t_program	*compile_program(t_node *tree);
+void		link_program(t_program *prog);
+t_word		*program_word(t_program *prog, int index);
+void		release_program(t_program *prog);
+void		dump_program(t_program *prog);
+int			vm_execute(t_program *prog, int pc);
+long		parse_size(char *str);
+int			builtin_break(char **args);
+int			builtin_continue(char **args);
+
+/* Startup file */
+void		load_rc_file(void);
+
+/* Functions and positional parameters */
+void		define_function(char *name, t_program *prog, int pc);
+t_func		*find_function(char *name);
+int			call_function(t_func *func, t_cmd *cmd);
+void		free_functions(void);
+char		*positional_value(char *name);
+t_local		*push_assignments(char **assigns, int exported);
+void		restore_locals(t_local *locals);
+int			builtin_local(char **args);
+int			builtin_return(char **args);
+int			builtin_shift(char **args);
 
 /* Built-in commands */
 int			builtin_echo(char **args);
@@ -110,16 +630,103 @@ int			builtin_export(char **args);
 int			builtin_unset(char **args);
 int			builtin_env(char **args);
 int			builtin_exit(char **args);
+int			builtin_exec(t_cmd *cmd);
+int			builtin_true(char **args);
+int			builtin_false(char **args);
+int			builtin_test(char **args);
+int			builtin_printf(char **args);
+int			builtin_read(char **args);
+int			builtin_cat(char **args);
+int			builtin_tee(char **args);
+int			transfer_data(int in, int out);
+int			write_all(int fd, char *data, size_t len);
+int			builtin_ulimit(char **args);
+int			builtin_pin(t_cmd *cmd);
+int			apply_pin(char ***args);
+void		place_stage(int stage);
+
+/* Waiting for children */
+long long	now_ms(void);
+int			open_pidfd(pid_t pid);
+int			reap_child(pid_t pid, int *status);
+int			time_left(long long sent);
+int			expired_signal(long long *sent);
+int			timeout_stops(void);
+int			wait_children(pid_t *pids, int count);
+int			builtin_timeout(t_cmd *cmd);
+int			builtin_parallel(char **args);
+
+/* Loadable builtins */
+int			add_builtin(char *name, const t_loadable *loadable);
+void		free_builtins(void);
+int			run_loadable(const t_loadable *loadable, char **args);
+int			builtin_enable(char **args);
+
+/* Completion */
+void		setup_completion(void);
+
+/* History */
+void		load_history(void);
+void		add_to_history(char *line);
+void		save_history(void);
+int			builtin_history(char **args);
+
+/* Command server */
+int			run_server(char *path);
+int			run_client(char *path, char **words);
+
+/* Command hashing and pipeline plans */
+char		*hashed_path(char *name);
+void		remember_path(char *name, char *path, int dir);
+void		forget_paths(void);
+void		sync_index(void);
+int			index_complete(void);
+void		commands_with_prefix(const char *prefix, t_argv *names);
+int			builtin_hash(char **args);
+t_plan		*plan_pipeline(t_program *prog, int pc);
+void		keep_stage(t_plan *plan, int index);
+void		close_stage(t_stage *stage);
+void		free_plan(t_plan *plan);
+int			exec_planned(t_cmd *cmd, t_stage *stage);
 int			is_builtin(char *cmd);
+int			is_special_builtin(char *cmd);
+char		*special_builtin_name(int index);
+int			run_special_builtin(t_cmd *cmd);
+int			builtin_index(char *name);
+char		*builtin_name(int index);
+int			run_builtin(int index, char **args);
 
 /* Environment functions */
 void		init_env(char **envp);
 char		*get_env_value(char *key);
 int			set_env_value(char *key, char *value);
+int			set_shell_value(char *key, char *value);
+int			export_variable(char *key, int exported);
+int			is_exported(char *key);
 int			unset_env_value(char *key);
-void		update_env_array(void);
+t_env		*detach_variable(char *key);
+void		attach_variable(char *key, t_env *var);
+char		**get_env_array(void);
+char		**overlay_env(char **assigns);
+t_array		*find_array(char *key);
+t_array		*make_array(char *key, int assoc);
 void		free_env(void);
 
+/* Array variables */
+void		free_array(t_array *arr);
+void		clear_array(t_array *arr);
+char		*array_get(t_array *arr, char *key);
+int			array_store(t_array *arr, char *key, char *value);
+int			array_unset(t_array *arr, char *key);
+void		array_push(t_array *arr, char *value);
+char		*array_value(char *name, char *subscript, int length);
+int			is_array_list(char *body);
+char		**array_items(char *body, int *len, int *made);
+char		*array_keys(char *body);
+char		*array_slice(char *name, char *range);
+int			builtin_declare(char **args);
+int			builtin_mapfile(char **args);
+
 /* Signal handling */
 void		setup_signals(void);
 void		handle_sigint(int sig);
@@ -127,16 +734,41 @@ void		handle_sigquit(int sig);
 
 /* Expansion functions */
 char		*expand_variables(char *str);
-char		*expand_tilde(char *str);
+char		*variable_value(char *name);
+void		expansion_error(void);
+void		expand_word(t_word *word, t_argv *fields, t_cmd *cmd);
+char		*expand_word_string(t_word *word, t_cmd *cmd);
+char		*expand_pattern(t_word *word);
+void		expand_cmd(t_cmd *cmd);
 char		**expand_wildcards(char *pattern);
+int			match_pattern(char *str, char *pattern);
+char		*expand_parameter(char *body);
+int			evaluate_arithmetic(char *expr, long long *result);
+void		free_arithmetic_cache(void);
 
 /* Utility functions */
 char		**split_string(char *str, char delimiter);
+char		**split_path(char *path);
 char		*trim_whitespace(char *str);
 char		*join_strings(char *s1, char *s2);
 int			count_words(char *str, char delimiter);
 void		free_string_array(char **array);
 int			array_length(char **array);
+char		*option_value(char ***args, int *i);
+unsigned int	hash_string(char *str);
+
+/* String buffer functions */
+void		buf_init(t_buf *buf, size_t cap);
+void		buf_reserve(t_buf *buf, size_t extra);
+void		buf_add(t_buf *buf, char *str, size_t len);
+void		buf_add_str(t_buf *buf, char *str);
+void		buf_add_char(t_buf *buf, char c);
+void		read_all(int fd, t_buf *buf);
+
+/* String vector functions */
+void		argv_init(t_argv *argv, int cap);
+void		argv_push(t_argv *argv, char *str);
+void		argv_reserve(t_argv *argv, int extra);
 
 /* Error handling */
 void		print_error(char *cmd, char *msg);
@@ -145,7 +777,7 @@ int			syntax_error(char *token);
 
 /* File operations */
 int			check_file_access(char *filename, int mode);
-int			create_heredoc(char *delimiter);
+int			create_heredoc(char *body);
 
 /* Memory management */
 void		*safe_malloc(size_t size);
@@ -0,0 +1,60 @@
+#ifndef MINISHELL_BUILTIN_H
+# define MINISHELL_BUILTIN_H
+
+/*
+ * The C ABI of builtins loaded with enable -f FILE NAME... FILE is a
+ * shared object that exports, for every NAME, a t_loadable called
+ * NAME_builtin, for instance:
+ *
+ *	static int	hello(int argc, char **argv, const t_shell_api *shell)
+ *	{
+ *		dprintf(shell->out, "hello %s\n", argc > 1 ? argv[1] : "world");
+ *		return (0);
+ *	}
+ *
+ *	t_loadable	hello_builtin = {MINISHELL_BUILTIN_ABI, hello, NULL};
+ *
+ * built with cc -shared -fPIC -I include. The builtin then runs in the
+ * shell itself, as echo does: redirections of the command are in place on
+ * in, out and err while run is called, argv holds the expanded words with
+ * argv[0] the name, and its return value is $?. It must not exit() and
+ * should not keep the shell's memory, argv included, past its return.
+ * A shared object is never unloaded.
+ */
+
+/* Bumped whenever a struct below changes */
+# define MINISHELL_BUILTIN_ABI 1
+
+/*
+ * What the shell offers a builtin. get_var returns the value of a
+ * variable, element 0 of an array, or NULL when it is unset; the string
+ * belongs to the shell and stays valid until the variable changes.
+ * set_var assigns a shell variable as NAME=value would, export keeps
+ * exported ones exported, and unset_var unsets one; they return 0, or -1
+ * for a name that is not an identifier.
+ */
+typedef struct s_shell_api
+{
+	int					abi;
+	int					in;
+	int					out;
+	int					err;
+	const char			*(*get_var)(const char *name);
+	int					(*set_var)(const char *name, const char *value);
+	int					(*unset_var)(const char *name);
+}	t_shell_api;
+
+/*
+ * A loadable builtin. abi is MINISHELL_BUILTIN_ABI as the builtin was
+ * built with. load, if set, is called once by enable -f, which fails when
+ * it returns nonzero.
+ */
+typedef struct s_loadable
+{
+	int					abi;
+	int					(*run)(int argc, char **argv,
+			const t_shell_api *shell);
+	int					(*load)(const t_shell_api *shell);
+}	t_loadable;
+
+#endif
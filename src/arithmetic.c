@@ -0,0 +1,723 @@
+#include "../include/minishell.h"
+
+/* Arithmetic node types */
+typedef enum e_arith_op
+{
+	ARITH_NUM,
+	ARITH_VAR,
+	ARITH_NEG,
+	ARITH_NOT,
+	ARITH_BNOT,
+	ARITH_PREINC,
+	ARITH_PREDEC,
+	ARITH_POSTINC,
+	ARITH_POSTDEC,
+	ARITH_POW,
+	ARITH_MUL,
+	ARITH_DIV,
+	ARITH_MOD,
+	ARITH_ADD,
+	ARITH_SUB,
+	ARITH_SHL,
+	ARITH_SHR,
+	ARITH_LT,
+	ARITH_LE,
+	ARITH_GT,
+	ARITH_GE,
+	ARITH_EQ,
+	ARITH_NE,
+	ARITH_BAND,
+	ARITH_BXOR,
+	ARITH_BOR,
+	ARITH_LAND,
+	ARITH_LOR,
+	ARITH_TERNARY,
+	ARITH_ASSIGN,
+	ARITH_COMMA,
+	ARITH_NONE
+}	t_arith_op;
+
+/* Parsed expression, ARITH_ASSIGN keeps its compound operator in sub_op
+ * and an ARITH_VAR for name[subscript] the subscript text */
+typedef struct s_arith
+{
+	t_arith_op			op;
+	t_arith_op			sub_op;
+	long long			value;
+	char				*name;
+	char				*subscript;
+	struct s_arith		*left;
+	struct s_arith		*right;
+	struct s_arith		*cond;
+}	t_arith;
+
+/* Operator spelling, node type and binary precedence (0 = not binary) */
+typedef struct s_arith_opdef
+{
+	char				*str;
+	t_arith_op			op;
+	int					prec;
+}	t_arith_opdef;
+
+/* Cached parse of an expression text, or the template of a text that
+ * is expanded before it is parsed */
+typedef struct s_arith_cache
+{
+	char					*expr;
+	t_arith					*tree;
+	t_word					*word;
+	struct s_arith_cache	*next;
+}	t_arith_cache;
+
+# define ARITH_CACHE_SIZE 256
+# define ARITH_CACHE_MAX 4096
+# define ARITH_NEST_MAX 1024
+
+/* Longest spellings first so "<<=" never reads as "<<" */
+static const t_arith_opdef	g_ops[] = {
+	{"<<=", ARITH_SHL, -1}, {">>=", ARITH_SHR, -1},
+	{"**", ARITH_POW, 11}, {"<<", ARITH_SHL, 8}, {">>", ARITH_SHR, 8},
+	{"<=", ARITH_LE, 7}, {">=", ARITH_GE, 7}, {"==", ARITH_EQ, 6},
+	{"!=", ARITH_NE, 6}, {"&&", ARITH_LAND, 2}, {"||", ARITH_LOR, 1},
+	{"+=", ARITH_ADD, -1}, {"-=", ARITH_SUB, -1}, {"*=", ARITH_MUL, -1},
+	{"/=", ARITH_DIV, -1}, {"%=", ARITH_MOD, -1}, {"&=", ARITH_BAND, -1},
+	{"^=", ARITH_BXOR, -1}, {"|=", ARITH_BOR, -1},
+	{"++", ARITH_PREINC, 0}, {"--", ARITH_PREDEC, 0},
+	{"*", ARITH_MUL, 10}, {"/", ARITH_DIV, 10}, {"%", ARITH_MOD, 10},
+	{"+", ARITH_ADD, 9}, {"-", ARITH_SUB, 9}, {"<", ARITH_LT, 7},
+	{">", ARITH_GT, 7}, {"&", ARITH_BAND, 5}, {"^", ARITH_BXOR, 4},
+	{"|", ARITH_BOR, 3}, {"=", ARITH_ASSIGN, -1}, {"?", ARITH_TERNARY, 0},
+	{":", ARITH_NONE, 0}, {",", ARITH_COMMA, 0}, {"!", ARITH_NOT, 0},
+	{"~", ARITH_BNOT, 0}, {"(", ARITH_NONE, 0}, {")", ARITH_NONE, 0},
+	{NULL, ARITH_NONE, 0}
+};
+
+static t_arith_cache	*g_arith_cache[ARITH_CACHE_SIZE];
+static int				g_arith_cached;
+static int				g_arith_nesting;
+
+static t_arith	*parse_comma(char **s);
+
+static t_arith	*new_node(t_arith_op op, t_arith *left, t_arith *right)
+{
+	t_arith	*node;
+
+	node = safe_malloc(sizeof(t_arith));
+	node->op = op;
+	node->sub_op = ARITH_NONE;
+	node->value = 0;
+	node->name = NULL;
+	node->subscript = NULL;
+	node->left = left;
+	node->right = right;
+	node->cond = NULL;
+	return (node);
+}
+
+static void	free_arith(t_arith *node)
+{
+	if (!node)
+		return ;
+	free_arith(node->left);
+	free_arith(node->right);
+	free_arith(node->cond);
+	free(node->name);
+	free(node->subscript);
+	free(node);
+}
+
+/* Operator at *s without consuming it, NULL if there is none */
+static const t_arith_opdef	*peek_op(char **s)
+{
+	int	i;
+
+	while (isspace(**s))
+		(*s)++;
+	i = 0;
+	while (g_ops[i].str)
+	{
+		if (strncmp(*s, g_ops[i].str, strlen(g_ops[i].str)) == 0)
+			return (&g_ops[i]);
+		i++;
+	}
+	return (NULL);
+}
+
+static int	accept_token(char **s, char *str)
+{
+	const t_arith_opdef	*def;
+
+	def = peek_op(s);
+	if (!def || strcmp(def->str, str) != 0)
+		return (0);
+	*s += strlen(str);
+	return (1);
+}
+
+/* The [subscript] of an array element at *s, up to the matching ] */
+static int	parse_subscript(char **s, t_arith *node)
+{
+	int	depth;
+	int	i;
+
+	depth = 0;
+	i = 0;
+	while ((*s)[i] && ((*s)[i] != ']' || --depth > 0))
+		if ((*s)[i++] == '[')
+			depth++;
+	if (!(*s)[i] || strspn(*s + 1, " \t") >= (size_t)i - 1)
+		return (0);
+	node->subscript = strndup(*s + 1, i - 1);
+	*s += i + 1;
+	return (1);
+}
+
+static t_arith	*parse_primary(char **s)
+{
+	t_arith	*node;
+	char	*end;
+	int		len;
+
+	while (isspace(**s))
+		(*s)++;
+	if (accept_token(s, "("))
+	{
+		node = parse_comma(s);
+		if (node && !accept_token(s, ")"))
+		{
+			free_arith(node);
+			return (NULL);
+		}
+		return (node);
+	}
+	if (isdigit(**s))
+	{
+		node = new_node(ARITH_NUM, NULL, NULL);
+		node->value = strtoll(*s, &end, 0);
+		*s = end;
+		return (node);
+	}
+	len = 0;
+	if (**s == '$')
+	{
+		(*s)++;
+		/* $1, $# and $? read like variables */
+		while (isdigit((*s)[len]))
+			len++;
+		if (len == 0 && (**s == '#' || **s == '?'))
+			len = 1;
+	}
+	if (len == 0)
+	{
+		while (isalnum((*s)[len]) || (*s)[len] == '_')
+			len++;
+		if (len == 0 || isdigit(**s))
+			return (NULL);
+	}
+	node = new_node(ARITH_VAR, NULL, NULL);
+	node->name = safe_malloc(len + 1);
+	strncpy(node->name, *s, len);
+	node->name[len] = '\0';
+	*s += len;
+	if (**s == '[' && !isdigit(node->name[0]) && !parse_subscript(s, node))
+	{
+		free_arith(node);
+		return (NULL);
+	}
+	if (accept_token(s, "++"))
+		return (new_node(ARITH_POSTINC, node, NULL));
+	if (accept_token(s, "--"))
+		return (new_node(ARITH_POSTDEC, node, NULL));
+	return (node);
+}
+
+static t_arith	*parse_unary(char **s)
+{
+	t_arith		*operand;
+	t_arith_op	op;
+
+	if (accept_token(s, "++"))
+		op = ARITH_PREINC;
+	else if (accept_token(s, "--"))
+		op = ARITH_PREDEC;
+	else if (accept_token(s, "-"))
+		op = ARITH_NEG;
+	else if (accept_token(s, "!"))
+		op = ARITH_NOT;
+	else if (accept_token(s, "~"))
+		op = ARITH_BNOT;
+	else if (accept_token(s, "+"))
+		return (parse_unary(s));
+	else
+		return (parse_primary(s));
+	operand = parse_unary(s);
+	if (!operand || ((op == ARITH_PREINC || op == ARITH_PREDEC)
+			&& operand->op != ARITH_VAR))
+	{
+		free_arith(operand);
+		return (NULL);
+	}
+	return (new_node(op, operand, NULL));
+}
+
+/* Precedence climbing over the binary operators of g_ops */
+static t_arith	*parse_binary(char **s, int min_prec)
+{
+	const t_arith_opdef	*def;
+	t_arith				*left;
+	t_arith				*right;
+
+	left = parse_unary(s);
+	while (left)
+	{
+		def = peek_op(s);
+		if (!def || def->prec < min_prec || def->prec <= 0)
+			break ;
+		*s += strlen(def->str);
+		/* ** is right associative, everything else left */
+		right = parse_binary(s, def->op == ARITH_POW ? def->prec
+				: def->prec + 1);
+		if (!right)
+		{
+			free_arith(left);
+			return (NULL);
+		}
+		left = new_node(def->op, left, right);
+	}
+	return (left);
+}
+
+static t_arith	*parse_assign(char **s)
+{
+	const t_arith_opdef	*def;
+	t_arith				*node;
+	t_arith				*branch;
+
+	node = parse_binary(s, 1);
+	if (node && accept_token(s, "?"))
+	{
+		branch = new_node(ARITH_TERNARY, parse_assign(s), NULL);
+		branch->cond = node;
+		if (!branch->left || !accept_token(s, ":")
+			|| !(branch->right = parse_assign(s)))
+		{
+			free_arith(branch);
+			return (NULL);
+		}
+		return (branch);
+	}
+	def = peek_op(s);
+	if (!node || !def || def->prec != -1)
+		return (node);
+	if (node->op != ARITH_VAR)
+	{
+		free_arith(node);
+		return (NULL);
+	}
+	*s += strlen(def->str);
+	node = new_node(ARITH_ASSIGN, node, parse_assign(s));
+	node->sub_op = def->op;
+	if (!node->right)
+	{
+		free_arith(node);
+		return (NULL);
+	}
+	return (node);
+}
+
+static t_arith	*parse_comma(char **s)
+{
+	t_arith	*node;
+	t_arith	*right;
+
+	node = parse_assign(s);
+	while (node && accept_token(s, ","))
+	{
+		right = parse_assign(s);
+		if (!right)
+		{
+			free_arith(node);
+			return (NULL);
+		}
+		node = new_node(ARITH_COMMA, node, right);
+	}
+	return (node);
+}
+
+static int	evaluate_text(char *expr, long long *result);
+
+/* A value that is a whole number is read as one, any other is evaluated
+ * as an expression in turn, as x=1+2; $((x * 2)) wants */
+static int	value_of(char *value, long long *out)
+{
+	char	*end;
+
+	*out = 0;
+	if (!value || !*value)
+		return (1);
+	errno = 0;
+	*out = strtoll(value, &end, 0);
+	if (end != value && !*end && !errno)
+		return (1);
+	return (evaluate_text(value, out));
+}
+
+/* A variable, or the element under key of an array; a variable that is an
+ * array reads as its element 0 */
+static int	get_var(char *name, char *key, long long *out)
+{
+	char	*value;
+	int		ok;
+
+	if (!key && find_array(name))
+		key = "0";
+	if (!key && (isalpha(name[0]) || name[0] == '_'))
+		return (value_of(get_env_value(name), out));
+	value = key ? array_value(name, key, 0) : variable_value(name);
+	ok = value_of(value, out);
+	free(value);
+	return (ok);
+}
+
+static int	set_var(char *name, char *key, long long value)
+{
+	char	str[24];
+
+	sprintf(str, "%lld", value);
+	if (!key && !find_array(name))
+	{
+		set_shell_value(name, str);
+		return (1);
+	}
+	return (array_store(make_array(name, 0), key ? key : "0",
+			safe_strdup(str)));
+}
+
+/* The key of an ARITH_VAR in the array store, NULL for a plain variable:
+ * the subscript text for an associative array, else its value */
+static int	element_key(t_arith *var, char **key)
+{
+	t_array		*arr;
+	long long	index;
+
+	*key = NULL;
+	if (!var->subscript)
+		return (1);
+	arr = find_array(var->name);
+	if (arr && arr->assoc)
+	{
+		*key = safe_strdup(var->subscript);
+		return (1);
+	}
+	if (!evaluate_text(var->subscript, &index))
+		return (0);
+	*key = safe_malloc(24);
+	sprintf(*key, "%lld", index);
+	return (1);
+}
+
+/* Squaring, in unsigned arithmetic that wraps like the other operators */
+static long long	power(long long base, long long exponent)
+{
+	unsigned long long	result;
+	unsigned long long	square;
+
+	result = 1;
+	square = base;
+	while (exponent > 0)
+	{
+		if (exponent & 1)
+			result *= square;
+		square *= square;
+		exponent >>= 1;
+	}
+	return ((long long)result);
+}
+
+static long long	step(long long value, t_arith_op op)
+{
+	if (op == ARITH_PREINC || op == ARITH_POSTINC)
+		return ((long long)((unsigned long long)value + 1));
+	return ((long long)((unsigned long long)value - 1));
+}
+
+static int	apply_binary(t_arith_op op, long long a, long long b,
+	long long *out)
+{
+	if ((op == ARITH_DIV || op == ARITH_MOD) && b == 0)
+	{
+		print_error("arithmetic", "division by 0");
+		return (0);
+	}
+	if (op == ARITH_POW && b < 0)
+	{
+		print_error("arithmetic", "exponent less than 0");
+		return (0);
+	}
+	if (op == ARITH_POW)
+		*out = power(a, b);
+	else if (op == ARITH_MUL)
+		*out = (long long)((unsigned long long)a * (unsigned long long)b);
+	else if (op == ARITH_DIV)
+		*out = (a == LLONG_MIN && b == -1) ? a : a / b;
+	else if (op == ARITH_MOD)
+		*out = (b == -1) ? 0 : a % b;
+	else if (op == ARITH_ADD)
+		*out = (long long)((unsigned long long)a + (unsigned long long)b);
+	else if (op == ARITH_SUB)
+		*out = (long long)((unsigned long long)a - (unsigned long long)b);
+	else if (op == ARITH_SHL)
+		*out = (long long)((unsigned long long)a << (b & 63));
+	else if (op == ARITH_SHR)
+		*out = a >> (b & 63);
+	else if (op == ARITH_LT || op == ARITH_LE)
+		*out = (op == ARITH_LT) ? a < b : a <= b;
+	else if (op == ARITH_GT || op == ARITH_GE)
+		*out = (op == ARITH_GT) ? a > b : a >= b;
+	else if (op == ARITH_EQ || op == ARITH_NE)
+		*out = (op == ARITH_EQ) ? a == b : a != b;
+	else if (op == ARITH_BAND)
+		*out = a & b;
+	else if (op == ARITH_BXOR)
+		*out = a ^ b;
+	else
+		*out = a | b;
+	return (1);
+}
+
+static int	eval(t_arith *node, long long *out);
+
+/* ++/-- and assignments read and write one variable or element, whose
+ * subscript is evaluated once */
+static int	eval_update(t_arith *node, long long *out)
+{
+	char		*key;
+	long long	a;
+	long long	b;
+	int			ok;
+
+	if (node->op == ARITH_ASSIGN && !eval(node->right, &b))
+		return (0);
+	if (!element_key(node->left, &key))
+		return (0);
+	ok = (node->op == ARITH_ASSIGN && node->sub_op == ARITH_ASSIGN)
+		|| get_var(node->left->name, key, &a);
+	if (ok && node->op != ARITH_ASSIGN)
+		b = step(a, node->op);
+	else if (ok && node->sub_op != ARITH_ASSIGN)
+		ok = apply_binary(node->sub_op, a, b, &b);
+	ok = ok && set_var(node->left->name, key, b);
+	*out = (node->op == ARITH_POSTINC || node->op == ARITH_POSTDEC) ? a : b;
+	free(key);
+	return (ok);
+}
+
+static int	eval(t_arith *node, long long *out)
+{
+	long long	a;
+	long long	b;
+	char		*key;
+	int			ok;
+
+	if (node->op == ARITH_NUM)
+		*out = node->value;
+	else if (node->op == ARITH_VAR)
+	{
+		if (!element_key(node, &key))
+			return (0);
+		ok = get_var(node->name, key, out);
+		free(key);
+		return (ok);
+	}
+	else if ((node->op >= ARITH_PREINC && node->op <= ARITH_POSTDEC)
+		|| node->op == ARITH_ASSIGN)
+		return (eval_update(node, out));
+	else if (node->op == ARITH_LAND || node->op == ARITH_LOR)
+	{
+		if (!eval(node->left, &a))
+			return (0);
+		if ((node->op == ARITH_LAND) == (a != 0))
+		{
+			if (!eval(node->right, &b))
+				return (0);
+			a = b;
+		}
+		*out = (a != 0);
+	}
+	else if (node->op == ARITH_TERNARY)
+	{
+		if (!eval(node->cond, &a))
+			return (0);
+		return (eval(a ? node->left : node->right, out));
+	}
+	else if (node->op == ARITH_COMMA)
+		return (eval(node->left, &a) && eval(node->right, out));
+	else if (node->op == ARITH_NEG || node->op == ARITH_NOT
+		|| node->op == ARITH_BNOT)
+	{
+		if (!eval(node->left, &a))
+			return (0);
+		if (node->op == ARITH_NEG)
+			*out = (long long)(0ULL - (unsigned long long)a);
+		else
+			*out = (node->op == ARITH_NOT) ? !a : ~a;
+	}
+	else
+	{
+		if (!eval(node->left, &a) || !eval(node->right, &b))
+			return (0);
+		return (apply_binary(node->op, a, b, out));
+	}
+	return (1);
+}
+
+static void	flush_cache(void)
+{
+	t_arith_cache	*entry;
+	t_arith_cache	*next;
+	int				i;
+
+	i = 0;
+	while (i < ARITH_CACHE_SIZE)
+	{
+		entry = g_arith_cache[i];
+		while (entry)
+		{
+			next = entry->next;
+			free(entry->expr);
+			free_arith(entry->tree);
+			free_words(entry->word);
+			free(entry);
+			entry = next;
+		}
+		g_arith_cache[i++] = NULL;
+	}
+	g_arith_cached = 0;
+}
+
+static t_arith_cache	*find_entry(char *expr)
+{
+	t_arith_cache	*entry;
+
+	entry = g_arith_cache[hash_string(expr) % ARITH_CACHE_SIZE];
+	while (entry && strcmp(entry->expr, expr) != 0)
+		entry = entry->next;
+	return (entry);
+}
+
+static t_arith_cache	*add_entry(char *expr)
+{
+	t_arith_cache	*entry;
+	unsigned int	slot;
+
+	slot = hash_string(expr) % ARITH_CACHE_SIZE;
+	entry = safe_malloc(sizeof(t_arith_cache));
+	entry->expr = safe_strdup(expr);
+	entry->tree = NULL;
+	entry->word = NULL;
+	entry->next = g_arith_cache[slot];
+	g_arith_cache[slot] = entry;
+	g_arith_cached++;
+	return (entry);
+}
+
+/* Parses expr once; later evaluations of the same text reuse the tree */
+static t_arith	*get_tree(char *expr)
+{
+	t_arith_cache	*entry;
+	t_arith			*tree;
+	char			*s;
+
+	entry = find_entry(expr);
+	if (entry && entry->tree)
+		return (entry->tree);
+	s = expr;
+	tree = parse_comma(&s);
+	while (tree && isspace(*s))
+		s++;
+	if (!tree || *s)
+	{
+		free_arith(tree);
+		return (NULL);
+	}
+	if (!entry)
+		entry = add_entry(expr);
+	entry->tree = tree;
+	return (tree);
+}
+
+/* Evaluates expr as it is, without expanding it */
+static int	evaluate_text(char *expr, long long *result)
+{
+	t_arith	*tree;
+	char	*s;
+	int		ok;
+
+	s = expr;
+	while (isspace(*s))
+		s++;
+	*result = 0;
+	if (!*s)
+		return (1);
+	if (g_arith_nesting >= ARITH_NEST_MAX)
+	{
+		print_error(expr, "expression recursion level exceeded");
+		return (0);
+	}
+	tree = get_tree(expr);
+	if (!tree)
+	{
+		print_error(expr, "arithmetic syntax error");
+		return (0);
+	}
+	g_arith_nesting++;
+	ok = eval(tree, result);
+	g_arith_nesting--;
+	return (ok);
+}
+
+/* expr with its parameters, arithmetic and command substitutions
+ * expanded, from a template compiled once per text */
+static char	*expand_expression(char *expr)
+{
+	t_arith_cache	*entry;
+
+	entry = find_entry(expr);
+	if (!entry)
+		entry = add_entry(expr);
+	if (!entry->word)
+		entry->word = compile_word(expr);
+	return (expand_word_string(entry->word, NULL));
+}
+
+/*
+ * Evaluates expr as 64-bit integer arithmetic, variables read and written
+ * through the environment, after expanding it as bash does. Returns 0
+ * (after printing why) on error.
+ */
+int	evaluate_arithmetic(char *expr, long long *result)
+{
+	char	*expanded;
+	int		failed;
+	int		ok;
+
+	/* Trees in use by an outer evaluation are never freed under it */
+	if (g_arith_nesting == 0 && g_arith_cached >= ARITH_CACHE_MAX)
+		flush_cache();
+	if (!strpbrk(expr, "$`\"'\\"))
+		return (evaluate_text(expr, result));
+	failed = g_shell.expand_failed;
+	g_shell.expand_failed = 0;
+	g_arith_nesting++;
+	expanded = expand_expression(expr);
+	g_arith_nesting--;
+	ok = !g_shell.expand_failed && evaluate_text(expanded, result);
+	g_shell.expand_failed |= failed;
+	free(expanded);
+	return (ok);
+}
+
+void	free_arithmetic_cache(void)
+{
+	flush_cache();
+}
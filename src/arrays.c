@@ -0,0 +1,814 @@
+#include "../include/minishell.h"
+
+/*
+ * Array variables. An indexed array is one contiguous vector indexed by
+ * subscript, an associative array appends its values to the same kind of
+ * vector with the keys alongside and finds them through a hash index. So
+ * "${a[@]}" is a walk over one vector for both kinds, and filling an
+ * array (mapfile, a=(...)) is mostly appends.
+ */
+
+# define ARRAY_INDEX_MAX 16777216
+# define MAPFILE_BLOCK 65536
+
+/* mapfile options and progress */
+typedef struct s_mapfile
+{
+	int					fd;
+	char				delim;
+	int					trim;
+	long				count;
+	long				skip;
+	long				stored;
+}	t_mapfile;
+
+static void	grow_slots(t_array *arr, int needed)
+{
+	int	old_cap;
+
+	if (needed <= arr->cap)
+		return ;
+	old_cap = arr->cap;
+	if (arr->cap == 0)
+		arr->cap = 8;
+	while (arr->cap < needed)
+		arr->cap *= 2;
+	arr->values = realloc(arr->values, sizeof(char *) * arr->cap);
+	if (arr->assoc)
+		arr->keys = realloc(arr->keys, sizeof(char *) * arr->cap);
+	if (!arr->values || (arr->assoc && !arr->keys))
+		exit_error("realloc failed");
+	memset(arr->values + old_cap, 0, sizeof(char *) * (arr->cap - old_cap));
+	if (arr->assoc)
+		memset(arr->keys + old_cap, 0, sizeof(char *) * (arr->cap - old_cap));
+}
+
+/* Element index of an indexed array subscript, an arithmetic expression;
+ * negative ones count back from the end. 0 (reported) if out of range */
+static int	element_index(t_array *arr, char *key, int *index)
+{
+	long long	value;
+	int			i;
+
+	i = 0;
+	while (isdigit(key[i]) && i < 8)
+		i++;
+	if (i > 0 && !key[i])
+		value = atoi(key);
+	else if (!evaluate_arithmetic(key, &value))
+		return (0);
+	if (value < 0)
+		value += arr->len;
+	if (value < 0 || value >= ARRAY_INDEX_MAX)
+	{
+		print_error(key, "bad array subscript");
+		return (0);
+	}
+	*index = value;
+	return (1);
+}
+
+/* Slot of key in an associative array, -1 if it isn't set */
+static int	find_slot(t_array *arr, char *key)
+{
+	unsigned int	pos;
+	int				slot;
+
+	if (arr->index_size == 0)
+		return (-1);
+	pos = hash_string(key) & (arr->index_size - 1);
+	while (arr->index[pos])
+	{
+		slot = arr->index[pos] - 1;
+		if (arr->keys[slot] && strcmp(arr->keys[slot], key) == 0)
+			return (slot);
+		pos = (pos + 1) & (arr->index_size - 1);
+	}
+	return (-1);
+}
+
+/* Drops unset slots and rebuilds the index with room to grow. Unset
+ * slots stay in the index as tombstones until then */
+static void	reindex(t_array *arr)
+{
+	unsigned int	pos;
+	int				len;
+	int				i;
+
+	len = 0;
+	i = -1;
+	while (++i < arr->len)
+	{
+		if (!arr->keys[i])
+			continue ;
+		arr->keys[len] = arr->keys[i];
+		arr->values[len++] = arr->values[i];
+	}
+	arr->len = len;
+	if (arr->index_size < 16 || arr->index_size < (len + 1) * 4)
+	{
+		free(arr->index);
+		arr->index_size = 16;
+		while (arr->index_size < (len + 1) * 4)
+			arr->index_size *= 2;
+		arr->index = safe_malloc(sizeof(int) * arr->index_size);
+	}
+	memset(arr->index, 0, sizeof(int) * arr->index_size);
+	i = -1;
+	while (++i < len)
+	{
+		pos = hash_string(arr->keys[i]) & (arr->index_size - 1);
+		while (arr->index[pos])
+			pos = (pos + 1) & (arr->index_size - 1);
+		arr->index[pos] = i + 1;
+	}
+}
+
+static void	store_key(t_array *arr, char *key, char *value)
+{
+	unsigned int	pos;
+	int				slot;
+
+	slot = find_slot(arr, key);
+	if (slot >= 0)
+	{
+		free(arr->values[slot]);
+		arr->values[slot] = value;
+		return ;
+	}
+	if ((arr->len + 1) * 2 > arr->index_size)
+		reindex(arr);
+	grow_slots(arr, arr->len + 1);
+	slot = arr->len++;
+	arr->keys[slot] = safe_strdup(key);
+	arr->values[slot] = value;
+	arr->count++;
+	pos = hash_string(key) & (arr->index_size - 1);
+	while (arr->index[pos])
+		pos = (pos + 1) & (arr->index_size - 1);
+	arr->index[pos] = slot + 1;
+}
+
+/* Stores value (taking ownership) under an expanded subscript. Returns 0
+ * for a bad subscript, value is freed then */
+int	array_store(t_array *arr, char *key, char *value)
+{
+	int	i;
+
+	if (arr->assoc && *key)
+	{
+		store_key(arr, key, value);
+		return (1);
+	}
+	if (arr->assoc)
+		print_error("\"\"", "bad array subscript");
+	if (arr->assoc || !element_index(arr, key, &i))
+	{
+		free(value);
+		return (0);
+	}
+	grow_slots(arr, i + 1);
+	if (arr->values[i])
+		free(arr->values[i]);
+	else
+		arr->count++;
+	arr->values[i] = value;
+	if (i >= arr->len)
+		arr->len = i + 1;
+	return (1);
+}
+
+/* Appends after the last element of an indexed array */
+void	array_push(t_array *arr, char *value)
+{
+	grow_slots(arr, arr->len + 1);
+	arr->values[arr->len++] = value;
+	arr->count++;
+}
+
+/* The element stored under an expanded subscript, NULL if unset */
+char	*array_get(t_array *arr, char *key)
+{
+	int	i;
+
+	if (arr->assoc)
+	{
+		i = find_slot(arr, key);
+		return (i >= 0 ? arr->values[i] : NULL);
+	}
+	if (!element_index(arr, key, &i) || i >= arr->len)
+		return (NULL);
+	return (arr->values[i]);
+}
+
+int	array_unset(t_array *arr, char *key)
+{
+	int	i;
+
+	if (arr->assoc)
+		i = find_slot(arr, key);
+	else if (!element_index(arr, key, &i) || i >= arr->len)
+		return (0);
+	if (i < 0 || !arr->values[i])
+		return (0);
+	free(arr->values[i]);
+	arr->values[i] = NULL;
+	if (arr->assoc)
+	{
+		free(arr->keys[i]);
+		arr->keys[i] = NULL;
+	}
+	arr->count--;
+	while (!arr->assoc && arr->len > 0 && !arr->values[arr->len - 1])
+		arr->len--;
+	return (1);
+}
+
+void	clear_array(t_array *arr)
+{
+	int	i;
+
+	i = 0;
+	while (i < arr->len)
+	{
+		free(arr->values[i]);
+		arr->values[i] = NULL;
+		if (arr->assoc)
+		{
+			free(arr->keys[i]);
+			arr->keys[i] = NULL;
+		}
+		i++;
+	}
+	arr->len = 0;
+	arr->count = 0;
+	if (arr->index)
+		memset(arr->index, 0, sizeof(int) * arr->index_size);
+}
+
+void	free_array(t_array *arr)
+{
+	if (!arr)
+		return ;
+	clear_array(arr);
+	free(arr->values);
+	free(arr->keys);
+	free(arr->index);
+	free(arr);
+}
+
+/* NAME[@] or NAME[*] at body, the length of NAME when it is */
+static int	list_name_length(char *body)
+{
+	int	len;
+
+	if (!isalpha(body[0]) && body[0] != '_')
+		return (0);
+	len = 1;
+	while (isalnum(body[len]) || body[len] == '_')
+		len++;
+	if (body[len] == '[' && (body[len + 1] == '@' || body[len + 1] == '*')
+		&& body[len + 2] == ']' && !body[len + 3])
+		return (len);
+	return (0);
+}
+
+/* "${a[@]}" and "${!a[@]}", which expand to a field per element */
+int	is_array_list(char *body)
+{
+	int	len;
+
+	len = list_name_length(body + (body[0] == '!'));
+	return (len > 0 && body[len + 1 + (body[0] == '!')] == '@');
+}
+
+/* Subscripts of the set elements of an indexed array, as strings */
+static char	**index_strings(t_array *arr)
+{
+	char	**keys;
+	int		count;
+	int		i;
+
+	keys = safe_malloc(sizeof(char *) * (arr->count + 1));
+	count = 0;
+	i = -1;
+	while (++i < arr->len)
+	{
+		if (!arr->values[i])
+			continue ;
+		keys[count] = safe_malloc(12);
+		sprintf(keys[count++], "%d", i);
+	}
+	keys[count] = NULL;
+	return (keys);
+}
+
+/*
+ * The vector behind ${name[@]} (values) or ${!name[@]} (keys), *len slots
+ * of which NULL ones are unset. It is the array's own storage, except for
+ * a scalar or the subscripts of an indexed array: *made is set then and
+ * the caller frees the vector with free_string_array().
+ */
+char	**array_items(char *body, int *len, int *made)
+{
+	t_array	*arr;
+	char	**items;
+	char	*name;
+	int		keys;
+
+	keys = (body[0] == '!');
+	name = safe_malloc(list_name_length(body + keys) + 1);
+	memcpy(name, body + keys, list_name_length(body + keys));
+	name[list_name_length(body + keys)] = '\0';
+	arr = find_array(name);
+	*made = (!arr || (keys && !arr->assoc));
+	*len = 0;
+	items = NULL;
+	if (arr && (!keys || arr->assoc))
+	{
+		*len = arr->len;
+		items = keys ? arr->keys : arr->values;
+	}
+	else if (arr)
+	{
+		*len = arr->count;
+		items = index_strings(arr);
+	}
+	else if (get_env_value(name))
+	{
+		items = safe_malloc(sizeof(char *) * 2);
+		items[0] = safe_strdup(keys ? "0" : get_env_value(name));
+		items[1] = NULL;
+		*len = 1;
+	}
+	free(name);
+	return (items);
+}
+
+/* The set items joined by sep, the value of an unquoted ${a[@]} */
+static char	*join_items(char *body, char *sep)
+{
+	t_buf	buf;
+	char	**items;
+	int		made;
+	int		len;
+	int		first;
+	int		i;
+
+	items = array_items(body, &len, &made);
+	buf_init(&buf, 64);
+	first = 1;
+	i = -1;
+	while (++i < len)
+	{
+		if (!items[i])
+			continue ;
+		if (!first)
+			buf_add_str(&buf, sep);
+		buf_add_str(&buf, items[i]);
+		first = 0;
+	}
+	if (made)
+		free_string_array(items);
+	return (buf.data);
+}
+
+/* ${!a[@]} and ${!a[*]} outside double quotes, NULL for any other
+ * ${!...} */
+char	*array_keys(char *body)
+{
+	if (!list_name_length(body + 1))
+		return (NULL);
+	return (join_items(body, " "));
+}
+
+/* ${a[@]:offset} and ${a[@]:offset:length}, range being what follows the
+ * first colon (and cut up here). Offsets are indexes, counted from the
+ * end when negative; length counts set elements */
+char	*array_slice(char *name, char *range)
+{
+	t_array		*arr;
+	t_buf		buf;
+	char		*sep;
+	long long	off;
+	long long	count;
+	int			first;
+	int			i;
+
+	sep = strchr(range, ':');
+	if (sep)
+		*sep = '\0';
+	arr = find_array(name);
+	if (!arr || arr->assoc || !evaluate_arithmetic(range, &off)
+		|| (sep && !evaluate_arithmetic(sep + 1, &count)))
+		return (safe_strdup(""));
+	if (!sep)
+		count = arr->count;
+	if (off < 0)
+		off = (arr->len + off < 0) ? arr->len : arr->len + off;
+	buf_init(&buf, 64);
+	first = 1;
+	i = off - 1;
+	while (++i < arr->len && count > 0)
+	{
+		if (!arr->values[i])
+			continue ;
+		if (!first)
+			buf_add_char(&buf, ' ');
+		first = 0;
+		buf_add_str(&buf, arr->values[i]);
+		count--;
+	}
+	return (buf.data);
+}
+
+/* Whether the subscript of a scalar, which only has element 0, is 0 */
+static int	is_scalar_index(char *subscript)
+{
+	t_array	scalar;
+	int		i;
+
+	memset(&scalar, 0, sizeof(t_array));
+	scalar.len = 1;
+	return (element_index(&scalar, subscript, &i) && i == 0);
+}
+
+/* ${a[@]} ${a[*]} ${#a[@]}: NAME[@] is rebuilt from name for join_items */
+static char	*list_value(char *name, char *subscript, int length)
+{
+	t_array	*arr;
+	char	*body;
+	char	*ifs;
+	char	*value;
+	char	sep[2];
+
+	arr = find_array(name);
+	if (length)
+	{
+		value = safe_malloc(12);
+		sprintf(value, "%d", arr ? arr->count : get_env_value(name) != NULL);
+		return (value);
+	}
+	ifs = get_env_value("IFS");
+	sep[0] = (subscript[0] == '*' && ifs) ? ifs[0] : ' ';
+	sep[1] = '\0';
+	body = safe_malloc(strlen(name) + 4);
+	sprintf(body, "%s[%c]", name, subscript[0]);
+	value = join_items(body, sep);
+	free(body);
+	return (value);
+}
+
+/*
+ * Value of ${name[subscript]} as a new string, NULL when unset; with
+ * length set, of ${#name[subscript]}. Indexed subscripts are arithmetic,
+ * associative ones are expanded as a word. A scalar is element 0.
+ */
+char	*array_value(char *name, char *subscript, int length)
+{
+	t_array	*arr;
+	char	*key;
+	char	*value;
+
+	if ((subscript[0] == '@' || subscript[0] == '*') && !subscript[1])
+		return (list_value(name, subscript, length));
+	arr = find_array(name);
+	value = NULL;
+	if (arr && arr->assoc)
+	{
+		key = expand_variables(subscript);
+		value = array_get(arr, key);
+		free(key);
+	}
+	else if (arr)
+		value = array_get(arr, subscript);
+	else if (get_env_value(name) && is_scalar_index(subscript))
+		value = get_env_value(name);
+	if (!value)
+		return (length ? safe_strdup("0") : NULL);
+	if (!length)
+		return (safe_strdup(value));
+	key = safe_malloc(12);
+	sprintf(key, "%d", (int)strlen(value));
+	return (key);
+}
+
+/* Double-quoted the way declare -p prints values */
+static void	print_quoted(char *value)
+{
+	printf("\"");
+	while (*value)
+	{
+		if (strchr("\"\\$`", *value))
+			printf("\\");
+		printf("%c", *value++);
+	}
+	printf("\"");
+}
+
+static void	print_variable(t_env *var)
+{
+	t_array	*arr;
+	int		first;
+	int		i;
+
+	arr = var->array;
+	if (!arr)
+	{
+		printf("declare -%s %s=", var->exported ? "x" : "-", var->key);
+		print_quoted(var->value);
+		printf("\n");
+		return ;
+	}
+	printf("declare -%c %s", arr->assoc ? 'A' : 'a', var->key);
+	if (arr->count > 0)
+		printf("=(");
+	first = 1;
+	i = -1;
+	while (arr->count > 0 && ++i < arr->len)
+	{
+		if (!arr->values[i])
+			continue ;
+		if (arr->assoc && !strpbrk(arr->keys[i], " \t\n\"'\\$`|&;<>()[]"))
+			printf("[%s]=", arr->keys[i]);
+		else if (arr->assoc)
+		{
+			printf("[");
+			print_quoted(arr->keys[i]);
+			printf("]=");
+		}
+		else
+			printf("%s[%d]=", first ? "" : " ", i);
+		print_quoted(arr->values[i]);
+		if (arr->assoc)
+			printf(" ");
+		first = 0;
+	}
+	printf("%s\n", arr->count > 0 ? ")" : "");
+}
+
+/* declare -p: the named variables, or all of them */
+static int	print_declared(char **names)
+{
+	t_env	*var;
+	char	*msg;
+	int		status;
+
+	status = 0;
+	var = g_shell.env_list;
+	while (!*names && var)
+	{
+		print_variable(var);
+		var = var->next;
+	}
+	while (*names)
+	{
+		var = g_shell.env_list;
+		while (var && strcmp(var->key, *names) != 0)
+			var = var->next;
+		if (var)
+			print_variable(var);
+		else
+		{
+			msg = join_strings("declare: ", *names);
+			print_error(msg, "not found");
+			free(msg);
+			status = 1;
+		}
+		names++;
+	}
+	return (status);
+}
+
+/*
+ * declare -A m=([key]=value ...) gets its list as an argument, already
+ * expanded: it is split into elements again, quotes are only removed.
+ */
+static void	assign_list(t_array *arr, char *list)
+{
+	t_token	*tokens;
+	t_token	*token;
+	char	*close;
+	char	*value;
+
+	tokens = lexer(list);
+	token = tokens;
+	while (token && token->type != TOKEN_EOF)
+	{
+		close = (token->type == TOKEN_WORD && token->value[0] == '[')
+			? strstr(token->value, "]=") : NULL;
+		if (close)
+		{
+			*close = '\0';
+			value = remove_quotes(token->value + 1);
+			array_store(arr, value, remove_quotes(close + 2));
+			free(value);
+		}
+		else if (token->type == TOKEN_WORD && !arr->assoc)
+			array_push(arr, remove_quotes(token->value));
+		else if (token->type == TOKEN_WORD)
+			print_error(token->value,
+				"must use subscript when assigning associative array");
+		token = token->next;
+	}
+	free_tokens(tokens);
+}
+
+/* One NAME, NAME=value or NAME=(list) operand of declare */
+static int	declare_name(char *arg, int kind, int exported)
+{
+	t_array	*arr;
+	char	*equals;
+	char	*end;
+
+	equals = strchr(arg, '=');
+	if (equals)
+		*equals = '\0';
+	arr = find_array(arg);
+	if (arr && kind == 'A' && !arr->assoc)
+	{
+		print_error(arg, "cannot convert indexed to associative array");
+		return (1);
+	}
+	end = equals ? equals + strlen(equals + 1) : NULL;
+	if (equals && equals[1] == '(' && *end == ')')
+	{
+		*end = '\0';
+		arr = make_array(arg, kind == 'A');
+		clear_array(arr);
+		assign_list(arr, equals + 2);
+		*end = ')';
+	}
+	else if (kind)
+		arr = make_array(arg, kind == 'A');
+	if (equals && !(equals[1] == '(' && *end == ')'))
+		set_shell_value(arg, equals + 1);
+	else if (!equals && !kind && !get_env_value(arg) && !arr)
+		set_shell_value(arg, "");
+	if (exported && !arr)
+		export_variable(arg, 1);
+	if (equals)
+		*equals = '=';
+	return (0);
+}
+
+/* declare [-aApx] [name[=value] ...], typeset is the same builtin */
+int	builtin_declare(char **args)
+{
+	int	kind;
+	int	print;
+	int	exported;
+	int	status;
+	int	i;
+
+	kind = 0;
+	print = 0;
+	exported = 0;
+	while (*++args && (*args)[0] == '-' && (*args)[1])
+	{
+		i = 0;
+		while ((*args)[++i])
+		{
+			if ((*args)[i] == 'a' || (*args)[i] == 'A')
+				kind = (*args)[i];
+			else if ((*args)[i] == 'p')
+				print = 1;
+			else if ((*args)[i] == 'x')
+				exported = 1;
+			else
+			{
+				print_error("declare", "usage: declare [-aApx] [name[=value] ...]");
+				return (2);
+			}
+		}
+	}
+	if (print || !*args)
+		return (print_declared(args));
+	status = 0;
+	while (*args)
+		status |= declare_name(*args++, kind, exported);
+	return (status);
+}
+
+/* Stores one line, 0 once -n lines have been stored */
+static int	store_line(t_array *arr, t_mapfile *opt, char *line, size_t len)
+{
+	char	*copy;
+
+	if (opt->skip > 0)
+	{
+		opt->skip--;
+		return (1);
+	}
+	copy = safe_malloc(len + 1);
+	memcpy(copy, line, len);
+	copy[len] = '\0';
+	array_push(arr, copy);
+	return (opt->count == 0 || ++opt->stored < opt->count);
+}
+
+/*
+ * Reads the descriptor MAPFILE_BLOCK bytes at a time and cuts each block
+ * into lines in place, the partial line at its end moved to the front
+ * for the next read. What was read past the -n limit is given back to a
+ * seekable descriptor.
+ */
+static int	map_lines(t_array *arr, t_mapfile *opt)
+{
+	t_buf	buf;
+	char	*end;
+	size_t	start;
+	ssize_t	n;
+	int		more;
+
+	buf_init(&buf, MAPFILE_BLOCK + 1);
+	n = 0;
+	more = (opt->count == 0 || opt->stored < opt->count);
+	while (more && !g_shell.interrupted)
+	{
+		buf_reserve(&buf, MAPFILE_BLOCK);
+		n = read(opt->fd, buf.data + buf.len, MAPFILE_BLOCK);
+		if (n == -1 && errno == EINTR)
+			continue ;
+		if (n <= 0)
+			break ;
+		buf.len += n;
+		start = 0;
+		while (more && (end = memchr(buf.data + start, opt->delim,
+					buf.len - start)))
+		{
+			more = store_line(arr, opt, buf.data + start,
+					end - buf.data - start + !opt->trim);
+			start = end - buf.data + 1;
+		}
+		buf.len -= start;
+		memmove(buf.data, buf.data + start, buf.len);
+	}
+	if (n == -1)
+		print_error("mapfile", strerror(errno));
+	if (!more && buf.len > 0)
+		lseek(opt->fd, -(off_t)buf.len, SEEK_CUR);
+	else if (more && buf.len > 0)
+		store_line(arr, opt, buf.data, buf.len);
+	free(buf.data);
+	return (n == -1);
+}
+
+static int	mapfile_option(t_mapfile *opt, char ***args, int *i)
+{
+	char	c;
+	char	*value;
+
+	c = (**args)[*i];
+	if (c == 't')
+	{
+		opt->trim = 1;
+		return (1);
+	}
+	if (!strchr("nsud", c) || !(value = option_value(args, i)))
+		return (0);
+	if (c == 'd')
+		opt->delim = value[0];
+	else if (c == 'n')
+		opt->count = atol(value);
+	else if (c == 's')
+		opt->skip = atol(value);
+	else
+		opt->fd = atoi(value);
+	return (1);
+}
+
+/* mapfile [-t] [-n count] [-s skip] [-u fd] [-d delim] [array], also
+ * known as readarray: lines of the input into an indexed array */
+int	builtin_mapfile(char **args)
+{
+	t_mapfile	opt;
+	t_array		*arr;
+	char		*name;
+	int			i;
+
+	memset(&opt, 0, sizeof(t_mapfile));
+	opt.delim = '\n';
+	while (*++args && (*args)[0] == '-' && (*args)[1])
+	{
+		i = 0;
+		while ((*args)[++i])
+		{
+			if (!mapfile_option(&opt, &args, &i))
+			{
+				print_error("mapfile", "usage: mapfile [-t] [-n count] "
+					"[-s skip] [-u fd] [-d delim] [array]");
+				return (2);
+			}
+		}
+	}
+	name = *args ? *args : "MAPFILE";
+	arr = make_array(name, 0);
+	if (arr->assoc)
+	{
+		print_error(name, "not an indexed array");
+		return (1);
+	}
+	clear_array(arr);
+	return (map_lines(arr, &opt));
+}
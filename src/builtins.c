@@ -1,43 +1,170 @@
 #include "../include/minishell.h"
 
+/* Builtins by name; the bytecode refers to them by index */
+static const t_builtin	g_builtins[] = {
+	{"echo", builtin_echo},
+	{"cd", builtin_cd},
+	{"pwd", builtin_pwd},
+	{"export", builtin_export},
+	{"unset", builtin_unset},
+	{"env", builtin_env},
+	{"exit", builtin_exit},
+	{"break", builtin_break},
+	{"continue", builtin_continue},
+	{"local", builtin_local},
+	{"return", builtin_return},
+	{"shift", builtin_shift},
+	{"declare", builtin_declare},
+	{"typeset", builtin_declare},
+	{"mapfile", builtin_mapfile},
+	{"readarray", builtin_mapfile},
+	{"true", builtin_true},
+	{"false", builtin_false},
+	{":", builtin_true},
+	{"test", builtin_test},
+	{"[", builtin_test},
+	{"printf", builtin_printf},
+	{"read", builtin_read},
+	{"cat", builtin_cat},
+	{"tee", builtin_tee},
+	{"ulimit", builtin_ulimit},
+	{"hash", builtin_hash},
+	{"parallel", builtin_parallel},
+	{"history", builtin_history},
+	{"enable", builtin_enable},
+	{NULL, NULL}
+};
+
+# define STATIC_BUILTINS (int)(sizeof(g_builtins) / sizeof(t_builtin) - 1)
+
+/* exec changes the shell's own descriptors, pin and timeout run the rest
+ * of the command under their settings */
+static const t_special	g_special[] = {
+	{"exec", builtin_exec},
+	{"pin", builtin_pin},
+	{"timeout", builtin_timeout},
+	{NULL, NULL}
+};
+
+static int	special_index(char *name)
+{
+	int	i;
+
+	i = 0;
+	while (name && g_special[i].name && strcmp(g_special[i].name, name) != 0)
+		i++;
+	return (name && g_special[i].name ? i : -1);
+}
+
+int	is_special_builtin(char *cmd)
+{
+	return (special_index(cmd) >= 0);
+}
+
+/* The name of special builtin index, NULL past the last one */
+char	*special_builtin_name(int index)
+{
+	return (g_special[index].name);
+}
+
+int	run_special_builtin(t_cmd *cmd)
+{
+	return (g_special[special_index(cmd->args[0])].fn(cmd));
+}
+
+int	builtin_index(char *name)
+{
+	char	*builtin;
+	int		i;
+
+	if (!name)
+		return (-1);
+	i = 0;
+	while ((builtin = builtin_name(i)))
+	{
+		if (strcmp(builtin, name) == 0)
+			return (i);
+		i++;
+	}
+	return (-1);
+}
+
+/* The name of builtin index, NULL past the last one; indexes past the
+ * table above are the builtins enable -f loaded */
+char	*builtin_name(int index)
+{
+	if (index < STATIC_BUILTINS)
+		return (g_builtins[index].name);
+	if (index - STATIC_BUILTINS < g_shell.loaded_count)
+		return (g_shell.loaded[index - STATIC_BUILTINS].name);
+	return (NULL);
+}
+
+int	run_builtin(int index, char **args)
+{
+	if (index < STATIC_BUILTINS)
+		return (g_builtins[index].fn(args));
+	return (run_loadable(g_shell.loaded[index - STATIC_BUILTINS].loadable,
+			args));
+}
+
+/*
+ * Makes name the builtin loadable runs and returns its index, -1 when
+ * name is one of the shell's own. A name loaded before keeps its index,
+ * so code compiled since still calls it.
+ */
+int	add_builtin(char *name, const t_loadable *loadable)
+{
+	t_loaded	*bigger;
+	int			index;
+
+	index = builtin_index(name);
+	if (index >= 0 && index < STATIC_BUILTINS)
+		return (-1);
+	if (index >= 0)
+	{
+		g_shell.loaded[index - STATIC_BUILTINS].loadable = loadable;
+		return (index);
+	}
+	if (g_shell.loaded_count == g_shell.loaded_cap)
+	{
+		g_shell.loaded_cap = g_shell.loaded_cap ? g_shell.loaded_cap * 2 : 8;
+		bigger = safe_malloc(sizeof(t_loaded) * g_shell.loaded_cap);
+		if (g_shell.loaded_count)
+			memcpy(bigger, g_shell.loaded,
+				sizeof(t_loaded) * g_shell.loaded_count);
+		free(g_shell.loaded);
+		g_shell.loaded = bigger;
+	}
+	g_shell.loaded[g_shell.loaded_count].name = safe_strdup(name);
+	g_shell.loaded[g_shell.loaded_count].loadable = loadable;
+	return (STATIC_BUILTINS + g_shell.loaded_count++);
+}
+
+void	free_builtins(void)
+{
+	while (g_shell.loaded_count > 0)
+		free(g_shell.loaded[--g_shell.loaded_count].name);
+	free(g_shell.loaded);
+	g_shell.loaded = NULL;
+	g_shell.loaded_cap = 0;
+}
+
 int	is_builtin(char *cmd)
 {
-	if (!cmd)
-		return (0);
-	
-	if (strcmp(cmd, "echo") == 0 ||
-		strcmp(cmd, "cd") == 0 ||
-		strcmp(cmd, "pwd") == 0 ||
-		strcmp(cmd, "export") == 0 ||
-		strcmp(cmd, "unset") == 0 ||
-		strcmp(cmd, "env") == 0 ||
-		strcmp(cmd, "exit") == 0)
-		return (1);
-	
-	return (0);
+	return (builtin_index(cmd) >= 0);
 }
 
 int	execute_builtin(t_cmd *cmd)
 {
+	int	index;
+
 	if (!cmd || !cmd->args || !cmd->args[0])
 		return (1);
-	
-	if (strcmp(cmd->args[0], "echo") == 0)
-		return (builtin_echo(cmd->args));
-	else if (strcmp(cmd->args[0], "cd") == 0)
-		return (builtin_cd(cmd->args));
-	else if (strcmp(cmd->args[0], "pwd") == 0)
-		return (builtin_pwd(cmd->args));
-	else if (strcmp(cmd->args[0], "export") == 0)
-		return (builtin_export(cmd->args));
-	else if (strcmp(cmd->args[0], "unset") == 0)
-		return (builtin_unset(cmd->args));
-	else if (strcmp(cmd->args[0], "env") == 0)
-		return (builtin_env(cmd->args));
-	else if (strcmp(cmd->args[0], "exit") == 0)
-		return (builtin_exit(cmd->args));
-	
-	return (1);
+	index = builtin_index(cmd->args[0]);
+	if (index < 0)
+		return (1);
+	return (run_builtin(index, cmd->args));
 }
 
 int	builtin_echo(char **args)
@@ -70,6 +197,18 @@ int	builtin_echo(char **args)
 	return (0);
 }
 
+int	builtin_true(char **args)
+{
+	(void)args;
+	return (0);
+}
+
+int	builtin_false(char **args)
+{
+	(void)args;
+	return (1);
+}
+
 int	builtin_cd(char **args)
 {
 	char	*path;
@@ -166,7 +305,7 @@ int	builtin_export(char **args)
 			set_env_value(key, value);
 			*equals = '=';  // Restore original string
 		}
-		else
+		else if (!export_variable(args[i], 1))
 		{
 			/* Export variable without value */
 			set_env_value(args[i], "");
@@ -177,9 +316,28 @@ int	builtin_export(char **args)
 	return (0);
 }
 
+/* unset a[key] removes one element of an array */
+static void	unset_element(char *arg, char *open)
+{
+	t_array	*arr;
+	char	*close;
+
+	close = open + strlen(open) - 1;
+	*open = '\0';
+	*close = '\0';
+	arr = find_array(arg);
+	if (arr)
+		array_unset(arr, open + 1);
+	else if (strcmp(open + 1, "0") == 0)
+		unset_env_value(arg);
+	*open = '[';
+	*close = ']';
+}
+
 int	builtin_unset(char **args)
 {
-	int	i;
+	char	*open;
+	int		i;
 
 	if (!args[1])
 		return (0);
@@ -187,7 +345,11 @@ int	builtin_unset(char **args)
 	i = 1;
 	while (args[i])
 	{
-		unset_env_value(args[i]);
+		open = strchr(args[i], '[');
+		if (open && args[i][strlen(args[i]) - 1] == ']')
+			unset_element(args[i], open);
+		else
+			unset_env_value(args[i]);
 		i++;
 	}
 	
@@ -203,7 +365,8 @@ int	builtin_env(char **args)
 	current = g_shell.env_list;
 	while (current)
 	{
-		if (current->value && *current->value)
+		if (current->exported && !current->array && current->value
+			&& *current->value)
 			printf("%s=%s\n", current->key, current->value);
 		current = current->next;
 	}
@@ -227,7 +390,70 @@ int	builtin_exit(char **args)
 		}
 	}
 	
-	printf("exit\n");
+	/* Only the interactive shell says so, where command output can't
+	 * take it in */
+	if (g_shell.interactive == getpid())
+		fputs("exit\n", stderr);
 	cleanup_shell();
 	exit(exit_code);
 }
+
+/* Records which user descriptors exec left open in the shell fd table */
+static void	track_exec_fds(t_redir *redirs)
+{
+	while (redirs)
+	{
+		if (redirs->fd >= 3 && redirs->fd < SHELL_FD_BASE)
+		{
+			if (fcntl(redirs->fd, F_GETFD) != -1)
+				g_shell.fd_table[redirs->fd] |= FD_USER;
+			else
+				g_shell.fd_table[redirs->fd] &= ~FD_USER;
+		}
+		/* The executor restores 0 and 1 from the backups after each line */
+		else if (redirs->fd == STDIN_FILENO)
+			dup3(STDIN_FILENO, g_shell.stdin_backup, O_CLOEXEC);
+		else if (redirs->fd == STDOUT_FILENO)
+			dup3(STDOUT_FILENO, g_shell.stdout_backup, O_CLOEXEC);
+		redirs = redirs->next;
+	}
+}
+
+int	builtin_exec(t_cmd *cmd)
+{
+	char	*cmd_path;
+	int		status;
+
+	fflush(stdout);
+	if (!apply_redirections(cmd->redirs, NULL))
+		return (1);
+	
+	/* Without a command the redirections persist in the shell */
+	if (!cmd->args[1])
+	{
+		track_exec_fds(cmd->redirs);
+		return (0);
+	}
+	
+	if (is_builtin(cmd->args[1]))
+	{
+		cmd->args++;
+		status = execute_builtin(cmd);
+		cmd->args--;
+		fflush(stdout);
+		cleanup_shell();
+		exit(status);
+	}
+	
+	cmd_path = find_command_path(cmd->args[1], cmd->assigns);
+	if (!cmd_path)
+	{
+		print_error(cmd->args[1], "command not found");
+		return (127);
+	}
+	prepare_exec(cmd);
+	execve(cmd_path, cmd->args + 1, overlay_env(cmd->assigns));
+	print_error(cmd->args[1], strerror(errno));
+	free(cmd_path);
+	return (126);
+}
@@ -0,0 +1,175 @@
+#include "../include/minishell.h"
+
+/* Opcode names and operand kinds for the disassembler: j jump target,
+ * s string, w word, n number, r redirection type, b builtin */
+typedef struct s_opinfo
+{
+	char				*name;
+	char				*operands;
+}	t_opinfo;
+
+static const t_opinfo	g_opinfo[] = {
+	[OP_HALT] = {"HALT", ""},
+	[OP_JUMP] = {"JUMP", "j"},
+	[OP_BRANCH_OK] = {"BRANCH_OK", "j"},
+	[OP_BRANCH_FAIL] = {"BRANCH_FAIL", "j"},
+	[OP_NOT] = {"NOT", ""},
+	[OP_STATUS] = {"STATUS", "n"},
+	[OP_BEGIN] = {"BEGIN", ""},
+	[OP_EXPAND] = {"EXPAND", "w"},
+	[OP_ASSIGN] = {"ASSIGN", "w"},
+	[OP_ARRAY] = {"ARRAY", "sn"},
+	[OP_ARRAY_ADD] = {"ARRAY_ADD", "sw"},
+	[OP_ARRAY_KEY] = {"ARRAY_KEY", "swwn"},
+	[OP_REDIRECT] = {"REDIRECT", "rnw"},
+	[OP_SPAWN] = {"SPAWN", ""},
+	[OP_BUILTIN] = {"BUILTIN", "bs"},
+	[OP_ARITH] = {"ARITH", "s"},
+	[OP_PIPE] = {"PIPE", "j"},
+	[OP_WAIT] = {"WAIT", ""},
+	[OP_EXIT] = {"EXIT", ""},
+	[OP_SUBSHELL] = {"SUBSHELL", "j"},
+	[OP_PUSH_REDIR] = {"PUSH_REDIR", "j"},
+	[OP_POP_REDIR] = {"POP_REDIR", ""},
+	[OP_LOOP] = {"LOOP", "jj"},
+	[OP_FOR_NEXT] = {"FOR_NEXT", "sj"},
+	[OP_LOOP_BODY] = {"LOOP_BODY", ""},
+	[OP_LOOP_END] = {"LOOP_END", ""},
+	[OP_CASE] = {"CASE", "w"},
+	[OP_MATCH] = {"MATCH", "wj"},
+	[OP_CASE_END] = {"CASE_END", ""},
+	[OP_DEFUN] = {"DEFUN", "sj"},
+	[OP_RETURN] = {"RETURN", ""}
+};
+
+/* Number of ints an instruction takes, opcode included */
+static int	op_length(int op)
+{
+	return (1 + strlen(g_opinfo[op].operands));
+}
+
+/*
+ * The t_word/t_segment templates the expansion code works on are built
+ * from the index tables one word at a time, the first time it runs. The
+ * views start out as zeroed memory, so a large program that mostly isn't
+ * run (an rc file full of functions) costs almost nothing to load.
+ */
+void	link_program(t_program *prog)
+{
+	prog->seg_view = calloc(prog->nsegs + 1, sizeof(t_segment));
+	prog->word_view = calloc(prog->nwords + 1, sizeof(t_word));
+	if (!prog->seg_view || !prog->word_view)
+		exit_error("calloc failed");
+}
+
+t_word	*program_word(t_program *prog, int index)
+{
+	t_segment	*seg;
+	t_word		*word;
+	int			first;
+	int			count;
+	int			i;
+
+	word = &prog->word_view[index];
+	first = prog->words[index * 2];
+	count = prog->words[index * 2 + 1];
+	if (word->segments || count == 0)
+		return (word);
+	i = count;
+	while (--i >= 0)
+	{
+		seg = &prog->seg_view[first + i];
+		seg->type = prog->segs[(first + i) * 3];
+		seg->quoted = prog->segs[(first + i) * 3 + 1];
+		seg->text = prog->strings + prog->segs[(first + i) * 3 + 2];
+		seg->next = (i + 1 < count) ? seg + 1 : NULL;
+	}
+	word->segments = &prog->seg_view[first];
+	if (count == 1 && word->segments->type == SEG_LITERAL)
+		word->literal = word->segments->text;
+	return (word);
+}
+
+void	release_program(t_program *prog)
+{
+	if (!prog || --prog->refs > 0)
+		return ;
+	/* A program loaded from the rc cache lives in one mapping */
+	if (prog->map)
+		munmap(prog->map, prog->map_len);
+	else
+	{
+		free(prog->code);
+		free(prog->strings);
+		free(prog->segs);
+		free(prog->words);
+	}
+	free(prog->seg_view);
+	free(prog->word_view);
+	free(prog);
+}
+
+/* Prints a word roughly as it was written */
+static void	dump_word(t_program *prog, int index)
+{
+	static char	*open[] = {"", "~", "$", "${", "$(", "$((", "<(", ">("};
+	static char	*close[] = {"", "", "", "}", ")", "))", ")", ")"};
+	t_segment	*seg;
+
+	printf("w%d ", index);
+	seg = program_word(prog, index)->segments;
+	while (seg)
+	{
+		if (seg->quoted)
+			printf("\"");
+		printf("%s%s%s", open[seg->type], seg->type == SEG_TILDE ? ""
+			: seg->text, close[seg->type]);
+		if (seg->quoted)
+			printf("\"");
+		seg = seg->next;
+	}
+}
+
+static void	dump_operand(t_program *prog, char kind, int value)
+{
+	static char	*redirs[] = {"<", ">", ">>", "<<", "<&", ">&"};
+
+	printf(" ");
+	if (kind == 'j')
+		printf("-> %04d", value);
+	else if (kind == 's')
+		printf("\"%s\"", prog->strings + value);
+	else if (kind == 'w')
+		dump_word(prog, value);
+	else if (kind == 'r')
+		printf("%s", redirs[value]);
+	else if (kind == 'b')
+		printf("#%d", value);
+	else
+		printf("%d", value);
+}
+
+/* minishell --dump-bytecode: one instruction per line */
+void	dump_program(t_program *prog)
+{
+	char	*kinds;
+	int		pc;
+	int		i;
+
+	printf("; %d ints of code, %d words, %d bytes of strings\n",
+		prog->len, prog->nwords, prog->strings_len);
+	pc = 0;
+	while (pc < prog->len)
+	{
+		kinds = g_opinfo[prog->code[pc]].operands;
+		printf("%04d  %-12s", pc, g_opinfo[prog->code[pc]].name);
+		i = 0;
+		while (kinds[i])
+		{
+			dump_operand(prog, kinds[i], prog->code[pc + 1 + i]);
+			i++;
+		}
+		printf("\n");
+		pc += op_length(prog->code[pc]);
+	}
+}
@@ -0,0 +1,381 @@
+#include "../include/minishell.h"
+
+/*
+ * cat and tee move data between the descriptors their redirections left
+ * them without copying it through the shell where the kernel can do it:
+ * copy_file_range() between files of one filesystem, splice() when either
+ * end is a pipe, sendfile() from a file to anything else, and tee(2) to
+ * duplicate a pipe for tee. A read()/write() loop takes over whenever the
+ * kernel refuses. Options they don't know go to the external command.
+ */
+
+# define TRANSFER_CHUNK 1048576
+# define TRANSFER_BUFFER 131072
+# define TRANSFER_ALL ((size_t)-1)
+
+/* Ways to move data */
+# define MOVE_COPY 0
+# define MOVE_RANGE 1
+# define MOVE_SPLICE 2
+# define MOVE_SENDFILE 3
+
+/* tee's outputs, standard output then files; a failed one has fd -1 */
+typedef struct s_tee
+{
+	int					*fds;
+	char				**files;
+	int					count;
+	int					status;
+}	t_tee;
+
+/* Writes all of data unless an error or an interrupt stops it */
+int	write_all(int fd, char *data, size_t len)
+{
+	ssize_t	n;
+
+	while (len > 0)
+	{
+		n = write(fd, data, len);
+		if (n == -1 && errno == EINTR && !g_shell.interrupted)
+			continue ;
+		if (n <= 0)
+			return (0);
+		data += n;
+		len -= n;
+	}
+	return (1);
+}
+
+/* *len bytes, or all of the input for TRANSFER_ALL, through a buffer; an
+ * out of -1 discards them */
+static int	copy_loop(int in, int out, size_t *len)
+{
+	static char	buffer[TRANSFER_BUFFER];
+	ssize_t		n;
+
+	while (*len > 0)
+	{
+		n = read(in, buffer, *len < TRANSFER_BUFFER ? *len : TRANSFER_BUFFER);
+		if (n == -1 && errno == EINTR && !g_shell.interrupted)
+			continue ;
+		if (n <= 0)
+			return (n == 0);
+		if (out != -1 && !write_all(out, buffer, n))
+			return (0);
+		if (*len != TRANSFER_ALL)
+			*len -= n;
+	}
+	return (1);
+}
+
+static ssize_t	fast_move(int method, int in, int out, size_t len)
+{
+#ifdef __linux__
+	if (len > TRANSFER_CHUNK)
+		len = TRANSFER_CHUNK;
+	if (method == MOVE_RANGE)
+		return (copy_file_range(in, NULL, out, NULL, len, 0));
+	if (method == MOVE_SPLICE)
+		return (splice(in, NULL, out, NULL, len,
+				SPLICE_F_MOVE | SPLICE_F_MORE));
+	return (sendfile(out, in, NULL, len));
+#else
+	(void)method;
+	(void)in;
+	(void)out;
+	(void)len;
+	errno = ENOSYS;
+	return (-1);
+#endif
+}
+
+/*
+ * Moves *len bytes, or everything for TRANSFER_ALL, from in to out with
+ * method, then with copy_loop() once the kernel refuses it; a real error
+ * shows up again there. 0 on error, errno set.
+ */
+static int	move_data(int method, int in, int out, size_t *len)
+{
+	ssize_t	n;
+
+	while (*len > 0 && method != MOVE_COPY)
+	{
+		n = fast_move(method, in, out, *len);
+		if (n == 0)
+			return (1);
+		if (n > 0 && *len != TRANSFER_ALL)
+			*len -= n;
+		if (n == -1 && (errno != EINTR || g_shell.interrupted))
+			method = MOVE_COPY;
+	}
+	return (copy_loop(in, out, len));
+}
+
+/*
+ * A regular file of size 0 may be a /proc file whose size isn't known, so
+ * only files with contents count as files.
+ */
+static int	is_file(struct stat *st)
+{
+	return (S_ISREG(st->st_mode) && st->st_size > 0);
+}
+
+static int	pick_method(int in, int out)
+{
+	struct stat	a;
+	struct stat	b;
+
+	if (fstat(in, &a) == -1 || fstat(out, &b) == -1)
+		return (MOVE_COPY);
+	if (is_file(&a) && S_ISREG(b.st_mode) && a.st_dev == b.st_dev)
+		return (MOVE_RANGE);
+	if (S_ISFIFO(a.st_mode) || S_ISFIFO(b.st_mode))
+		return (MOVE_SPLICE);
+	if (is_file(&a))
+		return (MOVE_SENDFILE);
+	return (MOVE_COPY);
+}
+
+/* Copies everything from in to out, 0 on error with errno set */
+int	transfer_data(int in, int out)
+{
+	size_t	len;
+
+	len = TRANSFER_ALL;
+	return (move_data(pick_method(in, out), in, out, &len));
+}
+
+static void	file_error(char *cmd, char *file, char *msg)
+{
+	char	*prefix;
+
+	prefix = join_strings(cmd, file);
+	print_error(prefix, msg);
+	free(prefix);
+}
+
+/* GNU cat's check against cat file >> file growing without end */
+static int	same_file(int in, int out)
+{
+	struct stat	a;
+	struct stat	b;
+
+	return (fstat(in, &a) == 0 && fstat(out, &b) == 0 && S_ISREG(a.st_mode)
+		&& a.st_dev == b.st_dev && a.st_ino == b.st_ino
+		&& lseek(in, 0, SEEK_CUR) < b.st_size);
+}
+
+static int	cat_file(char *file)
+{
+	int	fd;
+	int	status;
+
+	fd = STDIN_FILENO;
+	if (strcmp(file, "-") != 0)
+		fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		file_error("cat: ", file, strerror(errno));
+		return (1);
+	}
+	status = 0;
+	if (same_file(fd, STDOUT_FILENO))
+	{
+		file_error("cat: ", file, "input file is output file");
+		status = 1;
+	}
+	else if (!transfer_data(fd, STDOUT_FILENO))
+	{
+		file_error("cat: ", file, strerror(errno));
+		status = 1;
+	}
+	if (fd != STDIN_FILENO)
+		close(fd);
+	return (status);
+}
+
+/* cat [-u] [file...]; -u changes nothing as nothing is buffered */
+int	builtin_cat(char **args)
+{
+	int	status;
+	int	i;
+
+	i = 1;
+	while (args[i] && args[i][0] == '-' && args[i][1])
+	{
+		if (strcmp(args[i], "--") == 0 && ++i)
+			break ;
+		if (strcmp(args[i++], "-u") != 0)
+			return (run_external(args));
+	}
+	fflush(stdout);
+	if (!args[i])
+		return (cat_file("-"));
+	status = 0;
+	while (args[i])
+		status |= cat_file(args[i++]);
+	return (status);
+}
+
+static void	output_failed(t_tee *t, int i)
+{
+	file_error("tee: ", i ? t->files[i - 1] : "standard output",
+		strerror(errno));
+	if (i > 0)
+		close(t->fds[i]);
+	t->fds[i] = -1;
+	t->status = 1;
+}
+
+/* The last output still working, -1 when none is; *alive is the number
+ * of working outputs */
+static int	last_output(t_tee *t, int *alive)
+{
+	int	last;
+	int	i;
+
+	last = -1;
+	*alive = 0;
+	i = -1;
+	while (++i < t->count)
+	{
+		if (t->fds[i] == -1)
+			continue ;
+		last = i;
+		(*alive)++;
+	}
+	return (last);
+}
+
+/* Moves len bytes of a pipe to output i, dropping what it didn't take */
+static void	send_chunk(t_tee *t, int i, int from, size_t len)
+{
+	if (!move_data(MOVE_SPLICE, from, t->fds[i], &len))
+		output_failed(t, i);
+	copy_loop(from, -1, &len);
+}
+
+/*
+ * Every output but the last gets each chunk through a scratch pipe that
+ * tee(2) fills from the input without consuming it; the last output then
+ * takes the chunk off the input with splice(). The scratch pipe is empty
+ * before each tee() and as large as the chunk, so tee() always duplicates
+ * the whole of it.
+ */
+static void	tee_pipe(t_tee *t, int in, int *scratch)
+{
+	size_t	room;
+	ssize_t	n;
+	ssize_t	copied;
+	int		last;
+	int		alive;
+	int		i;
+
+	room = fcntl(scratch[1], F_GETPIPE_SZ);
+	while ((last = last_output(t, &alive)) >= 0)
+	{
+		if (alive == 1)
+		{
+			send_chunk(t, last, in, TRANSFER_ALL);
+			return ;
+		}
+		n = tee(in, scratch[1], room, 0);
+		if (n == -1 && errno == EINTR && !g_shell.interrupted)
+			continue ;
+		if (n <= 0)
+			return ;
+		copied = n;
+		i = -1;
+		while (++i < last)
+		{
+			if (t->fds[i] == -1)
+				continue ;
+			if (copied == 0)
+				copied = tee(in, scratch[1], n, 0);
+			send_chunk(t, i, scratch[0], copied > 0 ? copied : 0);
+			copied = 0;
+		}
+		send_chunk(t, last, in, n);
+	}
+}
+
+/* The fallback: a buffer of input at a time to every output */
+static void	tee_copy(t_tee *t, int in)
+{
+	static char	buffer[TRANSFER_BUFFER];
+	ssize_t		n;
+	int			alive;
+	int			i;
+
+	while (last_output(t, &alive) >= 0)
+	{
+		n = read(in, buffer, TRANSFER_BUFFER);
+		if (n == -1 && errno == EINTR && !g_shell.interrupted)
+			continue ;
+		if (n <= 0)
+			break ;
+		i = -1;
+		while (++i < t->count)
+			if (t->fds[i] != -1 && !write_all(t->fds[i], buffer, n))
+				output_failed(t, i);
+	}
+}
+
+static void	run_tee(t_tee *t)
+{
+	struct stat	st;
+	int			scratch[2];
+	int			size;
+
+	fflush(stdout);
+	if (fstat(STDIN_FILENO, &st) == 0 && S_ISFIFO(st.st_mode)
+		&& pipe2(scratch, O_CLOEXEC) == 0)
+	{
+		size = fcntl(STDIN_FILENO, F_GETPIPE_SZ);
+		if (size > 0)
+			fcntl(scratch[1], F_SETPIPE_SZ, size);
+		tee_pipe(t, STDIN_FILENO, scratch);
+		close(scratch[0]);
+		close(scratch[1]);
+	}
+	else
+		tee_copy(t, STDIN_FILENO);
+}
+
+/* tee [-a] [file...] */
+int	builtin_tee(char **args)
+{
+	t_tee	t;
+	int		flags;
+	int		i;
+
+	flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+	i = 1;
+	while (args[i] && args[i][0] == '-' && args[i][1])
+	{
+		if (strcmp(args[i], "--") == 0 && ++i)
+			break ;
+		if (strcmp(args[i++], "-a") != 0)
+			return (run_external(args));
+		flags = (flags & ~O_TRUNC) | O_APPEND;
+	}
+	t.files = args + i;
+	t.count = array_length(t.files) + 1;
+	t.fds = safe_malloc(sizeof(int) * t.count);
+	t.status = 0;
+	t.fds[0] = STDOUT_FILENO;
+	i = 0;
+	while (++i < t.count)
+	{
+		t.fds[i] = open(t.files[i - 1], flags, 0666);
+		if (t.fds[i] == -1)
+			output_failed(&t, i);
+	}
+	run_tee(&t);
+	i = 0;
+	while (++i < t.count)
+		if (t.fds[i] != -1)
+			close(t.fds[i]);
+	free(t.fds);
+	return (t.status);
+}
@@ -0,0 +1,474 @@
+#include "../include/minishell.h"
+
+/* Compiler state; strings are interned through an open addressing table
+ * of pool offsets */
+typedef struct s_emitter
+{
+	t_program			*prog;
+	int					code_cap;
+	t_buf				strings;
+	int					segs_cap;
+	int					words_cap;
+	int					*intern;
+	int					intern_size;
+	int					nstrings;
+}	t_emitter;
+
+static void	compile_node(t_emitter *e, t_node *node);
+
+static void	grow(int **array, int *cap, int needed)
+{
+	int	*bigger;
+	int	old_cap;
+
+	if (needed <= *cap)
+		return ;
+	old_cap = *cap;
+	while (*cap < needed)
+		*cap *= 2;
+	bigger = safe_malloc(sizeof(int) * *cap);
+	memcpy(bigger, *array, sizeof(int) * old_cap);
+	free(*array);
+	*array = bigger;
+}
+
+/* Appends one int to the code, returns its position */
+static int	emit(t_emitter *e, int value)
+{
+	grow(&e->prog->code, &e->code_cap, e->prog->len + 1);
+	e->prog->code[e->prog->len] = value;
+	return (e->prog->len++);
+}
+
+/* Forward jumps are chained through their operand slots until the
+ * target is known, then patched in one go */
+static void	emit_jump(t_emitter *e, int *chain)
+{
+	*chain = emit(e, *chain);
+}
+
+static void	patch(t_emitter *e, int chain, int target)
+{
+	int	next;
+
+	while (chain != -1)
+	{
+		next = e->prog->code[chain];
+		e->prog->code[chain] = target;
+		chain = next;
+	}
+}
+
+static void	rehash(t_emitter *e)
+{
+	int	*old;
+	int	old_size;
+	int	slot;
+	int	i;
+
+	old = e->intern;
+	old_size = e->intern_size;
+	e->intern_size = old_size ? old_size * 2 : 64;
+	e->intern = safe_malloc(sizeof(int) * e->intern_size);
+	memset(e->intern, -1, sizeof(int) * e->intern_size);
+	i = 0;
+	while (i < old_size)
+	{
+		if (old[i] != -1)
+		{
+			slot = hash_string(e->strings.data + old[i]) % e->intern_size;
+			while (e->intern[slot] != -1)
+				slot = (slot + 1) % e->intern_size;
+			e->intern[slot] = old[i];
+		}
+		i++;
+	}
+	free(old);
+}
+
+/* Pool offset of str, every distinct string is stored once */
+static int	intern(t_emitter *e, char *str)
+{
+	int	slot;
+	int	offset;
+
+	if (!str)
+		str = "";
+	if (e->nstrings * 2 >= e->intern_size)
+		rehash(e);
+	slot = hash_string(str) % e->intern_size;
+	while (e->intern[slot] != -1)
+	{
+		if (strcmp(e->strings.data + e->intern[slot], str) == 0)
+			return (e->intern[slot]);
+		slot = (slot + 1) % e->intern_size;
+	}
+	offset = e->strings.len;
+	buf_add(&e->strings, str, strlen(str) + 1);
+	e->intern[slot] = offset;
+	e->nstrings++;
+	return (offset);
+}
+
+/* Copies a word template into the program tables, returns its index */
+static int	add_word(t_emitter *e, t_word *word)
+{
+	t_program	*prog;
+	t_segment	*seg;
+	int			count;
+
+	prog = e->prog;
+	count = 0;
+	seg = word->segments;
+	while (seg)
+	{
+		grow(&prog->segs, &e->segs_cap, (prog->nsegs + 1) * 3);
+		prog->segs[prog->nsegs * 3] = seg->type;
+		prog->segs[prog->nsegs * 3 + 1] = seg->quoted;
+		prog->segs[prog->nsegs * 3 + 2] = intern(e, seg->text);
+		prog->nsegs++;
+		count++;
+		seg = seg->next;
+	}
+	grow(&prog->words, &e->words_cap, (prog->nwords + 1) * 2);
+	prog->words[prog->nwords * 2] = prog->nsegs - count;
+	prog->words[prog->nwords * 2 + 1] = count;
+	return (prog->nwords++);
+}
+
+static void	compile_redirects(t_emitter *e, t_redir *redir)
+{
+	while (redir)
+	{
+		emit(e, OP_REDIRECT);
+		emit(e, redir->type);
+		emit(e, redir->fd);
+		emit(e, add_word(e, redir->word));
+		redir = redir->next;
+	}
+}
+
+/* ASSIGN for a scalar; an array assignment is ARRAY, then ARRAY_ADD or
+ * ARRAY_KEY per element, and takes effect right away */
+static void	compile_assigns(t_emitter *e, t_assign *assign)
+{
+	t_element	*elem;
+
+	while (assign)
+	{
+		emit(e, assign->word ? OP_ASSIGN : OP_ARRAY);
+		if (assign->word)
+			emit(e, add_word(e, assign->word));
+		else
+		{
+			emit(e, intern(e, assign->name));
+			emit(e, assign->append);
+		}
+		elem = assign->elements;
+		while (elem)
+		{
+			emit(e, elem->key ? OP_ARRAY_KEY : OP_ARRAY_ADD);
+			emit(e, intern(e, assign->name));
+			if (elem->key)
+				emit(e, add_word(e, elem->key));
+			emit(e, add_word(e, elem->value));
+			if (elem->key)
+				emit(e, elem->append);
+			elem = elem->next;
+		}
+		assign = assign->next;
+	}
+}
+
+/* BEGIN, the prefix assignments, EXPAND each word, REDIRECT each target,
+ * then run the command. Literal builtin names are resolved here, the
+ * rest at run time */
+static void	compile_simple(t_emitter *e, t_cmd *cmd)
+{
+	t_word	*word;
+	int		builtin;
+
+	emit(e, OP_BEGIN);
+	compile_assigns(e, cmd->assignments);
+	word = cmd->words;
+	while (word)
+	{
+		emit(e, OP_EXPAND);
+		emit(e, add_word(e, word));
+		word = word->next;
+	}
+	compile_redirects(e, cmd->redirs);
+	builtin = -1;
+	if (cmd->words && cmd->words->literal)
+		builtin = builtin_index(cmd->words->literal);
+	if (cmd->arith)
+	{
+		emit(e, OP_ARITH);
+		emit(e, intern(e, cmd->arith));
+	}
+	else if (builtin >= 0)
+	{
+		emit(e, OP_BUILTIN);
+		emit(e, builtin);
+		emit(e, intern(e, cmd->words->literal));
+	}
+	else
+		emit(e, OP_SPAWN);
+}
+
+/* A compound command, its redirections wrapped around the body */
+static void	compile_stage(t_emitter *e, t_cmd *cmd)
+{
+	int	end;
+
+	if (!cmd->node)
+	{
+		compile_simple(e, cmd);
+		return ;
+	}
+	if (!cmd->redirs)
+	{
+		compile_node(e, cmd->node);
+		return ;
+	}
+	end = -1;
+	emit(e, OP_BEGIN);
+	compile_redirects(e, cmd->redirs);
+	emit(e, OP_PUSH_REDIR);
+	emit_jump(e, &end);
+	compile_node(e, cmd->node);
+	emit(e, OP_POP_REDIR);
+	patch(e, end, e->prog->len);
+}
+
+/* Each stage of a real pipeline is forked by PIPE and ends with EXIT */
+static void	compile_pipeline(t_emitter *e, t_node *node)
+{
+	t_cmd	*stage;
+	int		next;
+
+	if (!node->pipeline->next)
+		compile_stage(e, node->pipeline);
+	else
+	{
+		stage = node->pipeline;
+		while (stage)
+		{
+			next = -1;
+			emit(e, OP_PIPE);
+			emit_jump(e, &next);
+			compile_stage(e, stage);
+			emit(e, OP_EXIT);
+			patch(e, next, e->prog->len);
+			stage = stage->next;
+		}
+		emit(e, OP_WAIT);
+	}
+	if (node->negate)
+		emit(e, OP_NOT);
+}
+
+static void	compile_if(t_emitter *e, t_node *node)
+{
+	int	other;
+	int	end;
+
+	other = -1;
+	end = -1;
+	compile_node(e, node->left);
+	emit(e, OP_BRANCH_FAIL);
+	emit_jump(e, &other);
+	compile_node(e, node->right);
+	emit(e, OP_JUMP);
+	emit_jump(e, &end);
+	patch(e, other, e->prog->len);
+	/* Without an else the status of a false if is 0 */
+	if (node->extra)
+		compile_node(e, node->extra);
+	else
+	{
+		emit(e, OP_STATUS);
+		emit(e, 0);
+	}
+	patch(e, end, e->prog->len);
+}
+
+/*
+ * LOOP pushes the loop (and the expanded for list) on the control stack
+ * with its break and continue targets; LOOP_BODY records the status of
+ * the body for LOOP_END.
+ */
+static void	compile_loop(t_emitter *e, t_node *node)
+{
+	t_word	*word;
+	int		brk;
+	int		cont;
+
+	brk = -1;
+	if (node->type == NODE_FOR)
+	{
+		emit(e, OP_BEGIN);
+		word = node->words;
+		while (word)
+		{
+			emit(e, OP_EXPAND);
+			emit(e, add_word(e, word));
+			word = word->next;
+		}
+	}
+	emit(e, OP_LOOP);
+	emit_jump(e, &brk);
+	emit(e, e->prog->len + 1);
+	cont = e->prog->len;
+	if (node->type == NODE_FOR)
+	{
+		emit(e, OP_FOR_NEXT);
+		emit(e, intern(e, node->var));
+		emit_jump(e, &brk);
+	}
+	else
+	{
+		compile_node(e, node->left);
+		emit(e, node->type == NODE_WHILE ? OP_BRANCH_FAIL : OP_BRANCH_OK);
+		emit_jump(e, &brk);
+	}
+	compile_node(e, node->right);
+	emit(e, OP_LOOP_BODY);
+	emit(e, OP_JUMP);
+	emit(e, cont);
+	patch(e, brk, e->prog->len);
+	emit(e, OP_LOOP_END);
+}
+
+/* MATCH jumps to the body of the first matching pattern */
+static void	compile_case(t_emitter *e, t_node *node)
+{
+	t_case_item	*item;
+	t_word		*pattern;
+	int			body;
+	int			next;
+	int			end;
+
+	end = -1;
+	emit(e, OP_CASE);
+	emit(e, add_word(e, node->words));
+	item = node->items;
+	while (item)
+	{
+		body = -1;
+		next = -1;
+		pattern = item->patterns;
+		while (pattern)
+		{
+			emit(e, OP_MATCH);
+			emit(e, add_word(e, pattern));
+			emit_jump(e, &body);
+			pattern = pattern->next;
+		}
+		emit(e, OP_JUMP);
+		emit_jump(e, &next);
+		patch(e, body, e->prog->len);
+		compile_node(e, item->body);
+		emit(e, OP_JUMP);
+		emit_jump(e, &end);
+		patch(e, next, e->prog->len);
+		item = item->next;
+	}
+	patch(e, end, e->prog->len);
+	emit(e, OP_CASE_END);
+}
+
+/* The body is compiled in place and skipped over; DEFUN binds the name
+ * to its first instruction */
+static void	compile_function(t_emitter *e, t_node *node)
+{
+	int	end;
+
+	end = -1;
+	emit(e, OP_DEFUN);
+	emit(e, intern(e, node->var));
+	emit_jump(e, &end);
+	compile_node(e, node->left);
+	emit(e, OP_RETURN);
+	patch(e, end, e->prog->len);
+}
+
+static void	compile_list(t_emitter *e, t_node *node)
+{
+	int	end;
+
+	end = -1;
+	compile_node(e, node->left);
+	if (node->type != NODE_SEQ)
+	{
+		emit(e, node->type == NODE_AND ? OP_BRANCH_FAIL : OP_BRANCH_OK);
+		emit_jump(e, &end);
+	}
+	compile_node(e, node->right);
+	patch(e, end, e->prog->len);
+}
+
+static void	compile_node(t_emitter *e, t_node *node)
+{
+	int	end;
+
+	/* An empty case item; CASE has already set the status to 0 */
+	if (!node)
+		return ;
+	if (node->type == NODE_PIPELINE)
+		compile_pipeline(e, node);
+	else if (node->type == NODE_SEQ || node->type == NODE_AND
+		|| node->type == NODE_OR)
+		compile_list(e, node);
+	else if (node->type == NODE_IF)
+		compile_if(e, node);
+	else if (node->type == NODE_WHILE || node->type == NODE_UNTIL
+		|| node->type == NODE_FOR)
+		compile_loop(e, node);
+	else if (node->type == NODE_CASE)
+		compile_case(e, node);
+	else if (node->type == NODE_GROUP)
+		compile_node(e, node->left);
+	else if (node->type == NODE_FUNCTION)
+		compile_function(e, node);
+	else if (node->type == NODE_SUBSHELL)
+	{
+		end = -1;
+		emit(e, OP_SUBSHELL);
+		emit_jump(e, &end);
+		compile_node(e, node->left);
+		emit(e, OP_EXIT);
+		patch(e, end, e->prog->len);
+	}
+}
+
+/*
+ * Lowers a syntax tree to bytecode. The result doesn't point into the
+ * tree, which can be freed right away.
+ */
+t_program	*compile_program(t_node *tree)
+{
+	t_emitter	e;
+
+	e.prog = safe_malloc(sizeof(t_program));
+	memset(e.prog, 0, sizeof(t_program));
+	e.prog->refs = 1;
+	e.code_cap = 64;
+	e.prog->code = safe_malloc(sizeof(int) * e.code_cap);
+	e.segs_cap = 48;
+	e.prog->segs = safe_malloc(sizeof(int) * e.segs_cap);
+	e.words_cap = 32;
+	e.prog->words = safe_malloc(sizeof(int) * e.words_cap);
+	buf_init(&e.strings, 256);
+	e.intern = NULL;
+	e.intern_size = 0;
+	e.nstrings = 0;
+	if (tree)
+		compile_node(&e, tree);
+	emit(&e, OP_HALT);
+	free(e.intern);
+	e.prog->strings = e.strings.data;
+	e.prog->strings_len = e.strings.len;
+	link_program(e.prog);
+	return (e.prog);
+}
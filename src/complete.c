@@ -0,0 +1,102 @@
+#include "../include/minishell.h"
+
+/*
+ * Tab completion. A word where a command name goes completes to commands
+ * on PATH, from the sorted index kept with the command hash table, and to
+ * builtins and functions. Any other word, or one with a slash, completes
+ * to file names as readline does by default.
+ */
+
+/* Words after which a command name goes */
+static char	*g_leading[] = {"if", "then", "else", "elif", "while", "until",
+	"do", "!", NULL};
+
+static int	after_leading_word(int end)
+{
+	int	start;
+	int	i;
+
+	start = end;
+	while (start > 0 && !isspace((unsigned char)rl_line_buffer[start - 1]))
+		start--;
+	i = 0;
+	while (g_leading[i] && ((int)strlen(g_leading[i]) != end - start
+			|| strncmp(rl_line_buffer + start, g_leading[i], end - start)))
+		i++;
+	return (g_leading[i] != NULL);
+}
+
+/* Whether the word at start is at the beginning of a command */
+static int	command_position(int start)
+{
+	int	i;
+
+	i = start;
+	while (i > 0 && isspace((unsigned char)rl_line_buffer[i - 1]))
+		i--;
+	return (i == 0 || strchr("|&;({`", rl_line_buffer[i - 1])
+		|| after_leading_word(i));
+}
+
+static void	add_matches(t_argv *names, const char *text)
+{
+	t_func	*func;
+	size_t	len;
+	char	*name;
+	int		i;
+
+	len = strlen(text);
+	commands_with_prefix(text, names);
+	i = 0;
+	while ((name = builtin_name(i++)))
+		if (strncmp(name, text, len) == 0)
+			argv_push(names, safe_strdup(name));
+	i = 0;
+	while ((name = special_builtin_name(i++)))
+		if (strncmp(name, text, len) == 0)
+			argv_push(names, safe_strdup(name));
+	i = -1;
+	while (++i < FUNC_BUCKETS)
+	{
+		func = g_shell.functions[i];
+		while (func)
+		{
+			if (strncmp(func->name, text, len) == 0)
+				argv_push(names, safe_strdup(func->name));
+			func = func->next;
+		}
+	}
+}
+
+/* Readline's generator: the matches are collected on the first call and
+ * handed out one by one; readline sorts them and drops duplicates */
+static char	*command_generator(const char *text, int state)
+{
+	static t_argv	names;
+	static int		next;
+
+	if (state == 0)
+	{
+		free(names.items);
+		argv_init(&names, 16);
+		add_matches(&names, text);
+		next = 0;
+	}
+	if (next < names.count)
+		return (names.items[next++]);
+	return (NULL);
+}
+
+static char	**complete_word(const char *text, int start, int end)
+{
+	(void)end;
+	if (strchr(text, '/') || !command_position(start))
+		return (NULL);
+	rl_attempted_completion_over = 1;
+	return (rl_completion_matches(text, command_generator));
+}
+
+void	setup_completion(void)
+{
+	rl_attempted_completion_function = complete_word;
+}
@@ -1,12 +1,14 @@
 #include "../include/minishell.h"
 
-static t_env	*create_env_node(char *key, char *value)
+static t_env	*create_env_node(char *key, char *value, int exported)
 {
 	t_env	*node;
 
 	node = safe_malloc(sizeof(t_env));
 	node->key = safe_strdup(key);
 	node->value = value ? safe_strdup(value) : safe_strdup("");
+	node->exported = exported;
+	node->array = NULL;
 	node->next = NULL;
 	return (node);
 }
@@ -34,6 +36,8 @@ void	init_env(char **envp)
 	int		i;
 
 	g_shell.env_list = NULL;
+	g_shell.env_array = NULL;
+	g_shell.env_dirty = 1;
 	
 	if (!envp)
 		return ;
@@ -47,13 +51,21 @@ void	init_env(char **envp)
 			*equals = '\0';
 			key = envp[i];
 			value = equals + 1;
-			add_env_node(&g_shell.env_list, create_env_node(key, value));
+			add_env_node(&g_shell.env_list, create_env_node(key, value, 1));
 			*equals = '=';  // Restore original string
 		}
 		i++;
 	}
-	
-	update_env_array();
+}
+
+static t_env	*find_env_node(char *key)
+{
+	t_env	*current;
+
+	current = g_shell.env_list;
+	while (current && strcmp(current->key, key) != 0)
+		current = current->next;
+	return (current);
 }
 
 char	*get_env_value(char *key)
@@ -62,113 +74,262 @@ char	*get_env_value(char *key)
 
 	if (!key)
 		return (NULL);
-	
-	current = g_shell.env_list;
-	while (current)
-	{
-		if (strcmp(current->key, key) == 0)
-			return (current->value);
-		current = current->next;
-	}
-	
-	return (NULL);
+	current = find_env_node(key);
+	if (current && current->array)
+		return (array_get(current->array, "0"));
+	return (current ? current->value : NULL);
 }
 
-int	set_env_value(char *key, char *value)
+/*
+ * Sets a variable. exported is 1 to export it, 0 to keep it the way it
+ * is, or to create a shell variable. Only changes to exported variables
+ * invalidate the exec environment.
+ */
+static int	set_variable(char *key, char *value, int exported)
 {
 	t_env	*current;
 
 	if (!key)
 		return (0);
-	
-	/* Search for existing variable */
-	current = g_shell.env_list;
-	while (current)
+	current = find_env_node(key);
+	if (!current)
 	{
-		if (strcmp(current->key, key) == 0)
-		{
-			free(current->value);
-			current->value = value ? safe_strdup(value) : safe_strdup("");
-			update_env_array();
-			return (1);
-		}
-		current = current->next;
+		add_env_node(&g_shell.env_list, create_env_node(key, value, exported));
+		g_shell.env_dirty |= exported;
+		return (1);
 	}
-	
-	/* Add new variable */
-	add_env_node(&g_shell.env_list, create_env_node(key, value));
-	update_env_array();
+	/* Assigning an array by its name sets element 0 */
+	if (current->array)
+		return (array_store(current->array, "0",
+				safe_strdup(value ? value : "")));
+	free(current->value);
+	current->value = value ? safe_strdup(value) : safe_strdup("");
+	current->exported |= exported;
+	g_shell.env_dirty |= current->exported;
 	return (1);
 }
 
-int	unset_env_value(char *key)
+/* export NAME=value, and variables the shell itself exports */
+int	set_env_value(char *key, char *value)
+{
+	return (set_variable(key, value, 1));
+}
+
+/* NAME=value: stays out of the environment unless already exported */
+int	set_shell_value(char *key, char *value)
+{
+	return (set_variable(key, value, 0));
+}
+
+/* Marks an existing variable exported, or unexported, 0 if it is unset */
+int	export_variable(char *key, int exported)
+{
+	t_env	*current;
+
+	current = find_env_node(key);
+	if (!current)
+		return (0);
+	if (current->exported != exported)
+		g_shell.env_dirty = 1;
+	current->exported = exported;
+	return (1);
+}
+
+int	is_exported(char *key)
+{
+	t_env	*current;
+
+	current = find_env_node(key);
+	return (current && current->exported);
+}
+
+/* Takes key's variable out of the list whole, array and export flag
+ * included; NULL if it is unset */
+t_env	*detach_variable(char *key)
 {
 	t_env	*current;
 	t_env	*prev;
 
 	if (!key)
-		return (0);
+		return (NULL);
 	
 	current = g_shell.env_list;
 	prev = NULL;
 	
-	while (current)
+	while (current && strcmp(current->key, key) != 0)
 	{
-		if (strcmp(current->key, key) == 0)
-		{
-			if (prev)
-				prev->next = current->next;
-			else
-				g_shell.env_list = current->next;
-			
-			free(current->key);
-			free(current->value);
-			free(current);
-			update_env_array();
-			return (1);
-		}
 		prev = current;
 		current = current->next;
 	}
-	
-	return (0);
+	if (!current)
+		return (NULL);
+	if (prev)
+		prev->next = current->next;
+	else
+		g_shell.env_list = current->next;
+	current->next = NULL;
+	g_shell.env_dirty |= current->exported;
+	return (current);
+}
+
+/* Puts back a variable detach_variable() took, in place of the one key
+ * has now; a NULL var leaves key unset */
+void	attach_variable(char *key, t_env *var)
+{
+	unset_env_value(key);
+	if (!var)
+		return ;
+	add_env_node(&g_shell.env_list, var);
+	g_shell.env_dirty |= var->exported;
+}
+
+int	unset_env_value(char *key)
+{
+	t_env	*current;
+
+	current = detach_variable(key);
+	if (!current)
+		return (0);
+	free(current->key);
+	free(current->value);
+	free_array(current->array);
+	free(current);
+	return (1);
+}
+
+/* The array behind a variable, NULL for scalars and unset names */
+t_array	*find_array(char *key)
+{
+	t_env	*current;
+
+	current = find_env_node(key);
+	return (current ? current->array : NULL);
+}
+
+/* Turns a variable into an array, creating it if needed. A scalar value
+ * becomes element 0; an array keeps its kind whatever assoc says */
+t_array	*make_array(char *key, int assoc)
+{
+	t_env	*current;
+	t_array	*arr;
+
+	current = find_env_node(key);
+	if (current && current->array)
+		return (current->array);
+	arr = safe_malloc(sizeof(t_array));
+	memset(arr, 0, sizeof(t_array));
+	arr->assoc = assoc;
+	if (!current)
+	{
+		current = create_env_node(key, "", 0);
+		add_env_node(&g_shell.env_list, current);
+	}
+	else
+	{
+		if (current->value[0] || !assoc)
+			array_store(arr, "0", current->value);
+		else
+			free(current->value);
+		current->value = safe_strdup("");
+		/* Arrays are never exported */
+		g_shell.env_dirty |= current->exported;
+	}
+	current->array = arr;
+	return (arr);
 }
 
-void	update_env_array(void)
+/*
+ * The exported variables as KEY=value strings for execve. Rebuilt only
+ * when an exported variable changed since the last call, so loops that
+ * assign shell variables never pay for it.
+ */
+char	**get_env_array(void)
 {
 	t_env	*current;
 	int		count;
 	int		i;
 	char	*temp;
 
-	/* Free old array */
+	if (!g_shell.env_dirty)
+		return (g_shell.env_array);
+	g_shell.env_dirty = 0;
 	if (g_shell.env_array)
 		free_string_array(g_shell.env_array);
-	
-	/* Count environment variables */
 	count = 0;
 	current = g_shell.env_list;
 	while (current)
 	{
-		count++;
+		count += current->exported && !current->array;
 		current = current->next;
 	}
-	
-	/* Allocate new array */
 	g_shell.env_array = safe_malloc(sizeof(char *) * (count + 1));
-	
-	/* Fill array */
 	i = 0;
 	current = g_shell.env_list;
 	while (current)
 	{
-		temp = join_strings(current->key, "=");
-		g_shell.env_array[i] = join_strings(temp, current->value);
-		free(temp);
+		if (current->exported && !current->array)
+		{
+			temp = join_strings(current->key, "=");
+			g_shell.env_array[i++] = join_strings(temp, current->value);
+			free(temp);
+		}
 		current = current->next;
-		i++;
 	}
 	g_shell.env_array[i] = NULL;
+	return (g_shell.env_array);
+}
+
+/* Both strings start with the same NAME= */
+static int	same_name(char *a, char *b)
+{
+	while (*a && *a != '=' && *a == *b)
+	{
+		a++;
+		b++;
+	}
+	return (*a == '=' && *b == '=');
+}
+
+/*
+ * Environment for one exec with the NAME=value prefix assignments of the
+ * command on top: a new pointer array over the shared export snapshot and
+ * the assignments. Nothing of the shell's own environment is touched.
+ */
+char	**overlay_env(char **assigns)
+{
+	char	**base;
+	char	**env;
+	int		count;
+	int		i;
+	int		j;
+
+	base = get_env_array();
+	if (!assigns || !*assigns)
+		return (base);
+	env = safe_malloc(sizeof(char *)
+			* (array_length(base) + array_length(assigns) + 1));
+	count = 0;
+	i = -1;
+	while (base[++i])
+	{
+		j = 0;
+		while (assigns[j] && !same_name(base[i], assigns[j]))
+			j++;
+		if (!assigns[j])
+			env[count++] = base[i];
+	}
+	/* The last of repeated assignments wins */
+	i = -1;
+	while (assigns[++i])
+	{
+		j = i + 1;
+		while (assigns[j] && !same_name(assigns[i], assigns[j]))
+			j++;
+		if (!assigns[j])
+			env[count++] = assigns[i];
+	}
+	env[count] = NULL;
+	return (env);
 }
 
 void	free_env(void)
@@ -182,6 +343,7 @@ void	free_env(void)
 		next = current->next;
 		free(current->key);
 		free(current->value);
+		free_array(current->array);
 		free(current);
 		current = next;
 	}
@@ -1,11 +1,31 @@
 #include "../include/minishell.h"
 
-char	*find_command_path(char *cmd)
+/* The PATH=value prefix of a command, the last one when repeated */
+static char	*prefix_path(char **assigns)
+{
+	char	*path;
+
+	path = NULL;
+	while (assigns && *assigns)
+	{
+		if (strncmp(*assigns, "PATH=", 5) == 0)
+			path = *assigns + 5;
+		assigns++;
+	}
+	return (path);
+}
+
+/*
+ * Where cmd is run from. A PATH prefix in assigns is searched instead of
+ * the shell's, and past the hash table, which only knows the shell's.
+ */
+char	*find_command_path(char *cmd, char **assigns)
 {
 	char	*path_env;
 	char	**paths;
 	char	*full_path;
 	char	*temp;
+	int		hashed;
 	int		i;
 
 	if (!cmd || !*cmd)
@@ -19,11 +39,17 @@ char	*find_command_path(char *cmd)
 		return (NULL);
 	}
 	
-	path_env = get_env_value("PATH");
+	path_env = prefix_path(assigns);
+	hashed = !path_env;
+	if (hashed)
+		path_env = get_env_value("PATH");
 	if (!path_env)
 		return (NULL);
+	full_path = hashed ? hashed_path(cmd) : NULL;
+	if (full_path || (hashed && index_complete()))
+		return (full_path);
 	
-	paths = split_string(path_env, ':');
+	paths = split_path(path_env);
 	if (!paths)
 		return (NULL);
 	
@@ -37,6 +63,8 @@ char	*find_command_path(char *cmd)
 		if (access(full_path, X_OK) == 0)
 		{
 			free_string_array(paths);
+			if (hashed)
+				remember_path(cmd, full_path, i);
 			return (full_path);
 		}
 		free(full_path);
@@ -47,69 +75,82 @@ char	*find_command_path(char *cmd)
 	return (NULL);
 }
 
-static int	setup_redirections(t_cmd *cmd)
+/* (( expr )) succeeds when expr is non-zero */
+static int	execute_arith(t_cmd *cmd)
 {
-	int	fd;
+	long long	result;
 
-	if (cmd->input_file)
-	{
-		fd = open(cmd->input_file, O_RDONLY);
-		if (fd == -1)
-		{
-			print_error(cmd->input_file, strerror(errno));
-			return (0);
-		}
-		dup2(fd, STDIN_FILENO);
-		close(fd);
-	}
-	
-	if (cmd->heredoc)
+	if (!evaluate_arithmetic(cmd->arith, &result))
+		return (1);
+	return (result == 0);
+}
+
+/* NAME=value alone sets shell variables; its status is that of the last
+ * command substitution in the values, if any, or of a failed array
+ * assignment */
+static int	assign_variables(t_cmd *cmd)
+{
+	char	*equals;
+	int		i;
+
+	i = 0;
+	while (cmd->assigns && cmd->assigns[i])
 	{
-		fd = create_heredoc(cmd->heredoc_delimiter);
-		if (fd == -1)
-			return (0);
-		dup2(fd, STDIN_FILENO);
-		close(fd);
+		equals = strchr(cmd->assigns[i], '=');
+		*equals = '\0';
+		set_shell_value(cmd->assigns[i], equals + 1);
+		*equals = '=';
+		i++;
 	}
-	
-	if (cmd->output_file)
+	return (cmd->substituted ? g_shell.exit_status : 0);
+}
+
+static int	execute_in_shell(t_cmd *cmd, t_func *func, int builtin)
+{
+	t_fdsave	*saves;
+	t_local		*assigned;
+	int			status;
+
+	saves = NULL;
+	status = 1;
+	/* Prefix assignments only last as long as the function or builtin */
+	assigned = NULL;
+	if (cmd->assigns && cmd->args)
+		assigned = push_assignments(cmd->assigns, 1);
+	if (apply_redirections(cmd->redirs, &saves))
 	{
-		if (cmd->append_output)
-			fd = open(cmd->output_file, O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (func)
+			status = call_function(func, cmd);
+		else if (cmd->arith)
+			status = execute_arith(cmd);
+		else if (cmd->args)
+			status = run_builtin(builtin, cmd->args);
 		else
-			fd = open(cmd->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-		
-		if (fd == -1)
-		{
-			print_error(cmd->output_file, strerror(errno));
-			return (0);
-		}
-		dup2(fd, STDOUT_FILENO);
-		close(fd);
+			status = assign_variables(cmd);
 	}
-	
-	return (1);
+	restore_redirections(saves);
+	restore_locals(assigned);
+	return (status);
+}
+
+/* What is left of the child once it has forked: redirect and exec */
+static void	exec_external(t_cmd *cmd, char *cmd_path)
+{
+	if (!apply_redirections(cmd->redirs, NULL))
+		exit(1);
+	prepare_exec(cmd);
+	execve(cmd_path, cmd->args, overlay_env(cmd->assigns));
+	print_error(cmd->args[0], strerror(errno));
+	exit(126);
 }
 
-int	execute_single_cmd(t_cmd *cmd)
+static int	execute_external(t_cmd *cmd)
 {
 	pid_t	pid;
-	int		status;
 	char	*cmd_path;
 
-	if (!cmd || !cmd->args || !cmd->args[0])
-		return (0);
-	
-	/* Check if it's a builtin command */
-	if (is_builtin(cmd->args[0]))
-	{
-		if (!setup_redirections(cmd))
-			return (1);
-		return (execute_builtin(cmd));
-	}
-	
 	/* Find command path */
-	cmd_path = find_command_path(cmd->args[0]);
+	cmd_path = find_command_path(cmd->args[0], cmd->assigns);
 	if (!cmd_path)
 	{
 		print_error(cmd->args[0], "command not found");
@@ -118,144 +159,146 @@ int	execute_single_cmd(t_cmd *cmd)
 	
 	pid = fork();
 	if (pid == 0)
-	{
-		/* Child process */
-		if (!setup_redirections(cmd))
-			exit(1);
-		
-		execve(cmd_path, cmd->args, g_shell.env_array);
-		print_error(cmd->args[0], strerror(errno));
-		exit(126);
-	}
+		exec_external(cmd, cmd_path);
 	else if (pid > 0)
 	{
 		/* Parent process */
-		waitpid(pid, &status, 0);
+		close_procsubs(cmd);
 		free(cmd_path);
-		if (WIFEXITED(status))
-			return (WEXITSTATUS(status));
-		return (1);
-	}
-	else
-	{
-		print_error("fork", strerror(errno));
-		free(cmd_path);
-		return (1);
+		return (wait_children(&pid, 1));
 	}
+	print_error("fork", strerror(errno));
+	free(cmd_path);
+	return (1);
 }
 
-int	execute_pipeline(t_cmd *cmds)
+/* A builtin handing its arguments over to the external command of the
+ * same name, with the descriptors the builtin was given */
+int	run_external(char **args)
 {
-	int		pipe_fds[2];
-	pid_t	pid;
-	t_cmd	*current;
-	int		prev_fd;
+	t_cmd	cmd;
+
+	memset(&cmd, 0, sizeof(t_cmd));
+	cmd.args = args;
+	fflush(stdout);
+	return (execute_external(&cmd));
+}
+
+/*
+ * Runs an expanded command. builtin is the builtin index the compiler
+ * resolved from a literal command name, or -1 to look it up here.
+ */
+int	run_command(t_cmd *cmd, int builtin)
+{
+	t_func	*func;
 	int		status;
-	int		last_exit_status;
 
-	if (!cmds->next)
-		return (execute_single_cmd(cmds));
+	/* Functions shadow builtins and commands of the same name */
+	func = cmd->args ? find_function(cmd->args[0]) : NULL;
+	if (!func && cmd->args && builtin < 0)
+		builtin = builtin_index(cmd->args[0]);
 	
-	prev_fd = -1;
-	current = cmds;
-	last_exit_status = 0;
+	/* Special builtins handle redirections themselves: exec's are meant
+	 * to stay */
+	if (!func && cmd->args && is_special_builtin(cmd->args[0]))
+		status = run_special_builtin(cmd);
+	/* Functions, builtins, (( )) and redirection-only commands run in
+	 * the shell */
+	else if (func || !cmd->args || builtin >= 0)
+		status = execute_in_shell(cmd, func, builtin);
+	else
+		status = execute_external(cmd);
 	
-	while (current)
+	wait_procsubs(cmd);
+	return (status);
+}
+
+/*
+ * The last command of a forked pipeline stage or subshell: an external
+ * command replaces the child instead of being forked once more.
+ */
+int	exec_command(t_cmd *cmd)
+{
+	char	*cmd_path;
+	char	**args;
+	int		status;
+
+	/* pin places and limits this child, then runs what follows it */
+	if (cmd->args && strcmp(cmd->args[0], "pin") == 0
+		&& !find_function(cmd->args[0]))
 	{
-		if (current->next && pipe(pipe_fds) == -1)
-		{
-			print_error("pipe", strerror(errno));
-			return (1);
-		}
-		
-		pid = fork();
-		if (pid == 0)
-		{
-			/* Child process */
-			if (prev_fd != -1)
-			{
-				dup2(prev_fd, STDIN_FILENO);
-				close(prev_fd);
-			}
-			
-			if (current->next)
-			{
-				dup2(pipe_fds[1], STDOUT_FILENO);
-				close(pipe_fds[1]);
-			}
-			
-			if (current->next)
-				close(pipe_fds[0]);
-			
-			if (!setup_redirections(current))
-				exit(1);
-			
-			if (is_builtin(current->args[0]))
-			{
-				exit(execute_builtin(current));
-			}
-			else
-			{
-				char *cmd_path = find_command_path(current->args[0]);
-				if (!cmd_path)
-				{
-					print_error(current->args[0], "command not found");
-					exit(127);
-				}
-				execve(cmd_path, current->args, g_shell.env_array);
-				print_error(current->args[0], strerror(errno));
-				exit(126);
-			}
-		}
-		else if (pid > 0)
-		{
-			/* Parent process */
-			if (prev_fd != -1)
-				close(prev_fd);
-			
-			if (current->next)
-			{
-				close(pipe_fds[1]);
-				prev_fd = pipe_fds[0];
-			}
-			
-			if (!current->next)
-			{
-				waitpid(pid, &status, 0);
-				if (WIFEXITED(status))
-					last_exit_status = WEXITSTATUS(status);
-			}
-		}
+		args = cmd->args;
+		if (!apply_pin(&cmd->args))
+			status = 2;
 		else
-		{
-			print_error("fork", strerror(errno));
-			return (1);
-		}
-		
-		current = current->next;
+			status = exec_command(cmd);
+		cmd->args = args;
+		return (status);
 	}
-	
-	/* Wait for all remaining children */
-	while (wait(NULL) > 0)
-		;
-	
-	return (last_exit_status);
+	if (!cmd->args || find_function(cmd->args[0]) || is_builtin(cmd->args[0])
+		|| is_special_builtin(cmd->args[0]))
+		return (run_command(cmd, -1));
+	cmd_path = find_command_path(cmd->args[0], cmd->assigns);
+	if (!cmd_path)
+	{
+		print_error(cmd->args[0], "command not found");
+		return (127);
+	}
+	exec_external(cmd, cmd_path);
+	return (126);
 }
 
-int	executor(t_cmd *cmds)
+/* A pipeline stage planned in the shell: its command was found and its
+ * redirection files are open already */
+int	exec_planned(t_cmd *cmd, t_stage *stage)
 {
-	int	exit_status;
+	t_redir	*redir;
+	int		i;
 
-	if (!cmds)
+	redir = cmd->redirs;
+	i = 0;
+	while (redir && i < stage->nfds)
+	{
+		redir->opened = stage->fds[i++];
+		redir = redir->next;
+	}
+	exec_external(cmd, stage->path);
+	return (126);
+}
+
+/*
+ * Compiles a syntax tree and runs it. Nothing is parsed again: every pass
+ * through a loop body only expands the word templates of its commands.
+ */
+int	executor(t_node *node)
+{
+	t_program	*prog;
+	int			exit_status;
+
+	if (!node)
 		return (0);
-	
+	prog = compile_program(node);
+	exit_status = execute_program(prog);
+	release_program(prog);
+	return (exit_status);
+}
+
+/* Runs a whole program from the shell's original stdin and stdout */
+int	execute_program(t_program *prog)
+{
+	int	exit_status;
+
 	/* Backup stdin/stdout */
 	dup2(g_shell.stdin_backup, STDIN_FILENO);
 	dup2(g_shell.stdout_backup, STDOUT_FILENO);
 	
-	exit_status = execute_pipeline(cmds);
+	g_shell.interrupted = 0;
+	exit_status = vm_execute(prog, 0);
+	g_shell.breaking = 0;
+	g_shell.continuing = 0;
 	
 	/* Restore stdin/stdout */
+	fflush(stdout);
 	dup2(g_shell.stdin_backup, STDIN_FILENO);
 	dup2(g_shell.stdout_backup, STDOUT_FILENO);
 	
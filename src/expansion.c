@@ -1,160 +1,453 @@
 #include "../include/minishell.h"
 
-static char	*extract_var_name(char *str, int *i)
+/* Field splitting state while a word is expanded */
+typedef struct s_fields
 {
-	int		start;
+	t_argv				*out;
+	t_buf				field;
+	int					has_field;
+	char				*ifs;
+}	t_fields;
+
+/* Value of a variable or special parameter as a new string, NULL if unset */
+char	*variable_value(char *name)
+{
+	char	*value;
+
+	if (strcmp(name, "?") == 0)
+	{
+		value = safe_malloc(12);
+		sprintf(value, "%d", g_shell.exit_status);
+		return (value);
+	}
+	if ((name[0] && strchr("#@*", name[0])) || isdigit(name[0]))
+		return (positional_value(name));
+	return (safe_strdup(get_env_value(name)));
+}
+
+/* An expansion failed, after saying why: the command it was for is not
+ * run, see the VM */
+void	expansion_error(void)
+{
+	g_shell.expand_failed = 1;
+	g_shell.exit_status = 1;
+}
+
+static char	*arithmetic_value(char *expr)
+{
+	long long	value;
+	char		*str;
+
+	if (!evaluate_arithmetic(expr, &value))
+	{
+		expansion_error();
+		return (safe_strdup(""));
+	}
+	str = safe_malloc(24);
+	sprintf(str, "%lld", value);
+	return (str);
+}
+
+/* Runs the substitution a segment stands for, returns a new string */
+static char	*segment_value(t_segment *seg, t_cmd *cmd)
+{
+	char	*value;
+
+	if (seg->type == SEG_LITERAL)
+		return (safe_strdup(seg->text));
+	if (seg->type == SEG_TILDE)
+	{
+		value = get_env_value("HOME");
+		return (safe_strdup(value ? value : "~"));
+	}
+	if (seg->type == SEG_VAR)
+		value = variable_value(seg->text);
+	else if (seg->type == SEG_PARAM)
+		value = expand_parameter(seg->text);
+	else if (seg->type == SEG_COMMAND)
+	{
+		value = command_substitution(seg->text);
+		/* The status of x=$(cmd) is that of cmd */
+		if (cmd)
+			cmd->substituted = 1;
+	}
+	else if (seg->type == SEG_ARITH)
+		value = arithmetic_value(seg->text);
+	else if (cmd)
+		value = start_procsub(cmd, seg->text, seg->type == SEG_PROCSUB_OUT);
+	else
+		value = NULL;
+	return (value ? value : safe_strdup(""));
+}
+
+static void	end_field(t_fields *f)
+{
+	if (f->has_field)
+		argv_push(f->out, safe_strdup(f->field.data));
+	f->field.len = 0;
+	f->field.data[0] = '\0';
+	f->has_field = 0;
+}
+
+/*
+ * Splits an unquoted expansion on IFS: runs of IFS whitespace separate
+ * fields, every other IFS character ends one (possibly empty) field.
+ */
+static void	split_value(t_fields *f, char *value)
+{
+	while (*value)
+	{
+		if (!strchr(f->ifs, *value))
+		{
+			buf_add_char(&f->field, *value++);
+			f->has_field = 1;
+			continue ;
+		}
+		if (isspace(*value))
+		{
+			end_field(f);
+			while (*value && isspace(*value) && strchr(f->ifs, *value))
+				value++;
+			if (*value && strchr(f->ifs, *value) && !isspace(*value))
+				value++;
+		}
+		else
+		{
+			f->has_field = 1;
+			end_field(f);
+			value++;
+		}
+	}
+}
+
+/* "$@", "${a[@]}" and "${!a[@]}": quoted, yet a field per element */
+static int	is_quoted_list(t_segment *seg)
+{
+	if (!seg->quoted)
+		return (0);
+	if (seg->type == SEG_VAR)
+		return (strcmp(seg->text, "@") == 0);
+	return (seg->type == SEG_PARAM && is_array_list(seg->text));
+}
+
+/* The elements of a quoted list, *len slots where NULL ones are unset;
+ * *made when the vector is a copy for the caller to free */
+static char	**list_items(t_segment *seg, int *len, int *made)
+{
+	if (seg->type == SEG_VAR)
+	{
+		*len = g_shell.frame->count;
+		*made = 0;
+		return (g_shell.frame->params);
+	}
+	return (array_items(seg->text, len, made));
+}
+
+static int	is_empty_list(t_segment *seg)
+{
+	char	**items;
+	int		made;
 	int		len;
-	char	*name;
+	int		i;
 
-	start = *i;
-	
-	/* Handle special variables */
-	if (str[*i] == '?')
+	items = list_items(seg, &len, &made);
+	i = 0;
+	while (i < len && !items[i])
+		i++;
+	if (made)
+		free_string_array(items);
+	return (i == len);
+}
+
+/* A word of nothing but an empty "$@" or "${a[@]}" expands to no field */
+static int	is_empty_at(t_word *word)
+{
+	t_segment	*seg;
+	int			found;
+
+	found = 0;
+	seg = word->segments;
+	while (seg)
 	{
-		(*i)++;
-		return (safe_strdup("?"));
+		if (is_quoted_list(seg) && is_empty_list(seg))
+			found = 1;
+		else if (seg->type != SEG_LITERAL || seg->text[0])
+			return (0);
+		seg = seg->next;
 	}
-	
-	/* Handle regular variable names */
-	while (str[*i] && (isalnum(str[*i]) || str[*i] == '_'))
-		(*i)++;
-	
-	len = *i - start;
-	if (len == 0)
-		return (NULL);
-	
-	name = safe_malloc(len + 1);
-	strncpy(name, str + start, len);
-	name[len] = '\0';
-	
-	return (name);
+	return (found);
 }
 
-char	*expand_variables(char *str)
+/*
+ * A field per element, the first and last joined to the text around the
+ * list. The ones in between are copied straight into the argument vector,
+ * after a single reservation for all of them.
+ */
+static void	expand_list(t_fields *f, t_segment *seg)
 {
-	char	*result;
-	char	*var_name;
-	char	*var_value;
-	char	*temp;
+	char	**items;
+	int		made;
+	int		last;
 	int		i;
-	int		result_len;
 
-	if (!str)
-		return (NULL);
-	
-	result = safe_malloc(strlen(str) * 2 + 1);  // Conservative allocation
-	result[0] = '\0';
-	result_len = 0;
-	
+	items = list_items(seg, &last, &made);
 	i = 0;
-	while (str[i])
+	while (i < last && !items[i])
+		i++;
+	while (last > i && !items[last - 1])
+		last--;
+	if (i < last)
+	{
+		buf_add_str(&f->field, items[i]);
+		f->has_field = 1;
+	}
+	if (i < --last)
+	{
+		end_field(f);
+		argv_reserve(f->out, last - i - 1);
+		while (++i < last)
+			if (items[i])
+				f->out->items[f->out->count++] = safe_strdup(items[i]);
+		f->out->items[f->out->count] = NULL;
+		buf_add_str(&f->field, items[last]);
+		f->has_field = 1;
+	}
+	if (made)
+		free_string_array(items);
+}
+
+/*
+ * Expands a compiled word into fields appended to fields: the values of
+ * its segments are concatenated and unquoted ones are split on IFS.
+ * Process substitutions started on the way are recorded on cmd.
+ */
+void	expand_word(t_word *word, t_argv *fields, t_cmd *cmd)
+{
+	t_fields	f;
+	t_segment	*seg;
+	char		*value;
+
+	if (word->literal)
 	{
-		if (str[i] == '$' && str[i + 1])
+		argv_push(fields, safe_strdup(word->literal));
+		return ;
+	}
+	if (is_empty_at(word))
+		return ;
+	f.out = fields;
+	buf_init(&f.field, 64);
+	f.has_field = 0;
+	f.ifs = get_env_value("IFS");
+	if (!f.ifs)
+		f.ifs = " \t\n";
+	seg = word->segments;
+	while (seg)
+	{
+		if (is_quoted_list(seg))
 		{
-			i++;  // Skip $
-			var_name = extract_var_name(str, &i);
-			if (var_name)
-			{
-				if (strcmp(var_name, "?") == 0)
-				{
-					var_value = safe_malloc(12);  // Enough for any exit status
-					sprintf(var_value, "%d", g_shell.exit_status);
-				}
-				else
-				{
-					var_value = get_env_value(var_name);
-					if (var_value)
-						var_value = safe_strdup(var_value);
-					else
-						var_value = safe_strdup("");
-				}
-				
-				/* Expand result buffer if needed */
-				temp = safe_malloc(result_len + strlen(var_value) + 1);
-				strcpy(temp, result);
-				strcat(temp, var_value);
-				free(result);
-				result = temp;
-				result_len += strlen(var_value);
-				
-				free(var_name);
-				free(var_value);
-			}
-			else
-			{
-				/* Just add the $ character */
-				temp = safe_malloc(result_len + 2);
-				strcpy(temp, result);
-				temp[result_len] = '$';
-				temp[result_len + 1] = '\0';
-				free(result);
-				result = temp;
-				result_len++;
-			}
+			expand_list(&f, seg);
+			seg = seg->next;
+			continue ;
+		}
+		value = segment_value(seg, cmd);
+		if (seg->quoted || seg->type == SEG_LITERAL)
+		{
+			buf_add_str(&f.field, value);
+			f.has_field = 1;
 		}
 		else
+			split_value(&f, value);
+		free(value);
+		seg = seg->next;
+	}
+	end_field(&f);
+	free(f.field.data);
+}
+
+/* Expansion to a single string, without field splitting */
+char	*expand_word_string(t_word *word, t_cmd *cmd)
+{
+	t_buf		buf;
+	t_segment	*seg;
+	char		*value;
+
+	if (word->literal)
+		return (safe_strdup(word->literal));
+	buf_init(&buf, 64);
+	seg = word->segments;
+	while (seg)
+	{
+		value = segment_value(seg, cmd);
+		buf_add_str(&buf, value);
+		free(value);
+		seg = seg->next;
+	}
+	return (buf.data);
+}
+
+/* Expansion to a glob pattern, quoted parts only match themselves */
+char	*expand_pattern(t_word *word)
+{
+	t_buf		buf;
+	t_segment	*seg;
+	char		*value;
+	int			i;
+
+	buf_init(&buf, 64);
+	seg = word->segments;
+	while (seg)
+	{
+		value = segment_value(seg, NULL);
+		i = 0;
+		while (value[i])
 		{
-			/* Regular character */
-			temp = safe_malloc(result_len + 2);
-			strcpy(temp, result);
-			temp[result_len] = str[i];
-			temp[result_len + 1] = '\0';
-			free(result);
-			result = temp;
-			result_len++;
-			i++;
+			if (seg->quoted && strchr("*?[\\", value[i]))
+				buf_add_char(&buf, '\\');
+			buf_add_char(&buf, value[i++]);
 		}
+		free(value);
+		seg = seg->next;
 	}
-	
-	return (result);
+	return (buf.data);
 }
 
-char	*expand_tilde(char *str)
+/* Expands raw text (quotes included) to one string */
+char	*expand_variables(char *str)
 {
-	char	*home;
+	t_word	*word;
 	char	*result;
 
-	if (!str || str[0] != '~')
-		return (safe_strdup(str));
-	
-	home = get_env_value("HOME");
-	if (!home)
-		return (safe_strdup(str));
-	
-	if (str[1] == '\0' || str[1] == '/')
+	if (!str)
+		return (NULL);
+	word = compile_word(str);
+	result = expand_word_string(word, NULL);
+	free_words(word);
+	return (result);
+}
+
+/*
+ * Fills in cmd->args and the redirection targets from their templates.
+ * Runs before every execution of the command, in the shell process.
+ */
+void	expand_cmd(t_cmd *cmd)
+{
+	t_argv	args;
+	t_word	*word;
+	t_redir	*redir;
+
+	free_string_array(cmd->args);
+	cmd->args = NULL;
+	argv_init(&args, 8);
+	word = cmd->words;
+	while (word)
 	{
-		result = join_strings(home, str + 1);
-		return (result);
+		expand_word(word, &args, cmd);
+		word = word->next;
+	}
+	if (args.count > 0)
+		cmd->args = args.items;
+	else
+		free(args.items);
+	redir = cmd->redirs;
+	while (redir)
+	{
+		if (redir->word)
+		{
+			free(redir->target);
+			redir->target = expand_word_string(redir->word, cmd);
+		}
+		redir = redir->next;
 	}
-	
-	return (safe_strdup(str));
 }
 
-static int	match_pattern(char *str, char *pattern)
+/* Matches a [set] at *pattern against c, moving past it on success */
+static int	match_class(char **pattern, char c)
 {
-	if (*pattern == '\0')
-		return (*str == '\0');
-	
-	if (*pattern == '*')
+	char	*p;
+	int		negate;
+	int		found;
+
+	p = *pattern + 1;
+	negate = (*p == '!' || *p == '^');
+	if (negate)
+		p++;
+	found = 0;
+	if (*p == ']')
+		found = (*p++ == c);
+	while (*p && *p != ']')
 	{
-		/* Try matching zero characters */
-		if (match_pattern(str, pattern + 1))
-			return (1);
-		
-		/* Try matching one or more characters */
-		if (*str != '\0' && match_pattern(str + 1, pattern))
-			return (1);
-		
+		if (p[1] == '-' && p[2] && p[2] != ']')
+		{
+			found |= (c >= p[0] && c <= p[2]);
+			p += 3;
+		}
+		else
+			found |= (*p++ == c);
+	}
+	/* An unclosed [ is an ordinary character */
+	if (!*p)
+	{
+		if (c != '[')
+			return (0);
+		(*pattern)++;
+		return (1);
+	}
+	if (found == negate)
 		return (0);
+	*pattern = p + 1;
+	return (1);
+}
+
+static int	match_char(char **pattern, char c)
+{
+	if (**pattern == '[')
+		return (match_class(pattern, c));
+	if (**pattern == '\\' && (*pattern)[1])
+		(*pattern)++;
+	else if (**pattern == '?')
+	{
+		(*pattern)++;
+		return (1);
 	}
-	
-	if (*str == '\0')
+	if (**pattern != c)
 		return (0);
-	
-	if (*pattern == '?' || *pattern == *str)
-		return (match_pattern(str + 1, pattern + 1));
-	
-	return (0);
+	(*pattern)++;
+	return (1);
+}
+
+/*
+ * Glob match of the whole of str: *, ?, [set], [!set] and \ escapes.
+ * Backtracks only to the last *, so it stays linear for most patterns.
+ */
+int	match_pattern(char *str, char *pattern)
+{
+	char	*star_pattern;
+	char	*star_str;
+
+	star_pattern = NULL;
+	star_str = NULL;
+	while (*str)
+	{
+		if (*pattern == '*')
+		{
+			while (*pattern == '*')
+				pattern++;
+			star_pattern = pattern;
+			star_str = str;
+		}
+		else if (*pattern && match_char(&pattern, *str))
+			str++;
+		else if (star_pattern)
+		{
+			pattern = star_pattern;
+			str = ++star_str;
+		}
+		else
+			return (0);
+	}
+	while (*pattern == '*')
+		pattern++;
+	return (*pattern == '\0');
 }
 
 char	**expand_wildcards(char *pattern)
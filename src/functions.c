@@ -0,0 +1,265 @@
+#include "../include/minishell.h"
+
+/*
+ * Binds name to the body compiled at prog + pc. The function holds a
+ * reference to the program, which goes once no call runs it any more.
+ */
+void	define_function(char *name, t_program *prog, int pc)
+{
+	t_func			*func;
+	unsigned int	slot;
+
+	prog->refs++;
+	func = find_function(name);
+	if (func)
+	{
+		release_program(func->prog);
+		func->prog = prog;
+		func->pc = pc;
+		return ;
+	}
+	slot = hash_string(name) % FUNC_BUCKETS;
+	func = safe_malloc(sizeof(t_func));
+	func->name = safe_strdup(name);
+	func->prog = prog;
+	func->pc = pc;
+	func->next = g_shell.functions[slot];
+	g_shell.functions[slot] = func;
+}
+
+t_func	*find_function(char *name)
+{
+	t_func	*func;
+
+	func = g_shell.functions[hash_string(name) % FUNC_BUCKETS];
+	while (func && strcmp(func->name, name) != 0)
+		func = func->next;
+	return (func);
+}
+
+void	free_functions(void)
+{
+	t_func	*next;
+	int		i;
+
+	i = 0;
+	while (i < FUNC_BUCKETS)
+	{
+		while (g_shell.functions[i])
+		{
+			next = g_shell.functions[i]->next;
+			free(g_shell.functions[i]->name);
+			release_program(g_shell.functions[i]->prog);
+			free(g_shell.functions[i]);
+			g_shell.functions[i] = next;
+		}
+		i++;
+	}
+}
+
+/* Puts back what the locals of a returning function hid */
+void	restore_locals(t_local *locals)
+{
+	t_local	*next;
+
+	while (locals)
+	{
+		next = locals->next;
+		attach_variable(locals->name, locals->var);
+		free(locals->name);
+		free(locals);
+		locals = next;
+	}
+}
+
+/*
+ * Runs a function with the arguments of cmd as $1, $2... The frame is on
+ * this stack and takes over cmd->args, so a call copies nothing and a
+ * recursive call through the same command can't free the caller's $@.
+ */
+int	call_function(t_func *func, t_cmd *cmd)
+{
+	t_frame	frame;
+	int		loop_depth;
+	int		status;
+
+	if (g_shell.func_depth >= FUNC_NEST_MAX)
+	{
+		print_error(func->name, "maximum function nesting level exceeded");
+		return (1);
+	}
+	frame.args = cmd->args;
+	cmd->args = NULL;
+	frame.params = frame.args + 1;
+	frame.count = array_length(frame.params);
+	frame.locals = NULL;
+	frame.prev = g_shell.frame;
+	g_shell.frame = &frame;
+	loop_depth = g_shell.loop_depth;
+	g_shell.loop_depth = 0;
+	g_shell.func_depth++;
+	/* vm_execute() holds the program while the body runs */
+	status = vm_execute(func->prog, func->pc);
+	g_shell.func_depth--;
+	g_shell.loop_depth = loop_depth;
+	g_shell.returning = 0;
+	g_shell.breaking = 0;
+	g_shell.continuing = 0;
+	restore_locals(frame.locals);
+	g_shell.frame = frame.prev;
+	free_string_array(frame.args);
+	return (status);
+}
+
+/* $#, $@, $*, $0 and $1..., NULL when the parameter isn't set */
+char	*positional_value(char *name)
+{
+	t_frame	*frame;
+	t_buf	buf;
+	char	*ifs;
+	int		n;
+	int		i;
+
+	frame = g_shell.frame;
+	if (name[0] == '#')
+	{
+		buf_init(&buf, 12);
+		buf.len = sprintf(buf.data, "%d", frame->count);
+		return (buf.data);
+	}
+	if (name[0] == '@' || name[0] == '*')
+	{
+		ifs = get_env_value("IFS");
+		buf_init(&buf, 64);
+		i = 0;
+		while (i < frame->count)
+		{
+			if (i > 0 && (!ifs || *ifs))
+				buf_add_char(&buf, ifs ? *ifs : ' ');
+			buf_add_str(&buf, frame->params[i++]);
+		}
+		return (buf.data);
+	}
+	n = atoi(name);
+	if (n == 0)
+		return (safe_strdup(g_shell.name));
+	if (n > frame->count)
+		return (NULL);
+	return (safe_strdup(frame->params[n - 1]));
+}
+
+/* Takes name's variable away, leaving it unset until restore_locals puts
+ * it back */
+static t_local	*save_variable(char *name, t_local *next)
+{
+	t_local	*local;
+
+	local = safe_malloc(sizeof(t_local));
+	local->name = safe_strdup(name);
+	local->var = detach_variable(name);
+	local->next = next;
+	return (local);
+}
+
+/* The NAME=value prefixes of a function or builtin call, exported while
+ * it runs, or the assignments before the one being expanded; undone like
+ * locals */
+t_local	*push_assignments(char **assigns, int exported)
+{
+	t_local	*saved;
+	char	*equals;
+	int		i;
+
+	saved = NULL;
+	i = 0;
+	while (assigns && assigns[i])
+	{
+		equals = strchr(assigns[i], '=');
+		*equals = '\0';
+		saved = save_variable(assigns[i], saved);
+		if (exported)
+			set_env_value(assigns[i], equals + 1);
+		else
+			set_shell_value(assigns[i], equals + 1);
+		*equals = '=';
+		i++;
+	}
+	return (saved);
+}
+
+static int	make_local(char *arg)
+{
+	t_local	*local;
+	char	*equals;
+
+	equals = strchr(arg, '=');
+	if (equals)
+		*equals = '\0';
+	if (!isalpha(arg[0]) && arg[0] != '_')
+	{
+		print_error("local", "not a valid identifier");
+		return (0);
+	}
+	local = g_shell.frame->locals;
+	while (local && strcmp(local->name, arg) != 0)
+		local = local->next;
+	/* The first local of a name in a frame saves the outer value */
+	if (!local)
+	{
+		local = save_variable(arg, g_shell.frame->locals);
+		g_shell.frame->locals = local;
+	}
+	else
+		unset_env_value(arg);
+	if (equals)
+	{
+		set_shell_value(arg, equals + 1);
+		/* It stays exported if the variable it hides was */
+		export_variable(arg, local->var && local->var->exported);
+		*equals = '=';
+	}
+	return (1);
+}
+
+int	builtin_local(char **args)
+{
+	int	status;
+	int	i;
+
+	if (g_shell.frame == &g_shell.top_frame)
+	{
+		print_error("local", "can only be used in a function");
+		return (1);
+	}
+	status = 0;
+	i = 1;
+	while (args[i])
+		if (!make_local(args[i++]))
+			status = 1;
+	return (status);
+}
+
+int	builtin_return(char **args)
+{
+	if (g_shell.frame == &g_shell.top_frame)
+	{
+		print_error("return", "can only `return' from a function");
+		return (1);
+	}
+	g_shell.returning = 1;
+	if (args[1])
+		return (atoi(args[1]) & 0xff);
+	return (g_shell.exit_status);
+}
+
+int	builtin_shift(char **args)
+{
+	int	n;
+
+	n = args[1] ? atoi(args[1]) : 1;
+	if (n < 0 || n > g_shell.frame->count)
+		return (1);
+	g_shell.frame->params += n;
+	g_shell.frame->count -= n;
+	return (0);
+}
@@ -0,0 +1,496 @@
+#include "../include/minishell.h"
+
+/*
+ * Remembered command locations, as with bash's hash: PATH is searched once
+ * per command name, after that the path found is only checked with
+ * access(). The table belongs to one value of PATH and is forgotten as
+ * soon as PATH reads differently.
+ *
+ * The first Tab press fills it with every executable on PATH and sorts
+ * its entries into an index for completion. inotify watches on the PATH
+ * directories keep both up to date one name at a time, and while they
+ * do, a name missing from the table isn't on PATH and nothing is searched.
+ */
+
+# define INDEX_EVENTS 4096
+
+static t_hashed	*find_hashed(char *name)
+{
+	t_hashed	*entry;
+
+	entry = g_shell.hashed[hash_string(name) % HASH_BUCKETS];
+	while (entry && strcmp(entry->name, name) != 0)
+		entry = entry->next;
+	return (entry);
+}
+
+/* Where name sorts in the index, or would */
+static int	sorted_slot(const char *name, int *found)
+{
+	t_cmdindex	*index;
+	int			low;
+	int			high;
+	int			mid;
+	int			cmp;
+
+	index = &g_shell.commands;
+	low = 0;
+	high = index->count;
+	*found = 0;
+	while (low < high)
+	{
+		mid = low + (high - low) / 2;
+		cmp = strcmp(index->sorted[mid]->name, name);
+		if (cmp == 0)
+			*found = 1;
+		if (cmp < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return (low);
+}
+
+/* While the index is built entries are appended, sorted once at its end */
+static void	index_entry(t_hashed *entry)
+{
+	t_cmdindex	*index;
+	t_hashed	**bigger;
+	int			found;
+	int			slot;
+
+	index = &g_shell.commands;
+	if (index->count == index->cap)
+	{
+		index->cap = index->cap ? index->cap * 2 : 1024;
+		bigger = safe_malloc(sizeof(t_hashed *) * index->cap);
+		if (index->count)
+			memcpy(bigger, index->sorted, sizeof(t_hashed *) * index->count);
+		free(index->sorted);
+		index->sorted = bigger;
+	}
+	slot = index->count;
+	if (index->built)
+		slot = sorted_slot(entry->name, &found);
+	memmove(index->sorted + slot + 1, index->sorted + slot,
+		sizeof(t_hashed *) * (index->count - slot));
+	index->sorted[slot] = entry;
+	index->count++;
+}
+
+static t_hashed	*add_hashed(char *name, char *path, int dir, int hits)
+{
+	t_hashed		*entry;
+	unsigned int	slot;
+
+	slot = hash_string(name) % HASH_BUCKETS;
+	entry = safe_malloc(sizeof(t_hashed));
+	entry->name = safe_strdup(name);
+	entry->path = path;
+	entry->dir = dir;
+	entry->hits = hits;
+	entry->next = g_shell.hashed[slot];
+	g_shell.hashed[slot] = entry;
+	if (g_shell.commands.dirs)
+		index_entry(entry);
+	return (entry);
+}
+
+static void	forget_index(void)
+{
+	t_cmdindex	*index;
+
+	index = &g_shell.commands;
+	free(index->sorted);
+	free_string_array(index->dirs);
+	free(index->watches);
+	if (index->notify != -1 && index->owner == getpid())
+		close(index->notify);
+	memset(index, 0, sizeof(t_cmdindex));
+	index->notify = -1;
+}
+
+void	forget_paths(void)
+{
+	t_hashed	*next;
+	int			i;
+
+	forget_index();
+	i = 0;
+	while (i < HASH_BUCKETS)
+	{
+		while (g_shell.hashed[i])
+		{
+			next = g_shell.hashed[i]->next;
+			free(g_shell.hashed[i]->name);
+			free(g_shell.hashed[i]->path);
+			free(g_shell.hashed[i]);
+			g_shell.hashed[i] = next;
+		}
+		i++;
+	}
+	free(g_shell.hashed_for);
+	g_shell.hashed_for = NULL;
+}
+
+/* The table is valid for the PATH it was filled under */
+static void	check_path(void)
+{
+	char	*path;
+
+	path = get_env_value("PATH");
+	if (g_shell.hashed_for && path && strcmp(g_shell.hashed_for, path) == 0)
+		return ;
+	forget_paths();
+	if (path)
+		g_shell.hashed_for = safe_strdup(path);
+}
+
+/* Drops name from the table and the index */
+static void	unhash(char *name)
+{
+	t_hashed	**link;
+	t_hashed	*entry;
+	t_cmdindex	*index;
+	int			found;
+	int			slot;
+
+	link = &g_shell.hashed[hash_string(name) % HASH_BUCKETS];
+	while (*link && strcmp((*link)->name, name) != 0)
+		link = &(*link)->next;
+	entry = *link;
+	if (!entry)
+		return ;
+	*link = entry->next;
+	index = &g_shell.commands;
+	slot = sorted_slot(name, &found);
+	if (index->built && found)
+	{
+		index->count--;
+		memmove(index->sorted + slot, index->sorted + slot + 1,
+			sizeof(t_hashed *) * (index->count - slot));
+	}
+	free(entry->name);
+	free(entry->path);
+	free(entry);
+}
+
+/* name in directory dir, if it is an executable file there */
+static char	*executable_in(int dir, char *name)
+{
+	struct stat	st;
+	char		*path;
+	char		*temp;
+
+	temp = join_strings(g_shell.commands.dirs[dir], "/");
+	path = join_strings(temp, name);
+	free(temp);
+	if (stat(path, &st) == 0 && S_ISREG(st.st_mode)
+		&& access(path, X_OK) == 0)
+		return (path);
+	free(path);
+	return (NULL);
+}
+
+/* name changed in directory dir: it is there now, or if it was found
+ * there before, the directories after it are tried */
+static void	recheck_name(int dir, char *name)
+{
+	t_hashed	*entry;
+	char		*path;
+	int			i;
+
+	entry = find_hashed(name);
+	if (entry && entry->dir < dir)
+		return ;
+	path = executable_in(dir, name);
+	i = dir;
+	while (!path && entry && entry->dir == dir
+		&& ++i < g_shell.commands.ndirs)
+		path = executable_in(i, name);
+	if (path && entry)
+	{
+		free(entry->path);
+		entry->path = path;
+		entry->dir = i;
+	}
+	else if (path)
+		add_hashed(name, path, i, 0);
+	else if (entry && entry->dir == dir)
+		unhash(name);
+}
+
+static void	scan_dir(int dir)
+{
+	DIR				*d;
+	struct dirent	*ent;
+	struct stat		st;
+	char			*temp;
+
+	d = opendir(g_shell.commands.dirs[dir]);
+	if (!d)
+		return ;
+	temp = join_strings(g_shell.commands.dirs[dir], "/");
+	while ((ent = readdir(d)))
+	{
+		if (ent->d_name[0] == '.' || find_hashed(ent->d_name)
+			|| fstatat(dirfd(d), ent->d_name, &st, 0) == -1
+			|| !S_ISREG(st.st_mode)
+			|| faccessat(dirfd(d), ent->d_name, X_OK, 0) == -1)
+			continue ;
+		add_hashed(ent->d_name, join_strings(temp, ent->d_name), dir, 0);
+	}
+	free(temp);
+	closedir(d);
+}
+
+static int	compare_names(const void *a, const void *b)
+{
+	return (strcmp((*(t_hashed **)a)->name, (*(t_hashed **)b)->name));
+}
+
+#ifdef __linux__
+
+# define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+	| IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/* Watches every PATH directory; the index is only trusted when all that
+ * exist are */
+static void	watch_dirs(t_cmdindex *index)
+{
+	int	i;
+
+	index->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (index->notify != -1)
+		index->notify = shell_fd(index->notify, 0);
+	index->watches = safe_malloc(sizeof(int) * (index->ndirs + 1));
+	index->watching = index->notify != -1;
+	i = -1;
+	while (++i < index->ndirs)
+	{
+		index->watches[i] = -1;
+		if (index->notify != -1)
+			index->watches[i] = inotify_add_watch(index->notify,
+					index->dirs[i], WATCH_EVENTS);
+		if (index->watches[i] == -1 && errno != ENOENT && errno != ENOTDIR)
+			index->watching = 0;
+	}
+}
+
+static int	dir_of_watch(int wd)
+{
+	int	i;
+
+	i = 0;
+	while (i < g_shell.commands.ndirs && g_shell.commands.watches[i] != wd)
+		i++;
+	return (i < g_shell.commands.ndirs ? i : -1);
+}
+
+/*
+ * Applies what changed in the PATH directories. A directory that went
+ * away, or events that were lost, and the whole table is forgotten.
+ */
+void	sync_index(void)
+{
+	char					buf[INDEX_EVENTS]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event	*event;
+	ssize_t					n;
+	ssize_t					at;
+	int						lost;
+	int						dir;
+
+	if (g_shell.commands.notify == -1 || g_shell.commands.owner != getpid())
+		return ;
+	lost = 0;
+	while ((n = read(g_shell.commands.notify, buf, sizeof(buf))) > 0)
+	{
+		at = 0;
+		while (at < n)
+		{
+			event = (struct inotify_event *)(buf + at);
+			at += sizeof(struct inotify_event) + event->len;
+			if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF
+					| IN_MOVE_SELF | IN_IGNORED))
+				lost = 1;
+			else if (!lost && event->len
+				&& (dir = dir_of_watch(event->wd)) >= 0)
+				recheck_name(dir, event->name);
+		}
+	}
+	if (lost)
+		forget_paths();
+}
+
+#else
+
+static void	watch_dirs(t_cmdindex *index)
+{
+	index->notify = -1;
+	index->watching = 0;
+}
+
+void	sync_index(void)
+{
+}
+
+#endif
+
+/*
+ * Every executable of PATH, from the first directory that has it, in the
+ * table and sorted into the index. Without watches on all of PATH the
+ * index can't be kept up to date and is built again for each completion.
+ */
+static void	build_index(void)
+{
+	t_cmdindex	*index;
+	t_hashed	*entry;
+	int			i;
+
+	check_path();
+	sync_index();
+	index = &g_shell.commands;
+	if (index->built && index->watching && index->owner == getpid())
+		return ;
+	forget_index();
+	if (!g_shell.hashed_for)
+		return ;
+	index->owner = getpid();
+	index->dirs = split_path(g_shell.hashed_for);
+	index->ndirs = array_length(index->dirs);
+	i = -1;
+	while (++i < HASH_BUCKETS)
+	{
+		entry = g_shell.hashed[i];
+		while (entry)
+		{
+			index_entry(entry);
+			entry = entry->next;
+		}
+	}
+	watch_dirs(index);
+	i = -1;
+	while (++i < index->ndirs)
+	{
+		/* A relative directory is another one after each cd */
+		if (index->dirs[i][0] != '/')
+			index->watching = 0;
+		scan_dir(i);
+	}
+	qsort(index->sorted, index->count, sizeof(t_hashed *), compare_names);
+	index->built = 1;
+}
+
+/* Whether a name missing from the table is known not to be on PATH */
+int	index_complete(void)
+{
+	return (g_shell.commands.built && g_shell.commands.watching
+		&& g_shell.commands.owner == getpid());
+}
+
+/* Copies of the names on PATH starting with prefix, for completion */
+void	commands_with_prefix(const char *prefix, t_argv *names)
+{
+	t_cmdindex	*index;
+	size_t		len;
+	int			found;
+	int			i;
+
+	build_index();
+	index = &g_shell.commands;
+	len = strlen(prefix);
+	i = sorted_slot(prefix, &found);
+	while (i < index->count
+		&& strncmp(index->sorted[i]->name, prefix, len) == 0)
+		argv_push(names, safe_strdup(index->sorted[i++]->name));
+}
+
+/* A copy of the remembered path of name, NULL to search PATH */
+char	*hashed_path(char *name)
+{
+	t_hashed	*entry;
+
+	check_path();
+	sync_index();
+	entry = find_hashed(name);
+	if (!entry || access(entry->path, X_OK) != 0)
+		return (NULL);
+	entry->hits++;
+	return (safe_strdup(entry->path));
+}
+
+/* path was found for name in directory dir of PATH */
+void	remember_path(char *name, char *path, int dir)
+{
+	t_hashed	*entry;
+
+	entry = find_hashed(name);
+	if (!entry)
+	{
+		add_hashed(name, safe_strdup(path), dir, 1);
+		return ;
+	}
+	free(entry->path);
+	entry->path = safe_strdup(path);
+	entry->dir = dir;
+	entry->hits = 1;
+}
+
+static int	print_hashed(void)
+{
+	t_hashed	*entry;
+	int			any;
+	int			i;
+
+	check_path();
+	any = 0;
+	i = -1;
+	while (++i < HASH_BUCKETS)
+	{
+		entry = g_shell.hashed[i];
+		while (entry)
+		{
+			if (entry->hits && !any++)
+				printf("hits\tcommand\n");
+			if (entry->hits)
+				printf("%4d\t%s\n", entry->hits, entry->path);
+			entry = entry->next;
+		}
+	}
+	if (!any)
+		print_error("hash", "hash table empty");
+	return (0);
+}
+
+/* hash [-r] [name...]: lists the table, empties it or adds names to it */
+int	builtin_hash(char **args)
+{
+	char	*path;
+	char	*prefix;
+	int		status;
+
+	if (args[1] && strcmp(args[1], "-r") == 0)
+	{
+		forget_paths();
+		args++;
+	}
+	else if (!args[1])
+		return (print_hashed());
+	status = 0;
+	while (*++args)
+	{
+		if (strchr(*args, '/') || is_builtin(*args) || find_function(*args))
+			continue ;
+		path = find_command_path(*args, NULL);
+		if (!path)
+		{
+			prefix = join_strings("hash: ", *args);
+			print_error(prefix, "not found");
+			free(prefix);
+			status = 1;
+		}
+		free(path);
+	}
+	return (status);
+}
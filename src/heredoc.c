@@ -7,60 +7,29 @@ int	check_file_access(char *filename, int mode)
 	return (0);
 }
 
-int	create_heredoc(char *delimiter)
+/*
+ * A descriptor reading body from its start. The body is a file rather than
+ * a pipe so that a long one cannot block the shell writing it: a memory
+ * file where there are, else an unlinked temporary one.
+ */
+int	create_heredoc(char *body)
 {
-	int		pipe_fds[2];
-	char	*line;
-	pid_t	pid;
+	char	path[] = "/tmp/minishell-heredoc-XXXXXX";
+	int		fd;
 
-	if (pipe(pipe_fds) == -1)
-	{
-		print_error("pipe", strerror(errno));
+#ifdef __linux__
+	fd = memfd_create("minishell-heredoc", MFD_CLOEXEC);
+#else
+	fd = -1;
+#endif
+	if (fd == -1 && (fd = mkostemp(path, O_CLOEXEC)) != -1)
+		unlink(path);
+	if (fd == -1)
 		return (-1);
-	}
-	
-	pid = fork();
-	if (pid == 0)
-	{
-		/* Child process - read input and write to pipe */
-		close(pipe_fds[0]);
-		
-		while (1)
-		{
-			line = readline("> ");
-			if (!line)
-			{
-				printf("\n");
-				break ;
-			}
-			
-			if (strcmp(line, delimiter) == 0)
-			{
-				free(line);
-				break ;
-			}
-			
-			write(pipe_fds[1], line, strlen(line));
-			write(pipe_fds[1], "\n", 1);
-			free(line);
-		}
-		
-		close(pipe_fds[1]);
-		exit(0);
-	}
-	else if (pid > 0)
-	{
-		/* Parent process */
-		int status;
-		close(pipe_fds[1]);
-		waitpid(pid, &status, 0);
-		return (pipe_fds[0]);
-	}
-	else
+	if (!write_all(fd, body, strlen(body)) || lseek(fd, 0, SEEK_SET) == -1)
 	{
-		print_error("fork", strerror(errno));
-		close(pipe_fds[0]);
-		close(pipe_fds[1]);
+		close(fd);
 		return (-1);
 	}
+	return (fd);
 }
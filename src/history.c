@@ -0,0 +1,566 @@
+#include "../include/minishell.h"
+
+/*
+ * Command history kept across sessions in HISTFILE, ~/.minishell_history
+ * unless set. The file is mapped, not read, and only the places of its
+ * entries are indexed, so a long history costs an array of pointers
+ * rather than a copy of each line. New entries are appended HIST_BATCH at
+ * a time with a single write(). HISTSIZE bounds the list and HISTFILESIZE
+ * the file; HISTCONTROL's ignorespace, ignoredups, ignoreboth and
+ * erasedups pick what is kept, ignoredups when it is unset. The arrow keys
+ * walk this list, and history -g searches it.
+ *
+ * In the file a newline or a backslash inside an entry is escaped with a
+ * backslash, so every unescaped newline ends an entry. The file is only
+ * ever appended to, or replaced by rename(), never truncated under
+ * another shell's map.
+ */
+
+# define HIST_DEFAULT_SIZE 500
+# define HIST_BATCH 16
+# define HIST_FILE ".minishell_history"
+
+/* HISTSIZE or HISTFILESIZE, which defaults to HISTSIZE; negative is
+ * unlimited */
+static int	history_size(char *name)
+{
+	char	*value;
+	char	*end;
+	long	size;
+
+	value = get_env_value(name);
+	if (!value && strcmp(name, "HISTFILESIZE") == 0)
+		return (history_size("HISTSIZE"));
+	if (!value || !*value)
+		return (HIST_DEFAULT_SIZE);
+	size = strtol(value, &end, 10);
+	if (*end)
+		return (HIST_DEFAULT_SIZE);
+	return ((size < 0 || size > INT_MAX) ? INT_MAX : size);
+}
+
+/* The history file, NULL when HISTFILE is empty or there is no HOME */
+static char	*history_file(void)
+{
+	char	*file;
+	char	*home;
+	char	*path;
+
+	file = get_env_value("HISTFILE");
+	if (file)
+		return (*file ? safe_strdup(file) : NULL);
+	home = get_env_value("HOME");
+	if (!home)
+		return (NULL);
+	path = safe_malloc(strlen(home) + strlen(HIST_FILE) + 2);
+	sprintf(path, "%s/%s", home, HIST_FILE);
+	return (path);
+}
+
+/* Whether HISTCONTROL, a colon separated list, holds option */
+static int	controlled(char *option)
+{
+	char	*value;
+	size_t	len;
+
+	value = get_env_value("HISTCONTROL");
+	if (!value)
+		return (strcmp(option, "ignoredups") == 0);
+	while (*value)
+	{
+		len = strcspn(value, ":");
+		if ((len == strlen(option) && strncmp(value, option, len) == 0)
+			|| (len == 10 && strncmp(value, "ignoreboth", 10) == 0
+				&& strncmp(option, "ignore", 6) == 0))
+			return (1);
+		value += len + (value[len] == ':');
+	}
+	return (0);
+}
+
+static int	mapped(t_history *h, t_histent *entry)
+{
+	return (h->map && entry->line >= h->map
+		&& entry->line < h->map + h->map_len);
+}
+
+static void	drop_entry(t_history *h, int i)
+{
+	if (!mapped(h, &h->entries[i]))
+		free(h->entries[i].line);
+}
+
+static void	push_entry(t_history *h, char *line, size_t len)
+{
+	t_histent	*bigger;
+
+	if (h->end == h->cap && h->first >= h->cap / 2 && h->first > 0)
+	{
+		memmove(h->entries, h->entries + h->first,
+			sizeof(t_histent) * (h->end - h->first));
+		h->end -= h->first;
+		h->first = 0;
+	}
+	if (h->end == h->cap)
+	{
+		h->cap = h->cap ? h->cap * 2 : 64;
+		bigger = safe_malloc(sizeof(t_histent) * h->cap);
+		if (h->end)
+			memcpy(bigger, h->entries, sizeof(t_histent) * h->end);
+		free(h->entries);
+		h->entries = bigger;
+	}
+	h->entries[h->end].line = line;
+	h->entries[h->end++].len = len;
+}
+
+static int	same_as_last(t_history *h, char *line, size_t len)
+{
+	return (h->end > h->first && h->entries[h->end - 1].len == len
+		&& memcmp(h->entries[h->end - 1].line, line, len) == 0);
+}
+
+static void	trim_history(t_history *h, int size)
+{
+	while (h->end - h->first > size)
+		drop_entry(h, h->first++);
+}
+
+/* Indexes the entries of the mapped file */
+static void	index_entries(t_history *h)
+{
+	char	*line;
+	char	*end;
+	char	*stop;
+	int		dups;
+
+	dups = controlled("ignoredups");
+	line = h->map;
+	stop = h->map + h->map_len;
+	while (line < stop)
+	{
+		end = line;
+		while (end < stop && *end != '\n')
+			end += (*end == '\\' && end + 1 < stop) ? 2 : 1;
+		if (end > stop)
+			end = stop;
+		if (end > line && !(dups && same_as_last(h, line, end - line)))
+			push_entry(h, line, end - line);
+		line = end + 1;
+	}
+}
+
+/* Replaces the file by its last keep entries */
+static void	shorten_file(t_history *h, char *path, int keep)
+{
+	char	*tmp;
+	char	*from;
+	int		fd;
+	int		written;
+
+	from = h->map + h->map_len;
+	if (keep > 0)
+		from = h->entries[h->end - keep].line;
+	tmp = join_strings(path, ".tmp");
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	written = fd != -1 && write_all(fd, from, h->map + h->map_len - from);
+	if (fd != -1 && close(fd) == -1)
+		written = 0;
+	if (!written || rename(tmp, path) == -1)
+		unlink(tmp);
+	free(tmp);
+}
+
+/* Maps HISTFILE and indexes it; beyond HISTFILESIZE it is shortened */
+static void	read_history_file(t_history *h)
+{
+	struct stat	st;
+	char		*path;
+	int			fd;
+
+	path = history_file();
+	fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+	if (fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		h->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (h->map == MAP_FAILED)
+			h->map = NULL;
+		else
+			h->map_len = st.st_size;
+	}
+	if (fd != -1)
+		close(fd);
+	if (h->map)
+		index_entries(h);
+	if (h->map && h->end - h->first > history_size("HISTFILESIZE"))
+		shorten_file(h, path, history_size("HISTFILESIZE"));
+	trim_history(h, history_size("HISTSIZE"));
+	free(path);
+}
+
+/* Appends the entries added since the last time */
+static void	flush_history(t_history *h)
+{
+	char	*path;
+	int		fd;
+
+	if (!h->unsaved)
+		return ;
+	path = history_file();
+	fd = -1;
+	if (path)
+		fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	if (fd != -1)
+	{
+		write_all(fd, h->pending.data, h->pending.len);
+		close(fd);
+	}
+	free(path);
+	h->pending.len = 0;
+	h->unsaved = 0;
+}
+
+static void	forget_entries(t_history *h)
+{
+	while (h->first < h->end)
+		drop_entry(h, h->first++);
+	h->first = 0;
+	h->end = 0;
+	if (h->map)
+		munmap(h->map, h->map_len);
+	h->map = NULL;
+	h->map_len = 0;
+}
+
+/* The entry as it was typed */
+static char	*entry_text(t_histent *entry)
+{
+	char	*text;
+	size_t	i;
+	size_t	j;
+
+	text = safe_malloc(entry->len + 1);
+	i = 0;
+	j = 0;
+	while (i < entry->len)
+	{
+		if (entry->line[i] == '\\' && i + 1 < entry->len
+			&& (entry->line[i + 1] == '\n' || entry->line[i + 1] == '\\'))
+			i++;
+		text[j++] = entry->line[i++];
+	}
+	text[j] = '\0';
+	return (text);
+}
+
+/* Each readline() starts again from the end of the list */
+static int	rewind_history(void)
+{
+	t_history	*h;
+
+	h = &g_shell.history;
+	h->cursor = h->end;
+	free(h->typed);
+	h->typed = NULL;
+	return (0);
+}
+
+static void	show_line(char *text)
+{
+	rl_replace_line(text, 0);
+	rl_point = rl_end;
+}
+
+/* Up and down walk the list, the line being typed is kept at its end */
+static int	history_up(int count, int key)
+{
+	t_history	*h;
+	char		*text;
+
+	(void)key;
+	h = &g_shell.history;
+	if (count < 1 || h->cursor - count < h->first)
+		return (rl_ding());
+	if (h->cursor == h->end)
+		h->typed = safe_strdup(rl_line_buffer);
+	h->cursor -= count;
+	text = entry_text(&h->entries[h->cursor]);
+	show_line(text);
+	free(text);
+	return (0);
+}
+
+static int	history_down(int count, int key)
+{
+	t_history	*h;
+	char		*text;
+
+	(void)key;
+	h = &g_shell.history;
+	if (count < 1 || h->cursor + count > h->end)
+		return (rl_ding());
+	h->cursor += count;
+	if (h->cursor < h->end)
+	{
+		text = entry_text(&h->entries[h->cursor]);
+		show_line(text);
+		free(text);
+		return (0);
+	}
+	show_line(h->typed ? h->typed : "");
+	free(h->typed);
+	h->typed = NULL;
+	return (0);
+}
+
+/* The interactive shell's history: the file is loaded and the keys bound */
+void	load_history(void)
+{
+	t_history	*h;
+
+	h = &g_shell.history;
+	h->owner = getpid();
+	buf_init(&h->pending, 256);
+	read_history_file(h);
+	stifle_history(history_size("HISTSIZE"));
+	rl_startup_hook = rewind_history;
+	rl_bind_keyseq("\033[A", history_up);
+	rl_bind_keyseq("\033[B", history_down);
+	rl_bind_keyseq("\033OA", history_up);
+	rl_bind_keyseq("\033OB", history_down);
+	rl_bind_key(CTRL('P'), history_up);
+	rl_bind_key(CTRL('N'), history_down);
+}
+
+static void	erase_entries(t_history *h, char *line, size_t len)
+{
+	int	kept;
+	int	i;
+
+	kept = h->first;
+	i = h->first - 1;
+	while (++i < h->end)
+	{
+		if (h->entries[i].len == len
+			&& memcmp(h->entries[i].line, line, len) == 0)
+			drop_entry(h, i);
+		else
+			h->entries[kept++] = h->entries[i];
+	}
+	h->end = kept;
+}
+
+/* text as it is stored, with its newlines and backslashes escaped */
+static void	encode_entry(char *text, t_buf *line)
+{
+	buf_init(line, strlen(text) + 16);
+	while (*text)
+	{
+		if (*text == '\n' || *text == '\\')
+			buf_add_char(line, '\\');
+		buf_add_char(line, *text++);
+	}
+}
+
+/* A line read at the prompt; readline keeps its own copy for ^R */
+void	add_to_history(char *input)
+{
+	t_history	*h;
+	t_buf		line;
+	int			size;
+
+	h = &g_shell.history;
+	size = history_size("HISTSIZE");
+	if (!h->owner || size == 0
+		|| (input[0] == ' ' && controlled("ignorespace")))
+		return ;
+	encode_entry(input, &line);
+	if (controlled("ignoredups") && same_as_last(h, line.data, line.len))
+	{
+		free(line.data);
+		return ;
+	}
+	if (controlled("erasedups"))
+		erase_entries(h, line.data, line.len);
+	add_history(input);
+	stifle_history(size);
+	push_entry(h, line.data, line.len);
+	buf_add(&h->pending, line.data, line.len);
+	buf_add_char(&h->pending, '\n');
+	if (++h->unsaved >= HIST_BATCH)
+		flush_history(h);
+	trim_history(h, size);
+}
+
+/* At exit of the shell that loaded it; its forks leave the file alone */
+void	save_history(void)
+{
+	t_history	*h;
+
+	h = &g_shell.history;
+	if (h->owner != getpid())
+		return ;
+	flush_history(h);
+	forget_entries(h);
+	free(h->entries);
+	free(h->pending.data);
+	free(h->typed);
+	memset(h, 0, sizeof(t_history));
+}
+
+static void	print_entry(t_history *h, int i)
+{
+	t_histent	*entry;
+	char		*text;
+
+	entry = &h->entries[i];
+	if (!memchr(entry->line, '\\', entry->len))
+	{
+		printf("%5d  %.*s\n", i - h->first + 1, (int)entry->len, entry->line);
+		return ;
+	}
+	text = entry_text(entry);
+	printf("%5d  %s\n", i - h->first + 1, text);
+	free(text);
+}
+
+/* The loaded entries come first: the index of the first one after them */
+static int	loaded_end(t_history *h)
+{
+	int	low;
+	int	high;
+	int	mid;
+
+	low = h->first;
+	high = h->end;
+	while (low < high)
+	{
+		mid = low + (high - low) / 2;
+		if (mapped(h, &h->entries[mid]))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return (low);
+}
+
+/* The last of the loaded entries [low, high) starting at or before at */
+static int	entry_at(t_history *h, char *at, int low, int high)
+{
+	int	mid;
+
+	while (high - low > 1)
+	{
+		mid = low + (high - low) / 2;
+		if (h->entries[mid].line <= at)
+			low = mid;
+		else
+			high = mid;
+	}
+	return (low);
+}
+
+/*
+ * history -g text: the entries holding text. The loaded ones are searched
+ * as the single block of the mapping with memmem(), a match found is
+ * placed by bisection and the search goes on after its entry. text is
+ * escaped first, as the entries are.
+ */
+static int	search_history(t_history *h, char *pattern)
+{
+	t_histent	*entry;
+	t_buf		encoded;
+	char		*text;
+	size_t		len;
+	char		*at;
+	int			loaded;
+	int			found;
+	int			i;
+
+	encode_entry(pattern, &encoded);
+	text = encoded.data;
+	len = encoded.len;
+	loaded = loaded_end(h);
+	found = 0;
+	at = loaded > h->first ? h->entries[h->first].line : NULL;
+	while (at && len && at < h->map + h->map_len
+		&& (at = memmem(at, h->map + h->map_len - at, text, len)))
+	{
+		i = entry_at(h, at, h->first, loaded);
+		entry = &h->entries[i];
+		if (at < entry->line || at + len > entry->line + entry->len)
+		{
+			at++;
+			continue ;
+		}
+		print_entry(h, i);
+		found = 1;
+		at = entry->line + entry->len;
+	}
+	i = len ? loaded - 1 : h->first - 1;
+	while (++i < h->end)
+	{
+		if (!memmem(h->entries[i].line, h->entries[i].len, text, len))
+			continue ;
+		print_entry(h, i);
+		found = 1;
+	}
+	free(encoded.data);
+	return (!found);
+}
+
+static int	history_usage(void)
+{
+	print_error("history", "usage: history [-c] [-a] [-r] [-g text] [n]");
+	return (2);
+}
+
+/*
+ * history [n] lists the list, or its last n entries; -c empties it, -a
+ * appends the new entries to the file now and -r reads the file again.
+ */
+int	builtin_history(char **args)
+{
+	t_history	*h;
+	char		*end;
+	long		count;
+	int			acted;
+	int			i;
+
+	h = &g_shell.history;
+	acted = 0;
+	while (*++args && (*args)[0] == '-' && (*args)[1])
+	{
+		acted = 1;
+		if (strcmp(*args, "-g") == 0 && args[1])
+			return (search_history(h, args[1]));
+		if (strcmp(*args, "-c") == 0)
+		{
+			forget_entries(h);
+			clear_history();
+		}
+		else if (strcmp(*args, "-a") == 0 || strcmp(*args, "-r") == 0)
+			flush_history(h);
+		else
+			return (history_usage());
+		if (strcmp(*args, "-r") == 0)
+		{
+			forget_entries(h);
+			read_history_file(h);
+		}
+	}
+	if (!*args && acted)
+		return (0);
+	count = h->end - h->first;
+	if (*args)
+	{
+		errno = 0;
+		count = strtol(*args, &end, 10);
+		if (errno || end == *args || *end || count < 0)
+			return (history_usage());
+	}
+	i = h->end - count < h->first ? h->first : h->end - count;
+	while (i < h->end)
+		print_entry(h, i++);
+	return (0);
+}
@@ -7,6 +7,7 @@ t_token	*create_token(t_token_type type, char *value)
 	token = safe_malloc(sizeof(t_token));
 	token->type = type;
 	token->value = value ? safe_strdup(value) : NULL;
+	token->heredoc = NULL;
 	token->next = NULL;
 	return (token);
 }
@@ -35,20 +36,140 @@ void	free_tokens(t_token *tokens)
 		next = tokens->next;
 		if (tokens->value)
 			free(tokens->value);
+		free(tokens->heredoc);
 		free(tokens);
 		tokens = next;
 	}
 }
 
+/*
+ * Returns the index of the quote closing the one at input[i], or -1.
+ * Inside double quotes backslash escapes and $(...)/${...} are skipped.
+ */
+int	skip_quoted(char *input, int i)
+{
+	char	quote;
+	int		end;
+
+	quote = input[i++];
+	while (input[i] && input[i] != quote)
+	{
+		if (quote == '"' && input[i] == '\\' && input[i + 1])
+			i++;
+		else if (quote == '"' && input[i] == '$' && input[i + 1] == '('
+			&& (end = skip_parens(input, i + 1)) != -1)
+			i = end;
+		else if (quote == '"' && input[i] == '$' && input[i + 1] == '{'
+			&& (end = skip_braces(input, i + 1)) != -1)
+			i = end;
+		i++;
+	}
+	return (input[i] ? i : -1);
+}
+
+/* Index of the bracket matching input[i], skipping quotes and escapes */
+static int	skip_group(char *input, int i, char open, char close)
+{
+	int	depth;
+
+	depth = 0;
+	while (input[i])
+	{
+		if (input[i] == '\'' || input[i] == '"')
+		{
+			i = skip_quoted(input, i);
+			if (i == -1)
+				return (-1);
+		}
+		else if (input[i] == '\\' && input[i + 1])
+			i++;
+		else if (input[i] == open)
+			depth++;
+		else if (input[i] == close && --depth == 0)
+			return (i);
+		i++;
+	}
+	return (-1);
+}
+
+/*
+ * Returns the index of the parenthesis matching the one at input[i],
+ * skipping nested pairs and quoted parts, or -1 if there is none.
+ */
+int	skip_parens(char *input, int i)
+{
+	return (skip_group(input, i, '(', ')'));
+}
+
+/* Same as skip_parens() for the brace of a ${...} expansion */
+int	skip_braces(char *input, int i)
+{
+	return (skip_group(input, i, '{', '}'));
+}
+
+/* Same as skip_parens() for an array subscript */
+int	skip_brackets(char *input, int i)
+{
+	return (skip_group(input, i, '[', ']'));
+}
+
+/* The len characters of word so far are NAME= or NAME+=, so a ( that
+ * follows opens a compound array assignment */
+static int	is_array_open(char *word, int len)
+{
+	int	i;
+
+	if (len < 2 || word[len - 1] != '=' || (!isalpha(word[0])
+			&& word[0] != '_'))
+		return (0);
+	i = 1;
+	while (isalnum(word[i]) || word[i] == '_')
+		i++;
+	return (i == len - 1 || (word[i] == '+' && i == len - 2));
+}
+
+/*
+ * Extracts a raw word: quotes, backslash escapes and $(...)/${...} groups
+ * are kept verbatim for compile_word(). Returns NULL on an open quote.
+ */
 char	*extract_word(char *input, int *i)
 {
 	int		start;
+	int		end;
 	int		len;
 	char	*word;
 
 	start = *i;
-	while (input[*i] && !strchr(" \t\n|<>&();", input[*i]))
+	while (input[*i] && (!strchr(" \t\n|<>&();", input[*i])
+			|| (input[*i] == '(' && is_array_open(input + start, *i - start))))
+	{
+		end = *i;
+		if (input[*i] == '\'' || input[*i] == '"')
+			end = skip_quoted(input, *i);
+		else if (input[*i] == '\\' && input[*i + 1])
+			end = *i + 1;
+		/* $(...) and ${...} stay part of the word, whatever they contain */
+		else if (input[*i] == '$' && input[*i + 1] == '(')
+			end = skip_parens(input, *i + 1);
+		else if (input[*i] == '$' && input[*i + 1] == '{')
+			end = skip_braces(input, *i + 1);
+		/* a=(x y z) is a single word, split again by the parser */
+		else if (input[*i] == '(')
+			end = skip_parens(input, *i);
+		if (end == -1 && (input[*i] == '\'' || input[*i] == '"'))
+		{
+			print_error("lexer", "unterminated quoted string");
+			return (NULL);
+		}
+		if (end == -1 && input[*i] == '(')
+		{
+			print_error("lexer", "unterminated array assignment");
+			return (NULL);
+		}
+		if (end != -1)
+			*i = end;
 		(*i)++;
+	}
 	len = *i - start;
 	word = safe_malloc(len + 1);
 	strncpy(word, input + start, len);
@@ -56,28 +177,62 @@ char	*extract_word(char *input, int *i)
 	return (word);
 }
 
-char	*extract_quoted_string(char *input, int *i, char quote)
+/* Returns the text inside the parenthesis at input[*i], *i ends after it */
+char	*extract_parens(char *input, int *i)
 {
-	int		start;
+	int		end;
 	int		len;
 	char	*str;
 
-	start = ++(*i);  // Skip opening quote
-	while (input[*i] && input[*i] != quote)
-		(*i)++;
-	if (input[*i] != quote)
+	end = skip_parens(input, *i);
+	if (end == -1)
 	{
-		print_error("lexer", "unterminated quoted string");
+		print_error("lexer", "unterminated parenthesis");
 		return (NULL);
 	}
-	len = *i - start;
+	len = end - *i - 1;
 	str = safe_malloc(len + 1);
-	strncpy(str, input + start, len);
+	strncpy(str, input + *i + 1, len);
 	str[len] = '\0';
-	(*i)++;  // Skip closing quote
+	*i = end + 1;
 	return (str);
 }
 
+/*
+ * Returns the expression of an arithmetic group "((expr))" starting at
+ * input[*i], or NULL (leaving *i alone) if the parens are something else.
+ */
+char	*extract_arithmetic(char *input, int *i)
+{
+	int		end;
+	int		len;
+	char	*expr;
+
+	if (input[*i] != '(' || input[*i + 1] != '(')
+		return (NULL);
+	end = skip_parens(input, *i);
+	if (end == -1 || skip_parens(input, *i + 1) != end - 1)
+		return (NULL);
+	len = end - *i - 3;
+	expr = safe_malloc(len + 1);
+	strncpy(expr, input + *i + 2, len);
+	expr[len] = '\0';
+	*i = end + 1;
+	return (expr);
+}
+
+static int	is_io_number(char *word, char next)
+{
+	int	i;
+
+	if (next != '<' && next != '>')
+		return (0);
+	i = 0;
+	while (word[i] && isdigit(word[i]))
+		i++;
+	return (i > 0 && word[i] == '\0');
+}
+
 static t_token_type	get_operator_type(char *input, int *i)
 {
 	if (input[*i] == '|')
@@ -97,6 +252,11 @@ static t_token_type	get_operator_type(char *input, int *i)
 			*i += 2;
 			return (TOKEN_REDIRECT_HEREDOC);
 		}
+		if (input[*i + 1] == '&')
+		{
+			*i += 2;
+			return (TOKEN_DUP_IN);
+		}
 		(*i)++;
 		return (TOKEN_REDIRECT_IN);
 	}
@@ -107,6 +267,11 @@ static t_token_type	get_operator_type(char *input, int *i)
 			*i += 2;
 			return (TOKEN_REDIRECT_APPEND);
 		}
+		if (input[*i + 1] == '&')
+		{
+			*i += 2;
+			return (TOKEN_DUP_OUT);
+		}
 		(*i)++;
 		return (TOKEN_REDIRECT_OUT);
 	}
@@ -118,6 +283,16 @@ static t_token_type	get_operator_type(char *input, int *i)
 			return (TOKEN_AND);
 		}
 	}
+	else if (input[*i] == ';')
+	{
+		if (input[*i + 1] == ';')
+		{
+			*i += 2;
+			return (TOKEN_DSEMI);
+		}
+		(*i)++;
+		return (TOKEN_SEMI);
+	}
 	else if (input[*i] == '(')
 	{
 		(*i)++;
@@ -131,60 +306,176 @@ static t_token_type	get_operator_type(char *input, int *i)
 	return (TOKEN_ERROR);
 }
 
+/* Adds the line at input + *i to body unless it is the delimiter alone */
+static int	body_line(char *input, int *i, t_buf *body, char *delimiter)
+{
+	char	*end;
+	size_t	len;
+	int		found;
+
+	end = strchr(input + *i, '\n');
+	len = end ? (size_t)(end - (input + *i)) : strlen(input + *i);
+	found = (len == strlen(delimiter)
+			&& strncmp(input + *i, delimiter, len) == 0);
+	if (!found)
+	{
+		buf_add(body, input + *i, len);
+		buf_add_char(body, '\n');
+	}
+	*i += len + (end != NULL);
+	return (found);
+}
+
+/*
+ * Takes the lines after a heredoc's line up to its delimiter as its body.
+ * The end of the input ends it too, unless more lines can follow: then the
+ * body stays unread and the parser asks for them.
+ */
+static void	read_body(t_token *word, char *input, int *i)
+{
+	t_buf	body;
+	char	*delimiter;
+	char	*msg;
+	int		found;
+
+	delimiter = remove_quotes(word->value);
+	buf_init(&body, 256);
+	found = 0;
+	while (input[*i] && !found)
+		found = body_line(input, i, &body, delimiter);
+	if (!found && g_shell.continuation)
+		free(body.data);
+	else
+	{
+		if (!found)
+		{
+			msg = safe_malloc(strlen(delimiter) + 64);
+			sprintf(msg, "here-document delimited by end-of-file "
+				"(wanted `%s')", delimiter);
+			print_error("warning", msg);
+			free(msg);
+		}
+		word->heredoc = body.data;
+	}
+	free(delimiter);
+}
+
+/* Bodies of the heredocs opened on the line starting at token, in order */
+static void	read_heredocs(t_token *token, char *input, int *i)
+{
+	while (token)
+	{
+		if (token->type == TOKEN_REDIRECT_HEREDOC && token->next
+			&& token->next->type == TOKEN_WORD)
+			read_body(token->next, input, i);
+		token = token->next;
+	}
+}
+
 t_token	*lexer(char *input)
 {
 	t_token	*tokens;
+	t_token	**tail;
+	t_token	*line;
 	t_token	*new_token;
 	char	*word;
 	int		i;
 
 	tokens = NULL;
+	/* Appending through the last next pointer keeps long inputs linear */
+	tail = &tokens;
+	line = NULL;
 	i = 0;
 	
 	while (input[i])
 	{
-		/* Skip whitespace */
-		while (input[i] && strchr(" \t\n", input[i]))
-			i++;
+		/* Skip whitespace, comments and line continuations */
+		while (input[i] == ' ' || input[i] == '\t'
+			|| (input[i] == '\\' && input[i + 1] == '\n'))
+			i += (input[i] == '\\') ? 2 : 1;
+		if (input[i] == '#')
+			while (input[i] && input[i] != '\n')
+				i++;
 		
 		if (!input[i])
 			break ;
 		
-		/* Handle quoted strings */
-		if (input[i] == '"' || input[i] == '\'')
+		/* Newlines separate commands like ; */
+		if (input[i] == '\n')
+		{
+			new_token = create_token(TOKEN_NEWLINE, "newline");
+			i++;
+		}
+		/* Handle process substitution */
+		else if ((input[i] == '<' || input[i] == '>') && input[i + 1] == '(')
 		{
-			word = extract_quoted_string(input, &i, input[i]);
+			t_token_type type = input[i] == '<' ? TOKEN_PROCSUB_IN
+				: TOKEN_PROCSUB_OUT;
+			i++;
+			word = extract_parens(input, &i);
 			if (!word)
 			{
 				free_tokens(tokens);
 				return (NULL);
 			}
-			new_token = create_token(TOKEN_WORD, word);
+			new_token = create_token(type, word);
+			free(word);
+		}
+		/* Handle (( expr )) arithmetic commands */
+		else if ((word = extract_arithmetic(input, &i)) != NULL)
+		{
+			new_token = create_token(TOKEN_ARITH, word);
 			free(word);
 		}
 		/* Handle operators */
 		else if (strchr("|<>&();", input[i]))
 		{
+			int start = i;
 			t_token_type type = get_operator_type(input, &i);
 			if (type == TOKEN_ERROR)
 			{
+				word = strndup(input + i, 1);
+				syntax_error(word);
+				free(word);
 				free_tokens(tokens);
 				return (NULL);
 			}
-			new_token = create_token(type, NULL);
+			/* Operators carry their spelling for error messages */
+			word = strndup(input + start, i - start);
+			new_token = create_token(type, word);
+			free(word);
 		}
 		/* Handle regular words */
 		else
 		{
 			word = extract_word(input, &i);
-			new_token = create_token(TOKEN_WORD, word);
+			if (!word)
+			{
+				free_tokens(tokens);
+				return (NULL);
+			}
+			/* Digits glued to a redirection operator name its fd (2>err) */
+			if (is_io_number(word, input[i]))
+				new_token = create_token(TOKEN_IO_NUMBER, word);
+			else
+				new_token = create_token(TOKEN_WORD, word);
 			free(word);
 		}
 		
-		add_token(&tokens, new_token);
+		*tail = new_token;
+		tail = &new_token->next;
+		if (!line)
+			line = new_token;
+		/* Heredoc bodies start on the line after the one naming them */
+		if (new_token->type == TOKEN_NEWLINE)
+		{
+			read_heredocs(line, input, &i);
+			line = NULL;
+		}
 	}
+	read_heredocs(line, input, &i);
 	
 	/* Add EOF token */
-	add_token(&tokens, create_token(TOKEN_EOF, NULL));
+	*tail = create_token(TOKEN_EOF, NULL);
 	return (tokens);
 }
@@ -0,0 +1,314 @@
+#include "../include/minishell.h"
+
+/*
+ * Resource controls. ulimit changes the limits of the shell and of all it
+ * starts; pin places and limits one command, and PIPEAFFINITY spreads the
+ * stages of pipelines over CPUs. Both act in the forked child before
+ * execve(), so the shell itself is never moved or limited.
+ */
+
+/* A ulimit resource; values are counted in units of unit bytes */
+typedef struct s_limit
+{
+	char				option;
+	int					resource;
+	int					unit;
+	char				*name;
+	char				*units;
+}	t_limit;
+
+static const t_limit	g_limits[] = {
+	{'c', RLIMIT_CORE, 1024, "core file size", "blocks, "},
+	{'d', RLIMIT_DATA, 1024, "data seg size", "kbytes, "},
+	{'f', RLIMIT_FSIZE, 1024, "file size", "blocks, "},
+	{'l', RLIMIT_MEMLOCK, 1024, "max locked memory", "kbytes, "},
+	{'m', RLIMIT_RSS, 1024, "max memory size", "kbytes, "},
+	{'n', RLIMIT_NOFILE, 1, "open files", ""},
+	{'s', RLIMIT_STACK, 1024, "stack size", "kbytes, "},
+	{'t', RLIMIT_CPU, 1, "cpu time", "seconds, "},
+	{'u', RLIMIT_NPROC, 1, "max user processes", ""},
+	{'v', RLIMIT_AS, 1024, "virtual memory", "kbytes, "},
+	{0, 0, 0, NULL, NULL}
+};
+
+static const t_limit	*find_limit(char option)
+{
+	int	i;
+
+	i = 0;
+	while (g_limits[i].option && g_limits[i].option != option)
+		i++;
+	return (g_limits[i].option ? &g_limits[i] : NULL);
+}
+
+static void	print_limit(const t_limit *limit, int hard, int named)
+{
+	struct rlimit	rl;
+	rlim_t			value;
+
+	if (getrlimit(limit->resource, &rl) == -1)
+	{
+		print_error("ulimit", strerror(errno));
+		return ;
+	}
+	value = hard ? rl.rlim_max : rl.rlim_cur;
+	if (named)
+		printf("%-28s(%s-%c) ", limit->name, limit->units, limit->option);
+	if (value == RLIM_INFINITY)
+		printf("unlimited\n");
+	else
+		printf("%llu\n", (unsigned long long)(value / limit->unit));
+}
+
+/* ulimit sets the soft limit, the hard one or, without -S or -H, both */
+static int	set_limit(const t_limit *limit, char *arg, int which)
+{
+	struct rlimit	rl;
+	char			*end;
+	rlim_t			value;
+
+	value = RLIM_INFINITY;
+	if (strcmp(arg, "unlimited") != 0)
+	{
+		errno = 0;
+		value = strtoull(arg, &end, 10);
+		if (errno || end == arg || *end || arg[0] == '-'
+			|| value > RLIM_INFINITY / limit->unit)
+		{
+			print_error("ulimit", "invalid number");
+			return (1);
+		}
+		value *= limit->unit;
+	}
+	if (getrlimit(limit->resource, &rl) == -1)
+		return (1);
+	if (which != 'S')
+		rl.rlim_max = value;
+	if (which != 'H')
+		rl.rlim_cur = value;
+	if (setrlimit(limit->resource, &rl) == -1)
+	{
+		print_error("ulimit", strerror(errno));
+		return (1);
+	}
+	return (0);
+}
+
+/* ulimit [-SH] [-a | -cdflmnstuv] [limit], -f when no resource is named */
+int	builtin_ulimit(char **args)
+{
+	const t_limit	*limit;
+	int				which;
+	int				all;
+	int				i;
+
+	limit = find_limit('f');
+	which = 0;
+	all = 0;
+	while (*++args && (*args)[0] == '-' && (*args)[1])
+	{
+		i = 0;
+		while ((*args)[++i])
+		{
+			if ((*args)[i] == 'S' || (*args)[i] == 'H')
+				which = (*args)[i];
+			else if ((*args)[i] == 'a')
+				all = 1;
+			else if (!(limit = find_limit((*args)[i])))
+			{
+				print_error("ulimit", "usage: ulimit [-SHa] [-cdflmnstuv] "
+					"[limit]");
+				return (2);
+			}
+		}
+	}
+	if (*args && !all)
+		return (set_limit(limit, *args, which));
+	i = -1;
+	while (all && g_limits[++i].option)
+		print_limit(&g_limits[i], which == 'H', 1);
+	if (!all)
+		print_limit(limit, which == 'H', 0);
+	return (0);
+}
+
+#ifdef __linux__
+
+/* A CPU list such as 0-3,8,10-11 */
+static int	parse_cpus(char *list, cpu_set_t *set)
+{
+	char	*end;
+	long	first;
+	long	last;
+
+	CPU_ZERO(set);
+	while (*list)
+	{
+		first = strtol(list, &end, 10);
+		last = first;
+		if (end != list && *end == '-')
+		{
+			list = end + 1;
+			last = strtol(list, &end, 10);
+		}
+		if (end == list || first < 0 || last < first || last >= CPU_SETSIZE)
+			return (0);
+		while (first <= last)
+			CPU_SET(first++, set);
+		if (*end == ',' && end[1])
+			end++;
+		else if (*end)
+			return (0);
+		list = end;
+	}
+	return (CPU_COUNT(set) > 0);
+}
+
+static int	pin_cpus(char *list)
+{
+	cpu_set_t	set;
+
+	if (!parse_cpus(list, &set))
+	{
+		errno = EINVAL;
+		return (0);
+	}
+	return (sched_setaffinity(0, sizeof(cpu_set_t), &set) == 0);
+}
+
+/*
+ * PIPEAFFINITY is a CPU list, or auto for all the CPUs the shell may use;
+ * stage n of a pipeline is bound to the n-th of them, round robin.
+ */
+void	place_stage(int stage)
+{
+	cpu_set_t	set;
+	char		*value;
+	int			cpu;
+
+	value = get_env_value("PIPEAFFINITY");
+	if (!value || !*value)
+		return ;
+	if (strcmp(value, "auto") == 0)
+	{
+		if (sched_getaffinity(0, sizeof(cpu_set_t), &set) == -1)
+			return ;
+	}
+	else if (!parse_cpus(value, &set))
+	{
+		print_error("PIPEAFFINITY", "invalid CPU list");
+		return ;
+	}
+	stage %= CPU_COUNT(&set);
+	cpu = 0;
+	while (!CPU_ISSET(cpu, &set) || stage-- > 0)
+		cpu++;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(cpu_set_t), &set);
+}
+
+#else
+
+static int	pin_cpus(char *list)
+{
+	(void)list;
+	errno = ENOSYS;
+	return (0);
+}
+
+void	place_stage(int stage)
+{
+	(void)stage;
+}
+
+#endif
+
+/* Lowers the soft limit of resource to value */
+static int	pin_limit(int resource, long value)
+{
+	struct rlimit	rl;
+
+	if (value < 0 || getrlimit(resource, &rl) == -1)
+	{
+		errno = EINVAL;
+		return (0);
+	}
+	rl.rlim_cur = value;
+	return (setrlimit(resource, &rl) == 0);
+}
+
+static int	pin_option(char c, char *value)
+{
+	char	*end;
+	long	nice;
+
+	if (c == 'c')
+		return (pin_cpus(value));
+	if (c == 'm')
+		return (pin_limit(RLIMIT_AS, parse_size(value)));
+	if (c == 't')
+		return (pin_limit(RLIMIT_CPU, parse_size(value)));
+	errno = 0;
+	nice = strtol(value, &end, 10);
+	if (errno || end == value || *end)
+	{
+		errno = EINVAL;
+		return (0);
+	}
+	return (setpriority(PRIO_PROCESS, 0, nice) == 0);
+}
+
+/*
+ * pin's options applied to the calling process, a child about to run the
+ * command; *args is left on the command. 0 after an error.
+ */
+int	apply_pin(char ***args)
+{
+	char	*value;
+	char	*prefix;
+	char	c;
+	int		i;
+
+	while (*++(*args) && (**args)[0] == '-' && (**args)[1])
+	{
+		if (strcmp(**args, "--") == 0 && ++(*args))
+			break ;
+		i = 1;
+		c = (**args)[i];
+		if (!strchr("cmnt", c) || !(value = option_value(args, &i)))
+			break ;
+		if (!pin_option(c, value))
+		{
+			prefix = join_strings("pin: ", value);
+			print_error(prefix, strerror(errno));
+			free(prefix);
+			return (0);
+		}
+	}
+	if (!**args || (**args)[0] == '-')
+	{
+		print_error("pin", "usage: pin [-c cpus] [-n nice] [-m memory] "
+			"[-t seconds] command [args]");
+		return (0);
+	}
+	return (1);
+}
+
+/* pin in the shell itself: the command runs in a child placed first */
+int	builtin_pin(t_cmd *cmd)
+{
+	pid_t	pid;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0)
+		exit(exec_command(cmd));
+	if (pid == -1)
+	{
+		print_error("fork", strerror(errno));
+		return (1);
+	}
+	close_procsubs(cmd);
+	return (wait_children(&pid, 1));
+}
@@ -0,0 +1,150 @@
+#include "../include/minishell.h"
+
+/*
+ * enable -f FILE NAME... loads builtins from the shared object FILE, built
+ * against include/minishell_builtin.h, into the builtin table: they run in
+ * the shell like echo, with no fork, and functions still shadow them. FILE
+ * without a slash is searched for as dlopen() does. enable alone lists the
+ * builtins.
+ */
+
+static int	valid_name(const char *name)
+{
+	int	i;
+
+	i = 0;
+	while (isalnum((unsigned char)name[i]) || name[i] == '_')
+		i++;
+	return (i > 0 && !name[i] && !isdigit((unsigned char)name[0]));
+}
+
+static const char	*get_var(const char *name)
+{
+	return (get_env_value((char *)name));
+}
+
+static int	set_var(const char *name, const char *value)
+{
+	if (!valid_name(name))
+		return (-1);
+	set_shell_value((char *)name, (char *)value);
+	return (0);
+}
+
+static int	unset_var(const char *name)
+{
+	if (!valid_name(name))
+		return (-1);
+	unset_env_value((char *)name);
+	return (0);
+}
+
+static const t_shell_api	g_api = {
+	MINISHELL_BUILTIN_ABI,
+	STDIN_FILENO,
+	STDOUT_FILENO,
+	STDERR_FILENO,
+	get_var,
+	set_var,
+	unset_var
+};
+
+/* The builtin writes to the descriptors itself, after what printf kept */
+int	run_loadable(const t_loadable *loadable, char **args)
+{
+	fflush(stdout);
+	return (loadable->run(array_length(args), args, &g_api));
+}
+
+/* Whether name is one of the shell's own builtins, which stay */
+static int	shell_builtin(char *name)
+{
+	int	i;
+
+	if (is_special_builtin(name))
+		return (1);
+	if (!is_builtin(name))
+		return (0);
+	i = g_shell.loaded_count;
+	while (i-- > 0)
+		if (strcmp(g_shell.loaded[i].name, name) == 0)
+			return (0);
+	return (1);
+}
+
+/* name from NAME_builtin in handle; a name loaded before is replaced */
+static int	load_builtin(void *handle, char *name)
+{
+	const t_loadable	*loadable;
+	char				*symbol;
+
+	if (shell_builtin(name))
+	{
+		print_error(name, "is a shell builtin");
+		return (0);
+	}
+	symbol = safe_malloc(strlen(name) + sizeof("_builtin"));
+	sprintf(symbol, "%s_builtin", name);
+	loadable = dlsym(handle, symbol);
+	free(symbol);
+	if (!loadable)
+	{
+		print_error("enable", dlerror());
+		return (0);
+	}
+	if (loadable->abi != MINISHELL_BUILTIN_ABI || !loadable->run)
+	{
+		print_error(name, "built for another builtin ABI");
+		return (0);
+	}
+	if (loadable->load && loadable->load(&g_api) != 0)
+	{
+		print_error(name, "failed to load");
+		return (0);
+	}
+	return (add_builtin(name, loadable) >= 0);
+}
+
+static int	list_builtins(void)
+{
+	char	*name;
+	int		i;
+
+	i = 0;
+	while ((name = builtin_name(i++)))
+		printf("enable %s\n", name);
+	return (0);
+}
+
+int	builtin_enable(char **args)
+{
+	void	*handle;
+	char	*file;
+	int		loaded;
+	int		i;
+
+	if (!args[1])
+		return (list_builtins());
+	args++;
+	i = 1;
+	if ((*args)[0] != '-' || (*args)[1] != 'f'
+		|| !(file = option_value(&args, &i)) || !*++args)
+	{
+		print_error("enable", "usage: enable [-f file name...]");
+		return (2);
+	}
+	handle = dlopen(file, RTLD_NOW | RTLD_LOCAL);
+	if (!handle)
+	{
+		print_error("enable", dlerror());
+		return (1);
+	}
+	loaded = 0;
+	i = 0;
+	while (args[i])
+		loaded += load_builtin(handle, args[i++]);
+	/* A shared object stays loaded once a builtin of it is in the table */
+	if (!loaded)
+		dlclose(handle);
+	return (loaded < i);
+}
@@ -5,44 +5,150 @@ t_shell	g_shell;
 static void	init_shell(char **envp)
 {
 	g_shell.exit_status = 0;
-	g_shell.stdin_backup = dup(STDIN_FILENO);
-	g_shell.stdout_backup = dup(STDOUT_FILENO);
+	adopt_user_fds();
+	g_shell.stdin_backup = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC,
+			SHELL_FD_BASE);
+	g_shell.stdout_backup = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC,
+			SHELL_FD_BASE);
+	memset(&g_shell.inherited, 0, sizeof(t_fdset));
+	g_shell.check_fds = 0;
 	g_shell.pids = NULL;
 	g_shell.num_processes = 0;
+	g_shell.loop_depth = 0;
+	g_shell.breaking = 0;
+	g_shell.continuing = 0;
+	g_shell.interrupted = 0;
+	g_shell.continuation = 0;
+	g_shell.incomplete = 0;
+	g_shell.returning = 0;
+	g_shell.func_depth = 0;
+	g_shell.dump_bytecode = 0;
+	g_shell.no_rc = 0;
+	g_shell.pipe_size = 0;
+	memset(&g_shell.timeout, 0, sizeof(t_timeout));
+	memset(&g_shell.commands, 0, sizeof(t_cmdindex));
+	g_shell.commands.notify = -1;
+	g_shell.name = "minishell";
+	g_shell.top_frame.args = NULL;
+	g_shell.top_frame.params = NULL;
+	g_shell.top_frame.count = 0;
+	g_shell.top_frame.locals = NULL;
+	g_shell.top_frame.prev = NULL;
+	g_shell.frame = &g_shell.top_frame;
 	init_env(envp);
 	setup_signals();
 }
 
-static int	process_input(char *input)
+static int	is_blank(t_token *tokens)
+{
+	while (tokens && tokens->type == TOKEN_NEWLINE)
+		tokens = tokens->next;
+	return (!tokens || tokens->type == TOKEN_EOF);
+}
+
+/* Lexes and parses input, NULL for errors and input without commands */
+t_node	*parse_line(char *input)
 {
 	t_token	*tokens;
-	t_cmd	*commands;
-	int		result;
+	t_node	*tree;
 
-	if (!input || !*input)
-		return (0);
-	
-	/* Add to history */
-	add_history(input);
-	
 	/* Lexical analysis */
 	tokens = lexer(input);
 	if (!tokens)
-		return (0);
+	{
+		g_shell.exit_status = 2;
+		return (NULL);
+	}
 	
 	/* Syntax analysis */
-	commands = parser(tokens);
+	tree = parser(tokens);
+	if (!tree && !g_shell.incomplete && !is_blank(tokens))
+		g_shell.exit_status = 2;
 	free_tokens(tokens);
-	if (!commands)
-		return (0);
+	return (tree);
+}
+
+static int	dump_line(t_node *tree)
+{
+	t_program	*prog;
+
+	prog = compile_program(tree);
+	dump_program(prog);
+	release_program(prog);
+	return (0);
+}
+
+int	execute_line(char *input)
+{
+	t_node	*tree;
+	int		result;
+
+	tree = parse_line(input);
+	if (!tree)
+		return (g_shell.exit_status);
 	
-	/* Execution */
-	result = executor(commands);
-	free_cmds(commands);
+	/* Execution, or just the listing with --dump-bytecode */
+	if (g_shell.dump_bytecode)
+		result = dump_line(tree);
+	else
+		result = executor(tree);
+	free_node(tree);
 	
 	return (result);
 }
 
+/* Keeps reading lines while a command is unfinished, like an open loop */
+static t_node	*read_command(char **input)
+{
+	t_node	*tree;
+	char	*line;
+	char	*joined;
+
+	g_shell.continuation = 1;
+	tree = parse_line(*input);
+	while (!tree && g_shell.incomplete)
+	{
+		line = readline("> ");
+		if (!line)
+		{
+			/* Parsed once more to report the error */
+			g_shell.continuation = 0;
+			tree = parse_line(*input);
+			break ;
+		}
+		joined = safe_malloc(strlen(*input) + strlen(line) + 2);
+		sprintf(joined, "%s\n%s", *input, line);
+		free(line);
+		free(*input);
+		*input = joined;
+		tree = parse_line(*input);
+	}
+	g_shell.continuation = 0;
+	return (tree);
+}
+
+static void	process_input(char **input)
+{
+	t_node	*tree;
+
+	if (!*input || !**input)
+		return ;
+	
+	tree = read_command(input);
+	
+	/* Add to history */
+	add_to_history(*input);
+	
+	if (tree)
+	{
+		if (g_shell.dump_bytecode)
+			dump_line(tree);
+		else
+			executor(tree);
+		free_node(tree);
+	}
+}
+
 static void	shell_loop(void)
 {
 	char	*input;
@@ -100,23 +206,114 @@ static void	shell_loop(void)
 		
 		/* Process the input */
 		if (*input)
-			process_input(input);
+			process_input(&input);
 		
 		free(input);
 	}
 }
 
+/* minishell script: the whole file is parsed, then run */
+static void	run_script(char *path)
+{
+	t_buf	buf;
+	int		fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		print_error(path, strerror(errno));
+		g_shell.exit_status = 127;
+		return ;
+	}
+	buf_init(&buf, 4096);
+	read_all(fd, &buf);
+	close(fd);
+	execute_line(buf.data);
+	free(buf.data);
+}
+
+/* $0 and the positional parameters of a script or -c command */
+static void	set_arguments(char **argv)
+{
+	if (!*argv)
+		return ;
+	g_shell.name = *argv;
+	g_shell.top_frame.params = argv + 1;
+	g_shell.top_frame.count = array_length(argv + 1);
+}
+
 int	main(int argc, char **argv, char **envp)
 {
-	(void)argc;
-	(void)argv;
-	
+	/* --client SOCKET command runs command on a --server shell */
+	if (argc > 1 && strcmp(argv[1], "--client") == 0)
+		return (run_client(argv[2], argv + 2 + (argc > 2)));
 	init_shell(envp);
 	
-	printf(" Welcome to the MiniShell \n");
-	
-	shell_loop();
+	/* --dump-bytecode lists the compiled program instead of running it,
+	 * --norc skips ~/.minishellrc, --pipe-size=N sizes pipeline pipes,
+	 * --check-fds reports descriptors leaked into executed commands,
+	 * --server SOCKET serves the command lines of --client */
+	while (argc > 1 && (strcmp(argv[1], "--dump-bytecode") == 0
+			|| strcmp(argv[1], "--norc") == 0
+			|| strcmp(argv[1], "--check-fds") == 0
+			|| strncmp(argv[1], "--pipe-size=", 12) == 0))
+	{
+		if (strcmp(argv[1], "--norc") == 0)
+			g_shell.no_rc = 1;
+		else if (strcmp(argv[1], "--check-fds") == 0)
+			g_shell.check_fds = 1;
+		else if (argv[1][2] == 'p')
+			g_shell.pipe_size = parse_size(argv[1] + 12);
+		else
+			g_shell.dump_bytecode = 1;
+		if (g_shell.pipe_size < 0)
+		{
+			print_error(argv[1], "invalid size");
+			return (2);
+		}
+		argv++;
+		argc--;
+	}
+	if (!g_shell.no_rc && !g_shell.dump_bytecode)
+		load_rc_file();
+	if (argc > 1 && strcmp(argv[1], "--server") == 0)
+	{
+		if (argc > 2)
+			g_shell.exit_status = run_server(argv[2]);
+		else
+		{
+			print_error("--server", "option requires an argument");
+			g_shell.exit_status = 2;
+		}
+	}
+	else if (argc > 1 && strcmp(argv[1], "-c") == 0)
+	{
+		if (argc > 2)
+		{
+			set_arguments(argv + 3);
+			execute_line(argv[2]);
+		}
+		else
+		{
+			print_error("-c", "option requires an argument");
+			g_shell.exit_status = 2;
+		}
+	}
+	else if (argc > 1)
+	{
+		set_arguments(argv + 1);
+		run_script(argv[1]);
+	}
+	else
+	{
+		printf(" Welcome to the MiniShell \n");
+		if (isatty(STDIN_FILENO))
+			g_shell.interactive = getpid();
+		load_history();
+		setup_completion();
+		shell_loop();
+	}
 	
 	cleanup_shell();
 	return (g_shell.exit_status);
-}
\ No newline at end of file
+}
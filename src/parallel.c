@@ -0,0 +1,403 @@
+#include "../include/minishell.h"
+
+/*
+ * parallel [-j N] command [args] [::: item...] runs command once per item,
+ * taken from the words after ::: or else from the lines of standard input,
+ * with at most N jobs running at a time, one per online CPU by default. {}
+ * in the words stands for the item, which is appended when none has it.
+ * Jobs are forked straight from the shell and run as a pipeline stage
+ * would, so functions and builtins work as well as commands. Each job's
+ * output and errors are kept in buffers of its own and written out whole,
+ * in the order of the items. PARALLEL_STATUS gets the status of every job
+ * and parallel's own is the number of jobs that failed, at most 101.
+ */
+
+# define PARALLEL_BLOCK 65536
+# define FAILED_MAX 101
+# define JOBS_MAX 4096
+
+/* A job's output, its errors and its pidfd are polled; -1 once done */
+# define JOB_OUT 0
+# define JOB_ERR 1
+# define JOB_PID 2
+
+typedef struct s_job
+{
+	pid_t				pid;
+	int					fds[3];
+	t_buf				out[2];
+	int					status;
+	int					reaped;
+}	t_job;
+
+typedef struct s_parallel
+{
+	char				**command;
+	t_argv				items;
+	int					from_stdin;
+	int					reading;
+	t_buf				input;
+	t_job				*jobs;
+	int					cap;
+	int					started;
+	int					printed;
+	int					running;
+	int					slots;
+	int					failed;
+	t_array				*statuses;
+	struct pollfd		*polls;
+}	t_parallel;
+
+/* The words of the job for item: {} replaced, or item appended */
+static char	**job_args(char **command, char *item)
+{
+	t_argv	args;
+	t_buf	word;
+	char	*word_start;
+	char	*at;
+	int		replaced;
+
+	argv_init(&args, array_length(command) + 2);
+	replaced = 0;
+	while (*command)
+	{
+		buf_init(&word, strlen(*command) + 1);
+		word_start = *command++;
+		while ((at = strstr(word_start, "{}")))
+		{
+			buf_add(&word, word_start, at - word_start);
+			buf_add_str(&word, item);
+			word_start = at + 2;
+			replaced = 1;
+		}
+		buf_add_str(&word, word_start);
+		argv_push(&args, word.data);
+	}
+	if (!replaced)
+		argv_push(&args, safe_strdup(item));
+	return (args.items);
+}
+
+/* In the job's child; items read from stdin leave it /dev/null */
+static void	run_job(t_parallel *p, char *item, int out[2], int err[2])
+{
+	t_cmd	cmd;
+	int		fd;
+
+	if (p->from_stdin)
+	{
+		fd = open("/dev/null", O_RDONLY);
+		dup2(fd, STDIN_FILENO);
+		close(fd);
+	}
+	dup2(out[1], STDOUT_FILENO);
+	dup2(err[1], STDERR_FILENO);
+	dup3(STDIN_FILENO, g_shell.stdin_backup, O_CLOEXEC);
+	dup3(STDOUT_FILENO, g_shell.stdout_backup, O_CLOEXEC);
+	memset(&cmd, 0, sizeof(t_cmd));
+	cmd.args = job_args(p->command, item);
+	exit(exec_command(&cmd));
+}
+
+static t_job	*next_job(t_parallel *p)
+{
+	t_job	*job;
+	t_job	*bigger;
+
+	if (p->started == p->cap)
+	{
+		p->cap = p->cap ? p->cap * 2 : 16;
+		bigger = safe_malloc(sizeof(t_job) * p->cap);
+		if (p->started)
+			memcpy(bigger, p->jobs, sizeof(t_job) * p->started);
+		free(p->jobs);
+		p->jobs = bigger;
+	}
+	job = &p->jobs[p->started];
+	memset(job, 0, sizeof(t_job));
+	job->fds[JOB_OUT] = -1;
+	job->fds[JOB_ERR] = -1;
+	job->fds[JOB_PID] = -1;
+	job->status = 1;
+	job->reaped = 1;
+	buf_init(&job->out[JOB_OUT], 256);
+	buf_init(&job->out[JOB_ERR], 256);
+	return (job);
+}
+
+/* Forks the job of the next item; a job that can't start failed with 1 */
+static void	start_job(t_parallel *p)
+{
+	t_job	*job;
+	int		out[2];
+	int		err[2];
+
+	job = next_job(p);
+	out[0] = -1;
+	if (pipe2(out, O_CLOEXEC) == -1 || pipe2(err, O_CLOEXEC) == -1)
+	{
+		print_error("parallel", strerror(errno));
+		if (out[0] != -1)
+		{
+			close(out[0]);
+			close(out[1]);
+		}
+		p->started++;
+		return ;
+	}
+	fflush(stdout);
+	job->pid = fork();
+	if (job->pid == 0)
+		run_job(p, p->items.items[p->started], out, err);
+	close(out[1]);
+	close(err[1]);
+	p->started++;
+	if (job->pid == -1)
+	{
+		print_error("fork", strerror(errno));
+		close(out[0]);
+		close(err[0]);
+		return ;
+	}
+	job->fds[JOB_OUT] = shell_fd(out[0], 0);
+	job->fds[JOB_ERR] = shell_fd(err[0], 0);
+	job->fds[JOB_PID] = open_pidfd(job->pid);
+	job->reaped = 0;
+	p->running++;
+}
+
+static void	queue_line(t_parallel *p, char *line, size_t len)
+{
+	char	*item;
+
+	item = safe_malloc(len + 1);
+	memcpy(item, line, len);
+	item[len] = '\0';
+	argv_push(&p->items, item);
+}
+
+/* Queues the complete lines read from stdin; at its end, the rest too */
+static void	read_items(t_parallel *p)
+{
+	char	*end;
+	size_t	start;
+	ssize_t	n;
+
+	buf_reserve(&p->input, PARALLEL_BLOCK);
+	n = read(STDIN_FILENO, p->input.data + p->input.len, PARALLEL_BLOCK);
+	if (n == -1 && errno == EINTR)
+		return ;
+	if (n > 0)
+		p->input.len += n;
+	start = 0;
+	while ((end = memchr(p->input.data + start, '\n', p->input.len - start)))
+	{
+		queue_line(p, p->input.data + start, end - p->input.data - start);
+		start = end - p->input.data + 1;
+	}
+	p->input.len -= start;
+	memmove(p->input.data, p->input.data + start, p->input.len);
+	if (n > 0)
+		return ;
+	if (n == -1)
+		print_error("parallel", strerror(errno));
+	if (p->input.len > 0)
+		queue_line(p, p->input.data, p->input.len);
+	p->reading = 0;
+}
+
+/*
+ * Descriptor i of the job is ready: output is collected, an exit reaped.
+ * The job is over once both pipes are closed and it has been reaped.
+ */
+static void	job_event(t_parallel *p, t_job *job, int i)
+{
+	ssize_t	n;
+
+	if (i == JOB_PID)
+		job->reaped = reap_child(job->pid, &job->status);
+	else
+	{
+		buf_reserve(&job->out[i], PARALLEL_BLOCK);
+		n = read(job->fds[i], job->out[i].data + job->out[i].len,
+				PARALLEL_BLOCK);
+		if (n > 0)
+			job->out[i].len += n;
+		if (n > 0 || (n == -1 && errno == EINTR))
+			return ;
+	}
+	close(job->fds[i]);
+	job->fds[i] = -1;
+	if (job->fds[JOB_OUT] != -1 || job->fds[JOB_ERR] != -1
+		|| job->fds[JOB_PID] != -1)
+		return ;
+	if (!job->reaped)
+		job->status = wait_children(&job->pid, 1);
+	job->reaped = 1;
+	p->running--;
+}
+
+static void	signal_jobs(t_parallel *p, int sig)
+{
+	int	i;
+
+	i = p->printed - 1;
+	while (++i < p->started)
+		if (!p->jobs[i].reaped)
+			kill(p->jobs[i].pid, sig);
+}
+
+static void	add_poll(t_parallel *p, int *n, int fd)
+{
+	p->polls[*n].fd = fd;
+	p->polls[*n].events = POLLIN;
+	p->polls[(*n)++].revents = 0;
+}
+
+/* One poll() over stdin, while more items are wanted, and the running
+ * jobs; a timeout running out on the way signals the jobs */
+static void	wait_events(t_parallel *p, long long *sent)
+{
+	int	n;
+	int	i;
+	int	j;
+	int	input;
+
+	input = p->reading && p->items.count - p->started < p->slots - p->running;
+	n = 0;
+	if (input)
+		add_poll(p, &n, STDIN_FILENO);
+	i = p->printed - 1;
+	while (++i < p->started)
+	{
+		j = -1;
+		while (++j < 3)
+			if (p->jobs[i].fds[j] != -1)
+				add_poll(p, &n, p->jobs[i].fds[j]);
+	}
+	n = poll(p->polls, n, time_left(*sent));
+	if (n == 0)
+		signal_jobs(p, expired_signal(sent));
+	if (n <= 0)
+		return ;
+	n = 0;
+	if (input && p->polls[n++].revents)
+		read_items(p);
+	i = p->printed - 1;
+	while (++i < p->started)
+	{
+		j = -1;
+		while (++j < 3)
+			if (p->jobs[i].fds[j] != -1 && p->polls[n++].revents)
+				job_event(p, &p->jobs[i], j);
+	}
+}
+
+static int	job_done(t_job *job)
+{
+	return (job->reaped && job->fds[JOB_OUT] == -1
+		&& job->fds[JOB_ERR] == -1 && job->fds[JOB_PID] == -1);
+}
+
+/* Writes out the finished jobs whose turn has come */
+static void	print_jobs(t_parallel *p)
+{
+	t_job	*job;
+	char	status[16];
+
+	while (p->printed < p->started && job_done(&p->jobs[p->printed]))
+	{
+		job = &p->jobs[p->printed++];
+		write_all(STDOUT_FILENO, job->out[JOB_OUT].data,
+			job->out[JOB_OUT].len);
+		write_all(STDERR_FILENO, job->out[JOB_ERR].data,
+			job->out[JOB_ERR].len);
+		free(job->out[JOB_OUT].data);
+		free(job->out[JOB_ERR].data);
+		sprintf(status, "%d", job->status);
+		array_push(p->statuses, safe_strdup(status));
+		p->failed += (job->status != 0);
+	}
+}
+
+/* -j N, then the command words up to :::, whose items follow it */
+static int	parse_parallel(t_parallel *p, char **args)
+{
+	char	*value;
+	char	*end;
+	long	slots;
+	int		i;
+
+	p->slots = sysconf(_SC_NPROCESSORS_ONLN);
+	while (*++args && (*args)[0] == '-' && (*args)[1])
+	{
+		if (strcmp(*args, "--") == 0 && ++args)
+			break ;
+		i = 1;
+		if ((*args)[1] != 'j' || !(value = option_value(&args, &i)))
+			return (0);
+		slots = strtol(value, &end, 10);
+		if (end == value || *end || slots < 1 || slots > JOBS_MAX)
+			return (0);
+		p->slots = slots;
+	}
+	if (p->slots < 1)
+		p->slots = 1;
+	i = 0;
+	while (args[i] && strcmp(args[i], ":::") != 0)
+		i++;
+	if (i == 0)
+		return (0);
+	p->command = safe_malloc(sizeof(char *) * (i + 1));
+	memcpy(p->command, args, sizeof(char *) * i);
+	p->command[i] = NULL;
+	argv_init(&p->items, 16);
+	p->from_stdin = !args[i];
+	p->reading = p->from_stdin;
+	while (args[i] && args[++i])
+		argv_push(&p->items, safe_strdup(args[i]));
+	return (1);
+}
+
+/* No more jobs start after an interrupt or once a timeout ran out */
+static int	stopped(void)
+{
+	return (g_shell.interrupted || g_shell.timeout.expired);
+}
+
+int	builtin_parallel(char **args)
+{
+	t_parallel	p;
+	long long	sent;
+
+	memset(&p, 0, sizeof(t_parallel));
+	if (!parse_parallel(&p, args))
+	{
+		free(p.command);
+		print_error("parallel", "usage: parallel [-j jobs] command [args] "
+			"[::: item...]");
+		return (2);
+	}
+	p.statuses = make_array("PARALLEL_STATUS", 0);
+	clear_array(p.statuses);
+	buf_init(&p.input, PARALLEL_BLOCK + 1);
+	p.polls = safe_malloc(sizeof(struct pollfd) * (p.slots * 3 + 1));
+	sent = 0;
+	while (p.running > 0 || (!stopped()
+			&& (p.reading || p.started < p.items.count)))
+	{
+		while (!stopped() && p.running < p.slots
+			&& p.started < p.items.count)
+			start_job(&p);
+		print_jobs(&p);
+		if (p.running > 0 || (p.reading && !stopped()))
+			wait_events(&p, &sent);
+	}
+	print_jobs(&p);
+	free_string_array(p.items.items);
+	free(p.command);
+	free(p.input.data);
+	free(p.jobs);
+	free(p.polls);
+	return (p.failed > FAILED_MAX ? FAILED_MAX : p.failed);
+}
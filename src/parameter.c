@@ -0,0 +1,343 @@
+#include "../include/minishell.h"
+
+static char	*bad_substitution(char *body)
+{
+	t_buf	msg;
+
+	buf_init(&msg, strlen(body) + 4);
+	buf_add_str(&msg, "${");
+	buf_add_str(&msg, body);
+	buf_add_char(&msg, '}');
+	print_error(msg.data, "bad substitution");
+	free(msg.data);
+	expansion_error();
+	return (safe_strdup(""));
+}
+
+static int	name_length(char *body)
+{
+	int	len;
+
+	if (body[0] && strchr("?#@*", body[0]))
+		return (1);
+	if (isdigit(body[0]))
+	{
+		len = 1;
+		while (isdigit(body[len]))
+			len++;
+		return (len);
+	}
+	if (!isalpha(body[0]) && body[0] != '_')
+		return (0);
+	len = 1;
+	while (isalnum(body[len]) || body[len] == '_')
+		len++;
+	return (len);
+}
+
+static int	is_default_op(char *op)
+{
+	char	c;
+
+	c = (op[0] == ':') ? op[1] : op[0];
+	return (c && strchr("-=+?", c));
+}
+
+/* ${VAR:-word} ${VAR:=word} ${VAR:+word} ${VAR:?word}, colon optional */
+static char	*apply_default(char *name, char *value, char *op)
+{
+	char	*word;
+	int		colon;
+	int		unset;
+
+	colon = (*op == ':');
+	word = expand_variables(op + colon + 1);
+	unset = (!value || (colon && !*value));
+	if (op[colon] == '+')
+	{
+		free(value);
+		if (!unset)
+			return (word);
+		free(word);
+		return (safe_strdup(""));
+	}
+	if (!unset)
+	{
+		free(word);
+		return (value);
+	}
+	free(value);
+	if (op[colon] == '=')
+		set_shell_value(name, word);
+	else if (op[colon] == '?')
+	{
+		print_error(name, *word ? word : "parameter null or not set");
+		expansion_error();
+		free(word);
+		return (safe_strdup(""));
+	}
+	return (word);
+}
+
+/* ${VAR:offset} and ${VAR:offset:length}, both arithmetic expressions */
+static char	*apply_substring(char *value, char *op)
+{
+	char		*sep;
+	char		*result;
+	long long	len;
+	long long	off;
+	long long	size;
+
+	size = strlen(value);
+	sep = strchr(op + 1, ':');
+	if (sep)
+		*sep = '\0';
+	if (!evaluate_arithmetic(op + 1, &off)
+		|| (sep && !evaluate_arithmetic(sep + 1, &len)))
+	{
+		expansion_error();
+		free(value);
+		return (safe_strdup(""));
+	}
+	if (!sep)
+		len = size;
+	if (off < 0)
+		off = (size + off < 0) ? 0 : size + off;
+	if (off > size)
+		off = size;
+	if (len < 0)
+		len = (size + len < off) ? 0 : size + len - off;
+	if (len > size - off)
+		len = size - off;
+	result = safe_malloc(len + 1);
+	memcpy(result, value + off, len);
+	result[len] = '\0';
+	free(value);
+	return (result);
+}
+
+/* Whether the first len characters of str match pattern */
+static int	match_prefix(char *str, int len, char *pattern)
+{
+	char	saved;
+	int		matched;
+
+	saved = str[len];
+	str[len] = '\0';
+	matched = match_pattern(str, pattern);
+	str[len] = saved;
+	return (matched);
+}
+
+/* ${VAR#pat} ${VAR##pat} ${VAR%pat} ${VAR%%pat} */
+static char	*apply_trim(char *value, char *op)
+{
+	char	*pattern;
+	int		longest;
+	int		size;
+	int		cut;
+	int		k;
+
+	longest = (op[1] == op[0]);
+	pattern = expand_variables(op + 1 + longest);
+	size = strlen(value);
+	k = 0;
+	while (k <= size)
+	{
+		/* Shortest match tries lengths upwards, longest downwards */
+		cut = longest ? size - k : k;
+		if (op[0] == '#' && match_prefix(value, cut, pattern))
+		{
+			memmove(value, value + cut, size - cut + 1);
+			break ;
+		}
+		if (op[0] == '%' && match_pattern(value + size - cut, pattern))
+		{
+			value[size - cut] = '\0';
+			break ;
+		}
+		k++;
+	}
+	free(pattern);
+	return (value);
+}
+
+/* Length of the longest match of pattern at the start of str, or -1 */
+static int	match_at(char *str, char *pattern, int anchor_end)
+{
+	int	len;
+
+	len = strlen(str);
+	while (len >= 0)
+	{
+		if (match_prefix(str, len, pattern))
+			return (len);
+		if (anchor_end)
+			return (-1);
+		len--;
+	}
+	return (-1);
+}
+
+/* First unescaped / in str, the pattern may contain \/ */
+static char	*find_separator(char *str)
+{
+	while (*str && *str != '/')
+	{
+		if (*str == '\\' && str[1])
+			str++;
+		str++;
+	}
+	return (*str ? str : NULL);
+}
+
+/* ${VAR/pat/rep} ${VAR//pat/rep} ${VAR/#pat/rep} ${VAR/%pat/rep} */
+static char	*apply_replace(char *value, char *op)
+{
+	t_buf	result;
+	char	*sep;
+	char	*pattern;
+	char	*rep;
+	char	mode;
+	int		i;
+	int		len;
+
+	mode = (op[1] == '/' || op[1] == '#' || op[1] == '%') ? op[1] : 0;
+	sep = find_separator(op + 1 + (mode != 0));
+	if (sep)
+		*sep = '\0';
+	pattern = expand_variables(op + 1 + (mode != 0));
+	rep = expand_variables(sep ? sep + 1 : "");
+	buf_init(&result, strlen(value) + 1);
+	i = 0;
+	while (*pattern && value[i])
+	{
+		len = match_at(value + i, pattern, mode == '%');
+		if (len > 0)
+		{
+			buf_add_str(&result, rep);
+			i += len;
+			if (mode != '/')
+				break ;
+			continue ;
+		}
+		if (mode == '#')
+			break ;
+		buf_add_char(&result, value[i++]);
+	}
+	buf_add_str(&result, value + i);
+	free(pattern);
+	free(rep);
+	free(value);
+	return (result.data);
+}
+
+static char	*value_length(char *value)
+{
+	char	*length;
+
+	length = safe_malloc(12);
+	sprintf(length, "%d", value ? (int)strlen(value) : 0);
+	free(value);
+	return (length);
+}
+
+/* op is copied first: substring and replacement cut it up, and it may be
+ * program text in a read-only mapping */
+static char	*apply_operator(char *body, char *value, char *op)
+{
+	char	*result;
+
+	if (!value)
+		value = safe_strdup("");
+	op = safe_strdup(op);
+	if (op[0] == ':')
+		result = apply_substring(value, op);
+	else if (op[0] == '#' || op[0] == '%')
+		result = apply_trim(value, op);
+	else if (op[0] == '/')
+		result = apply_replace(value, op);
+	else
+	{
+		free(value);
+		result = bad_substitution(body);
+	}
+	free(op);
+	return (result);
+}
+
+/* ${name[subscript]...}: the element, op moved past the bracket */
+static char	*subscript_value(char *name, char **op, int length)
+{
+	char	*subscript;
+	char	*value;
+	int		close;
+
+	close = skip_brackets(*op, 0);
+	subscript = safe_malloc(close);
+	memcpy(subscript, *op + 1, close - 1);
+	subscript[close - 1] = '\0';
+	value = array_value(name, subscript, length);
+	free(subscript);
+	*op += close + 1;
+	return (value);
+}
+
+/*
+ * Expands the body of ${...}: plain references, array elements, ${#VAR},
+ * defaults, substrings, prefix/suffix removal and replacement. Patterns
+ * go through the same glob matcher as wildcards. Returns a malloc'd
+ * string.
+ */
+char	*expand_parameter(char *body)
+{
+	char	*name;
+	char	*value;
+	char	*op;
+	int		length;
+	int		subscripted;
+	int		len;
+
+	/* ${!a[@]}, the only ${!...} there is */
+	if (body[0] == '!')
+	{
+		value = array_keys(body);
+		return (value ? value : bad_substitution(body));
+	}
+	length = (body[0] == '#' && body[1]);
+	len = name_length(body + length);
+	if (len == 0)
+		return (bad_substitution(body));
+	name = safe_malloc(len + 1);
+	strncpy(name, body + length, len);
+	name[len] = '\0';
+	op = body + length + len;
+	/* ${a[@]:offset:length} slices the elements, not their joined text */
+	if (!length && op[0] == '[' && (op[1] == '@' || op[1] == '*')
+		&& op[2] == ']' && op[3] == ':' && !is_default_op(op + 3))
+	{
+		op = safe_strdup(op + 4);
+		value = array_slice(name, op);
+		free(op);
+		free(name);
+		return (value);
+	}
+	subscripted = (*op == '[' && skip_brackets(op, 0) > 0);
+	if (subscripted)
+		value = subscript_value(name, &op, length);
+	else
+		value = variable_value(name);
+	if (length && *op)
+	{
+		free(value);
+		value = bad_substitution(body);
+	}
+	else if (length && !subscripted)
+		value = value_length(value);
+	else if (is_default_op(op))
+		value = apply_default(name, value, op);
+	else if (*op)
+		value = apply_operator(body, value, op);
+	free(name);
+	return (value ? value : safe_strdup(""));
+}
@@ -5,16 +5,102 @@ t_cmd	*create_cmd(void)
 	t_cmd	*cmd;
 
 	cmd = safe_malloc(sizeof(t_cmd));
+	cmd->words = NULL;
 	cmd->args = NULL;
-	cmd->input_file = NULL;
-	cmd->output_file = NULL;
-	cmd->append_output = 0;
-	cmd->heredoc = 0;
-	cmd->heredoc_delimiter = NULL;
+	cmd->assignments = NULL;
+	cmd->assigns = NULL;
+	cmd->substituted = 0;
+	cmd->redirs = NULL;
+	cmd->procsubs = NULL;
+	cmd->arith = NULL;
+	cmd->node = NULL;
 	cmd->next = NULL;
 	return (cmd);
 }
 
+t_node	*create_node(t_node_type type)
+{
+	t_node	*node;
+
+	node = safe_malloc(sizeof(t_node));
+	node->type = type;
+	node->negate = 0;
+	node->pipeline = NULL;
+	node->left = NULL;
+	node->right = NULL;
+	node->extra = NULL;
+	node->var = NULL;
+	node->words = NULL;
+	node->items = NULL;
+	return (node);
+}
+
+void	free_node(t_node *node)
+{
+	t_case_item	*next;
+
+	if (!node)
+		return ;
+	free_cmds(node->pipeline);
+	free_node(node->left);
+	free_node(node->right);
+	free_node(node->extra);
+	free(node->var);
+	free_words(node->words);
+	while (node->items)
+	{
+		next = node->items->next;
+		free_words(node->items->patterns);
+		free_node(node->items->body);
+		free(node->items);
+		node->items = next;
+	}
+	free(node);
+}
+
+t_redir	*create_redir(t_redir_type type, int fd, t_word *word)
+{
+	t_redir	*redir;
+
+	redir = safe_malloc(sizeof(t_redir));
+	redir->type = type;
+	redir->fd = fd;
+	redir->word = word;
+	redir->target = NULL;
+	redir->opened = -1;
+	redir->next = NULL;
+	return (redir);
+}
+
+static void	add_redir(t_redir **redirs, t_redir *new_redir)
+{
+	t_redir	*current;
+
+	if (!*redirs)
+	{
+		*redirs = new_redir;
+		return ;
+	}
+	current = *redirs;
+	while (current->next)
+		current = current->next;
+	current->next = new_redir;
+}
+
+void	free_redirs(t_redir *redirs)
+{
+	t_redir	*next;
+
+	while (redirs)
+	{
+		next = redirs->next;
+		free_words(redirs->word);
+		free(redirs->target);
+		free(redirs);
+		redirs = next;
+	}
+}
+
 void	add_cmd(t_cmd **cmds, t_cmd *new_cmd)
 {
 	t_cmd	*current;
@@ -33,178 +119,788 @@ void	add_cmd(t_cmd **cmds, t_cmd *new_cmd)
 void	free_cmds(t_cmd *cmds)
 {
 	t_cmd	*next;
-	int		i;
 
 	while (cmds)
 	{
 		next = cmds->next;
-		if (cmds->args)
-		{
-			i = 0;
-			while (cmds->args[i])
-				free(cmds->args[i++]);
-			free(cmds->args);
-		}
-		if (cmds->input_file)
-			free(cmds->input_file);
-		if (cmds->output_file)
-			free(cmds->output_file);
-		if (cmds->heredoc_delimiter)
-			free(cmds->heredoc_delimiter);
+		free_words(cmds->words);
+		free_string_array(cmds->args);
+		free_assigns(cmds->assignments);
+		free_string_array(cmds->assigns);
+		free_redirs(cmds->redirs);
+		free_procsubs(cmds->procsubs);
+		free(cmds->arith);
+		free_node(cmds->node);
 		free(cmds);
 		cmds = next;
 	}
 }
 
-static void	add_arg_to_cmd(t_cmd *cmd, char *arg)
+static void	add_word_to_list(t_word **list, t_word *word)
 {
-	int		count;
-	char	**new_args;
-	char	*expanded_arg;
-	int		i;
+	t_word	**tail;
 
-	/* Expand variables and tilde */
-	expanded_arg = expand_variables(arg);
-	if (expanded_arg)
+	tail = list;
+	while (*tail)
+		tail = &(*tail)->next;
+	*tail = word;
+}
+
+void	free_assigns(t_assign *assigns)
+{
+	t_assign	*next;
+	t_element	*elem;
+	t_element	*next_elem;
+
+	while (assigns)
 	{
-		char *tilde_expanded = expand_tilde(expanded_arg);
-		free(expanded_arg);
-		expanded_arg = tilde_expanded;
+		next = assigns->next;
+		elem = assigns->elements;
+		while (elem)
+		{
+			next_elem = elem->next;
+			free_words(elem->key);
+			free_words(elem->value);
+			free(elem);
+			elem = next_elem;
+		}
+		free_words(assigns->word);
+		free(assigns->name);
+		free(assigns);
+		assigns = next;
 	}
-	else
-		expanded_arg = safe_strdup(arg);
+}
 
-	/* Count existing arguments */
-	count = 0;
-	if (cmd->args)
+/* Length of the NAME an assignment word starts with, 0 if none */
+static int	name_length(char *raw)
+{
+	int	i;
+
+	if (!isalpha(raw[0]) && raw[0] != '_')
+		return (0);
+	i = 1;
+	while (isalnum(raw[i]) || raw[i] == '_')
+		i++;
+	return (i);
+}
+
+/* NAME=value, NAME+=value and NAME[key]=value before the command name are
+ * assignments, not arguments */
+static int	is_assignment(t_cmd *cmd, char *raw)
+{
+	int	i;
+
+	i = name_length(raw);
+	if (cmd->words || i == 0)
+		return (0);
+	if (raw[i] == '[')
 	{
-		while (cmd->args[count])
-			count++;
+		i = skip_brackets(raw, i);
+		if (i == -1)
+			return (0);
+		i++;
 	}
-	
-	/* Allocate new array */
-	new_args = safe_malloc(sizeof(char *) * (count + 2));
-	
-	/* Copy existing arguments */
-	i = 0;
-	if (cmd->args)
+	if (raw[i] == '+')
+		i++;
+	return (raw[i] == '=');
+}
+
+/* [key]=value or [key]+=value, where raw[end] is the closing bracket */
+static t_element	*keyed_element(char *raw, int end)
+{
+	t_element	*elem;
+	char		*key;
+
+	elem = safe_malloc(sizeof(t_element));
+	key = safe_malloc(end);
+	memcpy(key, raw + 1, end - 1);
+	key[end - 1] = '\0';
+	elem->key = compile_word(key);
+	free(key);
+	elem->append = (raw[end + 1] == '+');
+	elem->value = compile_word(raw + end + 2 + elem->append);
+	elem->next = NULL;
+	return (elem);
+}
+
+static t_element	*list_element(char *raw)
+{
+	t_element	*elem;
+	int			end;
+
+	end = (raw[0] == '[') ? skip_brackets(raw, 0) : -1;
+	if (end > 0 && (raw[end + 1] == '='
+			|| (raw[end + 1] == '+' && raw[end + 2] == '=')))
+		return (keyed_element(raw, end));
+	elem = safe_malloc(sizeof(t_element));
+	elem->key = NULL;
+	elem->value = compile_word(raw);
+	elem->append = 0;
+	elem->next = NULL;
+	return (elem);
+}
+
+/* The words between the parentheses of a=(...), lexed like a command */
+static int	parse_elements(t_assign *assign, char *list)
+{
+	t_token		*tokens;
+	t_token		*token;
+	t_element	**tail;
+	int			ok;
+
+	tokens = lexer(list);
+	if (!tokens)
+		return (0);
+	tail = &assign->elements;
+	ok = 1;
+	token = tokens;
+	while (ok && token->type != TOKEN_EOF)
 	{
-		while (i < count)
+		if (token->type == TOKEN_WORD)
 		{
-			new_args[i] = cmd->args[i];
-			i++;
+			*tail = list_element(token->value);
+			tail = &(*tail)->next;
 		}
-		free(cmd->args);
+		else if (token->type != TOKEN_NEWLINE)
+			ok = syntax_error(token->value);
+		token = token->next;
 	}
-	
-	/* Add new argument */
-	new_args[count] = expanded_arg;
-	new_args[count + 1] = NULL;
-	cmd->args = new_args;
+	free_tokens(tokens);
+	return (ok);
 }
 
-int	parse_redirections(t_token **tokens, t_cmd *cmd)
+/* a=(...) and a+=(...); raw[open] is the opening parenthesis */
+static int	parse_array_list(t_assign *assign, char *raw, int open)
 {
-	t_token	*current;
+	char	*list;
+	int		close;
+	int		ok;
 
-	current = *tokens;
-	
-	if (current->type == TOKEN_REDIRECT_IN)
+	close = skip_parens(raw, open);
+	if (close == -1 || raw[close + 1])
+		return (syntax_error(raw));
+	list = safe_malloc(close - open);
+	memcpy(list, raw + open + 1, close - open - 1);
+	list[close - open - 1] = '\0';
+	ok = parse_elements(assign, list);
+	free(list);
+	return (ok);
+}
+
+/* Compiles an assignment word into a t_assign appended to the command */
+static int	add_assignment(t_cmd *cmd, char *raw)
+{
+	t_assign	*assign;
+	t_assign	**tail;
+	int			len;
+	int			ok;
+
+	assign = safe_malloc(sizeof(t_assign));
+	memset(assign, 0, sizeof(t_assign));
+	len = name_length(raw);
+	ok = 1;
+	if (raw[len] == '[' || raw[len + (raw[len] == '+') + 1] == '(')
 	{
-		*tokens = current->next;
-		if (!*tokens || (*tokens)->type != TOKEN_WORD)
-			return (syntax_error("newline"));
-		cmd->input_file = safe_strdup((*tokens)->value);
-		*tokens = (*tokens)->next;
+		assign->name = safe_malloc(len + 1);
+		memcpy(assign->name, raw, len);
+		assign->name[len] = '\0';
 	}
-	else if (current->type == TOKEN_REDIRECT_OUT)
+	/* a[key]=value only sets one element of the array */
+	if (raw[len] == '[')
 	{
-		*tokens = current->next;
-		if (!*tokens || (*tokens)->type != TOKEN_WORD)
-			return (syntax_error("newline"));
-		cmd->output_file = safe_strdup((*tokens)->value);
-		cmd->append_output = 0;
-		*tokens = (*tokens)->next;
+		assign->append = 1;
+		assign->elements = keyed_element(raw + len, skip_brackets(raw, len)
+				- len);
 	}
-	else if (current->type == TOKEN_REDIRECT_APPEND)
+	else if (assign->name)
 	{
-		*tokens = current->next;
-		if (!*tokens || (*tokens)->type != TOKEN_WORD)
-			return (syntax_error("newline"));
-		cmd->output_file = safe_strdup((*tokens)->value);
-		cmd->append_output = 1;
-		*tokens = (*tokens)->next;
+		assign->append = (raw[len] == '+');
+		ok = parse_array_list(assign, raw, len + assign->append + 1);
 	}
-	else if (current->type == TOKEN_REDIRECT_HEREDOC)
+	else
+		assign->word = compile_assignment(raw);
+	tail = &cmd->assignments;
+	while (*tail)
+		tail = &(*tail)->next;
+	*tail = assign;
+	return (ok);
+}
+
+static int	is_redirection(t_token *token)
+{
+	return (token->type == TOKEN_REDIRECT_IN ||
+			token->type == TOKEN_REDIRECT_OUT ||
+			token->type == TOKEN_REDIRECT_APPEND ||
+			token->type == TOKEN_REDIRECT_HEREDOC ||
+			token->type == TOKEN_DUP_IN ||
+			token->type == TOKEN_DUP_OUT);
+}
+
+static t_redir_type	get_redir_type(t_token_type type, int *default_fd)
+{
+	*default_fd = STDOUT_FILENO;
+	if (type == TOKEN_REDIRECT_OUT)
+		return (REDIR_OUT);
+	if (type == TOKEN_REDIRECT_APPEND)
+		return (REDIR_APPEND);
+	if (type == TOKEN_DUP_OUT)
+		return (REDIR_DUP_OUT);
+	*default_fd = STDIN_FILENO;
+	if (type == TOKEN_REDIRECT_HEREDOC)
+		return (REDIR_HEREDOC);
+	if (type == TOKEN_DUP_IN)
+		return (REDIR_DUP_IN);
+	return (REDIR_IN);
+}
+
+int	parse_redirections(t_token **tokens, t_cmd *cmd)
+{
+	t_redir			*redir;
+	t_redir_type	type;
+	int				fd;
+	int				default_fd;
+
+	fd = -1;
+	if ((*tokens)->type == TOKEN_IO_NUMBER)
 	{
-		*tokens = current->next;
-		if (!*tokens || (*tokens)->type != TOKEN_WORD)
-			return (syntax_error("newline"));
-		cmd->heredoc = 1;
-		cmd->heredoc_delimiter = safe_strdup((*tokens)->value);
+		/* Anything longer can't be a valid descriptor anyway */
+		if (strlen((*tokens)->value) > 9)
+			return (syntax_error((*tokens)->value));
+		fd = atoi((*tokens)->value);
 		*tokens = (*tokens)->next;
 	}
+	if (!*tokens || !is_redirection(*tokens))
+		return (syntax_error(*tokens ? (*tokens)->value : NULL));
+	
+	type = get_redir_type((*tokens)->type, &default_fd);
+	if (fd == -1)
+		fd = default_fd;
+	
+	*tokens = (*tokens)->next;
+	/* < <(cmd) reads from the substitution like from a file */
+	if (*tokens && (type == REDIR_IN || type == REDIR_OUT
+			|| type == REDIR_APPEND)
+		&& ((*tokens)->type == TOKEN_PROCSUB_IN
+			|| (*tokens)->type == TOKEN_PROCSUB_OUT))
+		redir = create_redir(type, fd, compile_procsub(*tokens));
+	else if (!*tokens || (*tokens)->type != TOKEN_WORD)
+		return (syntax_error("newline"));
+	else if (type == REDIR_HEREDOC)
+	{
+		/* The lexer read the body; a missing one needs more lines */
+		if (!(*tokens)->heredoc)
+		{
+			g_shell.incomplete = 1;
+			return (0);
+		}
+		redir = create_redir(type, fd, compile_heredoc((*tokens)->heredoc,
+					strpbrk((*tokens)->value, "'\"\\") != NULL));
+	}
+	else
+		redir = create_redir(type, fd, compile_word((*tokens)->value));
+	add_redir(&cmd->redirs, redir);
+	*tokens = (*tokens)->next;
 	return (1);
 }
 
 int	parse_command(t_token **tokens, t_cmd *cmd)
 {
-	while (*tokens && (*tokens)->type != TOKEN_PIPE && 
-		   (*tokens)->type != TOKEN_EOF)
+	/* Stops at the first operator that isn't part of a simple command */
+	while (*tokens)
 	{
-		if ((*tokens)->type == TOKEN_WORD)
+		if ((*tokens)->type == TOKEN_WORD
+			&& is_assignment(cmd, (*tokens)->value))
+		{
+			if (!add_assignment(cmd, (*tokens)->value))
+				return (0);
+			*tokens = (*tokens)->next;
+		}
+		else if ((*tokens)->type == TOKEN_WORD)
 		{
-			add_arg_to_cmd(cmd, (*tokens)->value);
+			add_word_to_list(&cmd->words, compile_word((*tokens)->value));
 			*tokens = (*tokens)->next;
 		}
-		else if ((*tokens)->type == TOKEN_REDIRECT_IN ||
-				 (*tokens)->type == TOKEN_REDIRECT_OUT ||
-				 (*tokens)->type == TOKEN_REDIRECT_APPEND ||
-				 (*tokens)->type == TOKEN_REDIRECT_HEREDOC)
+		else if ((*tokens)->type == TOKEN_ARITH && !cmd->words && !cmd->arith
+			&& !cmd->assignments)
+		{
+			cmd->arith = safe_strdup((*tokens)->value);
+			*tokens = (*tokens)->next;
+			if ((*tokens)->type == TOKEN_WORD)
+				return (syntax_error((*tokens)->value));
+		}
+		else if ((*tokens)->type == TOKEN_PROCSUB_IN ||
+				 (*tokens)->type == TOKEN_PROCSUB_OUT)
+		{
+			add_word_to_list(&cmd->words, compile_procsub(*tokens));
+			*tokens = (*tokens)->next;
+		}
+		else if ((*tokens)->type == TOKEN_IO_NUMBER ||
+				 is_redirection(*tokens))
 		{
 			if (!parse_redirections(tokens, cmd))
 				return (0);
 		}
 		else
+			break ;
+	}
+	return (1);
+}
+
+/* Reserved words only count unquoted and in command position */
+static int	is_keyword(t_token *token, char *word)
+{
+	return (token->type == TOKEN_WORD && strcmp(token->value, word) == 0);
+}
+
+/* Reports an unexpected token; at the end of interactive input the
+ * construct is merely incomplete and the caller reads another line */
+static void	*parse_error(t_token *token)
+{
+	if (token->type == TOKEN_EOF && g_shell.continuation)
+		g_shell.incomplete = 1;
+	else
+		syntax_error(token->value);
+	return (NULL);
+}
+
+static int	expect(t_token **tokens, char *word)
+{
+	if (!is_keyword(*tokens, word))
+	{
+		parse_error(*tokens);
+		return (0);
+	}
+	*tokens = (*tokens)->next;
+	return (1);
+}
+
+static void	skip_newlines(t_token **tokens)
+{
+	while ((*tokens)->type == TOKEN_NEWLINE)
+		*tokens = (*tokens)->next;
+}
+
+/* Tokens that close the list being parsed */
+static int	is_list_end(t_token *token)
+{
+	static char	*closers[] = {"then", "elif", "else", "fi", "do", "done",
+		"esac", "}", NULL};
+	int			i;
+
+	if (token->type == TOKEN_EOF || token->type == TOKEN_RPAREN
+		|| token->type == TOKEN_DSEMI)
+		return (1);
+	i = 0;
+	while (closers[i])
+		if (is_keyword(token, closers[i++]))
+			return (1);
+	return (0);
+}
+
+static t_node	*parse_and_or(t_token **tokens);
+static t_cmd	*parse_stage(t_token **tokens);
+static int		is_compound(t_token *token);
+
+/* and_or lists separated by ; or newlines, up to a closing token */
+static int	parse_list(t_token **tokens, t_node **list)
+{
+	t_node	*item;
+	t_node	*seq;
+
+	*list = NULL;
+	skip_newlines(tokens);
+	while (!is_list_end(*tokens))
+	{
+		item = parse_and_or(tokens);
+		if (!item)
+			return (0);
+		if (*list)
 		{
-			return (syntax_error((*tokens)->value));
+			seq = create_node(NODE_SEQ);
+			seq->left = *list;
+			seq->right = item;
+			item = seq;
 		}
+		*list = item;
+		if ((*tokens)->type != TOKEN_SEMI && (*tokens)->type != TOKEN_NEWLINE)
+			break ;
+		*tokens = (*tokens)->next;
+		skip_newlines(tokens);
+	}
+	return (1);
+}
+
+/* A list that must not be empty, like the body of a loop */
+static int	parse_body(t_token **tokens, t_node **body)
+{
+	if (!parse_list(tokens, body))
+		return (0);
+	if (!*body)
+	{
+		parse_error(*tokens);
+		return (0);
 	}
 	return (1);
 }
 
-t_cmd	*parser(t_token *tokens)
+static t_node	*fail(t_node *node)
 {
-	t_cmd	*commands;
-	t_cmd	*current_cmd;
+	free_node(node);
+	return (NULL);
+}
 
-	commands = NULL;
-	
-	while (tokens && tokens->type != TOKEN_EOF)
+/* if list then list [elif list then list]... [else list] fi */
+static t_node	*parse_if(t_token **tokens)
+{
+	t_node	*node;
+
+	node = create_node(NODE_IF);
+	if (!parse_body(tokens, &node->left) || !expect(tokens, "then")
+		|| !parse_body(tokens, &node->right))
+		return (fail(node));
+	if (is_keyword(*tokens, "elif"))
+	{
+		*tokens = (*tokens)->next;
+		node->extra = parse_if(tokens);
+		return (node->extra ? node : fail(node));
+	}
+	if (is_keyword(*tokens, "else"))
+	{
+		*tokens = (*tokens)->next;
+		if (!parse_body(tokens, &node->extra))
+			return (fail(node));
+	}
+	if (!expect(tokens, "fi"))
+		return (fail(node));
+	return (node);
+}
+
+/* while/until list do list done */
+static t_node	*parse_while(t_token **tokens, t_node_type type)
+{
+	t_node	*node;
+
+	node = create_node(type);
+	if (!parse_body(tokens, &node->left) || !expect(tokens, "do")
+		|| !parse_body(tokens, &node->right) || !expect(tokens, "done"))
+		return (fail(node));
+	return (node);
+}
+
+static int	is_name(char *str)
+{
+	int	i;
+
+	if (!isalpha(str[0]) && str[0] != '_')
+		return (0);
+	i = 1;
+	while (isalnum(str[i]) || str[i] == '_')
+		i++;
+	return (str[i] == '\0');
+}
+
+/* for name [in word...] ; do list done, without in it loops over "$@" */
+static t_node	*parse_for(t_token **tokens)
+{
+	t_node	*node;
+	t_word	**tail;
+
+	if ((*tokens)->type != TOKEN_WORD || !is_name((*tokens)->value))
+		return (parse_error(*tokens));
+	node = create_node(NODE_FOR);
+	node->var = safe_strdup((*tokens)->value);
+	*tokens = (*tokens)->next;
+	skip_newlines(tokens);
+	if (is_keyword(*tokens, "in"))
 	{
-		current_cmd = create_cmd();
-		
-		if (!parse_command(&tokens, current_cmd))
+		*tokens = (*tokens)->next;
+		tail = &node->words;
+		while ((*tokens)->type == TOKEN_WORD)
 		{
-			free_cmds(commands);
-			free_cmds(current_cmd);
-			return (NULL);
+			*tail = compile_word((*tokens)->value);
+			tail = &(*tail)->next;
+			*tokens = (*tokens)->next;
 		}
-		
-		add_cmd(&commands, current_cmd);
-		
-		/* Handle pipe */
-		if (tokens && tokens->type == TOKEN_PIPE)
+	}
+	else
+		node->words = compile_word("\"$@\"");
+	if ((*tokens)->type == TOKEN_SEMI)
+		*tokens = (*tokens)->next;
+	skip_newlines(tokens);
+	if (!expect(tokens, "do") || !parse_body(tokens, &node->right)
+		|| !expect(tokens, "done"))
+		return (fail(node));
+	return (node);
+}
+
+static t_case_item	*free_case_item(t_case_item *item)
+{
+	free_words(item->patterns);
+	free_node(item->body);
+	free(item);
+	return (NULL);
+}
+
+/* [(] pattern [| pattern]... ) list */
+static t_case_item	*parse_case_item(t_token **tokens)
+{
+	t_case_item	*item;
+	t_word		**tail;
+
+	item = safe_malloc(sizeof(t_case_item));
+	item->patterns = NULL;
+	item->body = NULL;
+	item->next = NULL;
+	if ((*tokens)->type == TOKEN_LPAREN)
+		*tokens = (*tokens)->next;
+	tail = &item->patterns;
+	while ((*tokens)->type == TOKEN_WORD)
+	{
+		*tail = compile_word((*tokens)->value);
+		tail = &(*tail)->next;
+		*tokens = (*tokens)->next;
+		if ((*tokens)->type != TOKEN_PIPE)
+			break ;
+		*tokens = (*tokens)->next;
+	}
+	if (!item->patterns || (*tokens)->type != TOKEN_RPAREN)
+	{
+		parse_error(*tokens);
+		return (free_case_item(item));
+	}
+	*tokens = (*tokens)->next;
+	if (!parse_list(tokens, &item->body))
+		return (free_case_item(item));
+	return (item);
+}
+
+/* case word in [item ;;]... esac, the last ;; is optional */
+static t_node	*parse_case(t_token **tokens)
+{
+	t_node		*node;
+	t_case_item	**tail;
+
+	if ((*tokens)->type != TOKEN_WORD)
+		return (parse_error(*tokens));
+	node = create_node(NODE_CASE);
+	node->words = compile_word((*tokens)->value);
+	*tokens = (*tokens)->next;
+	skip_newlines(tokens);
+	if (!expect(tokens, "in"))
+		return (fail(node));
+	skip_newlines(tokens);
+	tail = &node->items;
+	while (!is_keyword(*tokens, "esac"))
+	{
+		*tail = parse_case_item(tokens);
+		if (!*tail)
+			return (fail(node));
+		tail = &(*tail)->next;
+		if ((*tokens)->type != TOKEN_DSEMI)
+			break ;
+		*tokens = (*tokens)->next;
+		skip_newlines(tokens);
+	}
+	if (!expect(tokens, "esac"))
+		return (fail(node));
+	return (node);
+}
+
+/* { list } and ( list ) */
+static t_node	*parse_group(t_token **tokens, t_node_type type)
+{
+	t_node	*node;
+
+	node = create_node(type);
+	if (!parse_body(tokens, &node->left))
+		return (fail(node));
+	if (type == NODE_GROUP)
+	{
+		if (!expect(tokens, "}"))
+			return (fail(node));
+	}
+	else if ((*tokens)->type != TOKEN_RPAREN)
+	{
+		parse_error(*tokens);
+		return (fail(node));
+	}
+	else
+		*tokens = (*tokens)->next;
+	return (node);
+}
+
+/* name() compound-command, or function name [()] compound-command */
+static t_node	*parse_function(t_token **tokens)
+{
+	t_node	*node;
+	t_cmd	*body;
+
+	if (is_keyword(*tokens, "function"))
+		*tokens = (*tokens)->next;
+	if ((*tokens)->type != TOKEN_WORD || strpbrk((*tokens)->value, "'\"\\$=/"))
+		return (parse_error(*tokens));
+	node = create_node(NODE_FUNCTION);
+	node->var = safe_strdup((*tokens)->value);
+	*tokens = (*tokens)->next;
+	if ((*tokens)->type == TOKEN_LPAREN)
+	{
+		*tokens = (*tokens)->next;
+		if ((*tokens)->type != TOKEN_RPAREN)
 		{
-			tokens = tokens->next;
-			if (!tokens || tokens->type == TOKEN_EOF)
+			parse_error(*tokens);
+			return (fail(node));
+		}
+		*tokens = (*tokens)->next;
+	}
+	skip_newlines(tokens);
+	if (!is_compound(*tokens) || is_keyword(*tokens, "function"))
+	{
+		parse_error(*tokens);
+		return (fail(node));
+	}
+	/* The body keeps its redirections, they apply at every call */
+	body = parse_stage(tokens);
+	if (!body)
+		return (fail(node));
+	node->left = create_node(NODE_PIPELINE);
+	node->left->pipeline = body;
+	return (node);
+}
+
+static int	is_function(t_token *token)
+{
+	return (is_keyword(token, "function") || (token->type == TOKEN_WORD
+			&& token->next->type == TOKEN_LPAREN
+			&& token->next->next->type == TOKEN_RPAREN));
+}
+
+static int	is_compound(t_token *token)
+{
+	return (token->type == TOKEN_LPAREN || is_keyword(token, "if")
+		|| is_keyword(token, "while") || is_keyword(token, "until")
+		|| is_keyword(token, "for") || is_keyword(token, "case")
+		|| is_keyword(token, "{") || is_function(token));
+}
+
+static t_node	*parse_compound(t_token **tokens)
+{
+	t_token	*keyword;
+
+	if (is_function(*tokens))
+		return (parse_function(tokens));
+	keyword = *tokens;
+	*tokens = (*tokens)->next;
+	if (keyword->type == TOKEN_LPAREN)
+		return (parse_group(tokens, NODE_SUBSHELL));
+	if (is_keyword(keyword, "{"))
+		return (parse_group(tokens, NODE_GROUP));
+	if (is_keyword(keyword, "if"))
+		return (parse_if(tokens));
+	if (is_keyword(keyword, "while"))
+		return (parse_while(tokens, NODE_WHILE));
+	if (is_keyword(keyword, "until"))
+		return (parse_while(tokens, NODE_UNTIL));
+	if (is_keyword(keyword, "for"))
+		return (parse_for(tokens));
+	return (parse_case(tokens));
+}
+
+/* One pipeline stage: a simple command, or a compound command with its
+ * redirections (while ... done < file) */
+static t_cmd	*parse_stage(t_token **tokens)
+{
+	t_cmd	*cmd;
+
+	cmd = create_cmd();
+	if (is_compound(*tokens))
+	{
+		cmd->node = parse_compound(tokens);
+		while (cmd->node && ((*tokens)->type == TOKEN_IO_NUMBER
+				|| is_redirection(*tokens)))
+		{
+			if (!parse_redirections(tokens, cmd))
 			{
-				syntax_error("newline");
-				free_cmds(commands);
+				free_cmds(cmd);
 				return (NULL);
 			}
 		}
+		if (cmd->node)
+			return (cmd);
 	}
-	
-	return (commands);
+	else if (parse_command(tokens, cmd))
+	{
+		if (cmd->words || cmd->assignments || cmd->redirs || cmd->arith)
+			return (cmd);
+		parse_error(*tokens);
+	}
+	free_cmds(cmd);
+	return (NULL);
+}
+
+/* [!] stage [| stage]... */
+static t_node	*parse_pipeline(t_token **tokens)
+{
+	t_node	*node;
+	t_cmd	*cmd;
+
+	node = create_node(NODE_PIPELINE);
+	if (is_keyword(*tokens, "!"))
+	{
+		node->negate = 1;
+		*tokens = (*tokens)->next;
+	}
+	while (1)
+	{
+		cmd = parse_stage(tokens);
+		if (!cmd)
+			return (fail(node));
+		add_cmd(&node->pipeline, cmd);
+		if ((*tokens)->type != TOKEN_PIPE)
+			break ;
+		*tokens = (*tokens)->next;
+		skip_newlines(tokens);
+	}
+	return (node);
+}
+
+/* pipeline [&& pipeline | || pipeline]... */
+static t_node	*parse_and_or(t_token **tokens)
+{
+	t_node	*node;
+	t_node	*op;
+
+	node = parse_pipeline(tokens);
+	while (node && ((*tokens)->type == TOKEN_AND
+			|| (*tokens)->type == TOKEN_OR))
+	{
+		op = create_node((*tokens)->type == TOKEN_AND ? NODE_AND : NODE_OR);
+		op->left = node;
+		*tokens = (*tokens)->next;
+		skip_newlines(tokens);
+		op->right = parse_pipeline(tokens);
+		if (!op->right)
+			return (fail(op));
+		node = op;
+	}
+	return (node);
+}
+
+/*
+ * Builds the syntax tree of a whole input. Words are compiled here once,
+ * loops and other compound commands then run without going back to the
+ * tokens. Returns NULL on errors and for empty input.
+ */
+t_node	*parser(t_token *tokens)
+{
+	t_node	*tree;
+
+	g_shell.incomplete = 0;
+	if (!parse_list(&tokens, &tree))
+		return (NULL);
+	if (tokens->type != TOKEN_EOF)
+	{
+		parse_error(tokens);
+		return (fail(tree));
+	}
+	return (tree);
 }
@@ -0,0 +1,190 @@
+#include "../include/minishell.h"
+
+/*
+ * Pipelines are planned in the shell before the first stage is forked.
+ * A stage that is a plain external command with literal words gets its
+ * command looked up, through the hash table, and its redirection files
+ * opened, in order, once. A stage that fails there is reported and never
+ * forked; the others still are, since a pipeline runs all of its stages
+ * whatever one of them does (cat missing | wc -l prints 0), and run from
+ * the plan without searching PATH again. Anything whose words have to be
+ * expanded is left to its child, and so is a stage redirected to a FIFO
+ * or a device, whose open may block until another stage runs.
+ */
+
+/* Whether target exists and isn't a regular file */
+static int	special_file(t_program *prog, int pc)
+{
+	struct stat	st;
+
+	if (prog->code[pc + 1] == REDIR_DUP_IN
+		|| prog->code[pc + 1] == REDIR_DUP_OUT)
+		return (0);
+	return (stat(program_word(prog, prog->code[pc + 3])->literal, &st) == 0
+		&& !S_ISREG(st.st_mode));
+}
+
+/* The redirections of a stage at code + pc, -1 if they aren't literal,
+ * hold a heredoc or name a special file */
+static int	count_redirs(t_program *prog, int pc)
+{
+	int	count;
+
+	count = 0;
+	while (prog->code[pc] == OP_REDIRECT)
+	{
+		if (prog->code[pc + 1] == REDIR_HEREDOC
+			|| !program_word(prog, prog->code[pc + 3])->literal
+			|| special_file(prog, pc))
+			return (-1);
+		count++;
+		pc += 4;
+	}
+	if (prog->code[pc] != OP_SPAWN || prog->code[pc + 1] != OP_EXIT)
+		return (-1);
+	return (count);
+}
+
+/* The command name of a stage that can be planned, else NULL; *pc is
+ * left on its first REDIRECT */
+static char	*stage_command(t_program *prog, int *pc)
+{
+	t_word	*word;
+	char	*name;
+
+	name = NULL;
+	if (prog->code[(*pc)++] != OP_BEGIN)
+		return (NULL);
+	while (prog->code[*pc] == OP_EXPAND)
+	{
+		word = program_word(prog, prog->code[*pc + 1]);
+		if (!word->literal)
+			return (NULL);
+		if (!name)
+			name = word->literal;
+		*pc += 2;
+	}
+	if (!name || find_function(name) || is_builtin(name)
+		|| is_special_builtin(name))
+		return (NULL);
+	return (name);
+}
+
+/* Opens the files of the stage's count redirections, 0 once one fails */
+static int	open_files(t_program *prog, int pc, t_stage *stage, int count)
+{
+	t_redir	redir;
+	int		fd;
+
+	memset(&redir, 0, sizeof(t_redir));
+	while (stage->nfds < count)
+	{
+		redir.type = prog->code[pc + 1];
+		redir.target = program_word(prog, prog->code[pc + 3])->literal;
+		pc += 4;
+		fd = -1;
+		if (redir.type != REDIR_DUP_IN && redir.type != REDIR_DUP_OUT
+			&& (fd = open_target(&redir)) == -1)
+		{
+			print_error(redir.target, strerror(errno));
+			return (0);
+		}
+		stage->fds[stage->nfds++] = fd;
+	}
+	return (1);
+}
+
+/* A stage from the BEGIN at pc; failures are reported as bash's children
+ * would, redirections first */
+static void	plan_stage(t_program *prog, int pc, t_stage *stage)
+{
+	char	*name;
+	int		count;
+
+	name = stage_command(prog, &pc);
+	count = name ? count_redirs(prog, pc) : -1;
+	if (count < 0)
+		return ;
+	stage->planned = 1;
+	stage->fds = safe_malloc(sizeof(int) * (count + 1));
+	if (!open_files(prog, pc, stage, count))
+	{
+		stage->status = 1;
+		return ;
+	}
+	stage->path = find_command_path(name, NULL);
+	if (!stage->path)
+	{
+		print_error(name, "command not found");
+		stage->status = 127;
+	}
+}
+
+/* The pipeline whose first PIPE is at code + pc */
+t_plan	*plan_pipeline(t_program *prog, int pc)
+{
+	t_plan	*plan;
+	int		count;
+	int		i;
+
+	count = 0;
+	i = pc;
+	while (prog->code[i] == OP_PIPE)
+	{
+		count++;
+		i = prog->code[i + 1];
+	}
+	plan = safe_malloc(sizeof(t_plan));
+	plan->count = count;
+	plan->stages = safe_malloc(sizeof(t_stage) * count);
+	memset(plan->stages, 0, sizeof(t_stage) * count);
+	i = -1;
+	while (++i < count)
+	{
+		plan_stage(prog, pc + 2, &plan->stages[i]);
+		pc = prog->code[pc + 1];
+	}
+	return (plan);
+}
+
+/* The shell's copies of the stage's files, once it has been forked */
+void	close_stage(t_stage *stage)
+{
+	int	i;
+
+	i = 0;
+	while (i < stage->nfds)
+	{
+		if (stage->fds[i] != -1)
+			close(stage->fds[i]);
+		stage->fds[i++] = -1;
+	}
+}
+
+/* In the child of stage index: the files of the other stages go */
+void	keep_stage(t_plan *plan, int index)
+{
+	int	i;
+
+	i = -1;
+	while (++i < plan->count)
+		if (i != index)
+			close_stage(&plan->stages[i]);
+}
+
+void	free_plan(t_plan *plan)
+{
+	int	i;
+
+	if (!plan)
+		return ;
+	i = -1;
+	while (++i < plan->count)
+	{
+		close_stage(&plan->stages[i]);
+		free(plan->stages[i].path);
+		free(plan->stages[i].fds);
+	}
+	free(plan->stages);
+	free(plan);
+}
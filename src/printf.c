@@ -0,0 +1,315 @@
+#include "../include/minishell.h"
+
+/*
+ * printf FORMAT [ARGUMENT...] and printf -v NAME. The whole output is
+ * formatted into one buffer, then written with a single stdio call or
+ * assigned to NAME; the format is reused while arguments are left.
+ */
+
+typedef struct s_printf
+{
+	t_buf				out;
+	char				**args;
+	int					status;
+	int					stop;
+}	t_printf;
+
+static void	add_formatted(t_buf *buf, char *spec, ...)
+{
+	va_list	ap;
+	int		len;
+
+	va_start(ap, spec);
+	len = vsnprintf(NULL, 0, spec, ap);
+	va_end(ap);
+	if (len < 0)
+		return ;
+	buf_reserve(buf, len);
+	va_start(ap, spec);
+	vsnprintf(buf->data + buf->len, len + 1, spec, ap);
+	va_end(ap);
+	buf->len += len;
+}
+
+static char	*next_arg(t_printf *p)
+{
+	if (!*p->args)
+		return (NULL);
+	return (*p->args++);
+}
+
+/* Octal digits after \ (\0NNN in %b), hex digits after \x */
+static int	escape_number(char *s, int *i, int base, int max)
+{
+	int	value;
+	int	digit;
+	int	n;
+
+	value = 0;
+	n = 0;
+	while (n < max && s[*i])
+	{
+		if (isdigit(s[*i]) && s[*i] - '0' < base)
+			digit = s[*i] - '0';
+		else if (base == 16 && isxdigit(s[*i]))
+			digit = tolower(s[*i]) - 'a' + 10;
+		else
+			break ;
+		value = value * base + digit;
+		(*i)++;
+		n++;
+	}
+	return (value);
+}
+
+/*
+ * The backslash escape at s[*i] (the character after the \), *i moved
+ * past it. In %b arguments octal takes a leading 0 and \c ends all
+ * output.
+ */
+static void	add_escape(t_printf *p, char *s, int *i, int in_arg)
+{
+	static char	*from = "\\abefnrtv\"'?";
+	static char	*to = "\\\a\b\033\f\n\r\t\v\"'?";
+	char		*found;
+	int			start;
+
+	found = s[*i] ? strchr(from, s[*i]) : NULL;
+	start = *i;
+	if (found)
+		buf_add_char(&p->out, to[found - from]);
+	else if (s[*i] == 'x' && isxdigit(s[*i + 1]))
+	{
+		(*i)++;
+		buf_add_char(&p->out, escape_number(s, i, 16, 2));
+		return ;
+	}
+	else if (s[*i] >= '0' && s[*i] <= '7')
+	{
+		*i += (in_arg && s[*i] == '0');
+		buf_add_char(&p->out, escape_number(s, i, 8, 3));
+		return ;
+	}
+	else if (s[*i] == 'c' && in_arg)
+		p->stop = 1;
+	else
+	{
+		buf_add_char(&p->out, '\\');
+		if (!s[*i])
+			return ;
+		buf_add_char(&p->out, s[*i]);
+	}
+	*i = start + 1;
+}
+
+/* %b: the argument with its escapes expanded */
+static void	add_escaped_arg(t_printf *p, char *arg)
+{
+	int	i;
+
+	i = 0;
+	while (arg[i] && !p->stop)
+	{
+		if (arg[i] == '\\')
+		{
+			i++;
+			add_escape(p, arg, &i, 1);
+		}
+		else
+			buf_add_char(&p->out, arg[i++]);
+	}
+}
+
+static void	number_error(t_printf *p, char *arg, char *msg)
+{
+	char	*cmd;
+
+	cmd = join_strings("printf: ", arg);
+	print_error(cmd, msg);
+	free(cmd);
+	p->status = 1;
+}
+
+/* Numeric argument: C constants, 'c for the code of c, 0 when missing */
+static long long	numeric_arg(t_printf *p, char *arg, int is_unsigned)
+{
+	long long	value;
+	char		*end;
+
+	if (!arg || !*arg)
+		return (0);
+	if (arg[0] == '\'' || arg[0] == '"')
+		return ((unsigned char)arg[1]);
+	errno = 0;
+	if (is_unsigned && arg[0] != '-')
+		value = strtoull(arg, &end, 0);
+	else
+		value = strtoll(arg, &end, 0);
+	if (errno || end == arg || *end)
+		number_error(p, arg, errno ? strerror(errno) : "invalid number");
+	return (value);
+}
+
+static double	float_arg(t_printf *p, char *arg)
+{
+	double	value;
+	char	*end;
+
+	if (!arg || !*arg)
+		return (0);
+	if (arg[0] == '\'' || arg[0] == '"')
+		return ((unsigned char)arg[1]);
+	value = strtod(arg, &end);
+	if (end == arg || *end)
+		number_error(p, arg, "invalid number");
+	return (value);
+}
+
+/* One conversion; spec holds %, flags, width and precision so far */
+static void	convert(t_printf *p, t_buf *spec, char conv)
+{
+	char	*arg;
+	char	c[2];
+
+	arg = next_arg(p);
+	if (conv == 'b')
+	{
+		add_escaped_arg(p, arg ? arg : "");
+		return ;
+	}
+	if (conv == 'c')
+	{
+		c[0] = arg ? arg[0] : '\0';
+		c[1] = '\0';
+		arg = c;
+	}
+	if (conv == 's' || conv == 'c')
+		buf_add_char(spec, 's');
+	else if (strchr("diouxX", conv))
+	{
+		buf_add_str(spec, "ll");
+		buf_add_char(spec, conv);
+	}
+	else
+		buf_add_char(spec, conv);
+	if (conv == 's' || conv == 'c')
+		add_formatted(&p->out, spec->data, arg ? arg : "");
+	else if (conv == 'd' || conv == 'i')
+		add_formatted(&p->out, spec->data, numeric_arg(p, arg, 0));
+	else if (strchr("ouxX", conv))
+		add_formatted(&p->out, spec->data,
+			(unsigned long long)numeric_arg(p, arg, 1));
+	else
+		add_formatted(&p->out, spec->data, float_arg(p, arg));
+}
+
+/* A width or precision, * taking it from the next argument */
+static void	add_width(t_printf *p, t_buf *spec, char *fmt, int *i)
+{
+	if (fmt[*i] == '*')
+	{
+		(*i)++;
+		add_formatted(spec, "%d", (int)numeric_arg(p, next_arg(p), 0));
+		return ;
+	}
+	while (isdigit(fmt[*i]))
+		buf_add_char(spec, fmt[(*i)++]);
+}
+
+/* The conversion at fmt[*i], a %; length modifiers are ignored */
+static int	format_spec(t_printf *p, char *fmt, int *i)
+{
+	t_buf	spec;
+	int		ok;
+
+	buf_init(&spec, 32);
+	buf_add_char(&spec, fmt[(*i)++]);
+	while (fmt[*i] && strchr("-+ #0", fmt[*i]))
+		buf_add_char(&spec, fmt[(*i)++]);
+	add_width(p, &spec, fmt, i);
+	if (fmt[*i] == '.')
+	{
+		buf_add_char(&spec, fmt[(*i)++]);
+		add_width(p, &spec, fmt, i);
+	}
+	while (fmt[*i] && strchr("hlLjzt", fmt[*i]))
+		(*i)++;
+	ok = fmt[*i] && strchr("diouxXeEfFgGaAcsb", fmt[*i]);
+	if (ok)
+		convert(p, &spec, fmt[(*i)++]);
+	else
+	{
+		spec.len = 0;
+		buf_add_str(&spec, "printf: `");
+		buf_add_char(&spec, fmt[*i] ? fmt[*i] : '%');
+		buf_add_char(&spec, '\'');
+		print_error(spec.data, fmt[*i] ? "invalid format character"
+			: "missing format character");
+		p->status = 1;
+	}
+	free(spec.data);
+	return (ok);
+}
+
+/* One pass over the format, 0 if it had to stop at a bad conversion */
+static int	format_once(t_printf *p, char *fmt)
+{
+	int	i;
+
+	i = 0;
+	while (fmt[i] && !p->stop)
+	{
+		if (fmt[i] == '\\')
+		{
+			i++;
+			add_escape(p, fmt, &i, 0);
+		}
+		else if (fmt[i] != '%')
+			buf_add_char(&p->out, fmt[i++]);
+		else if (fmt[i + 1] == '%')
+		{
+			buf_add_char(&p->out, '%');
+			i += 2;
+		}
+		else if (!format_spec(p, fmt, &i))
+			return (0);
+	}
+	return (1);
+}
+
+int	builtin_printf(char **args)
+{
+	t_printf	p;
+	char		**start;
+	char		*name;
+
+	name = NULL;
+	if (args[1] && strcmp(args[1], "-v") == 0 && args[2])
+	{
+		name = args[2];
+		args += 2;
+	}
+	if (args[1] && strcmp(args[1], "--") == 0)
+		args++;
+	if (!args[1])
+	{
+		print_error("printf", "usage: printf [-v var] format [arguments]");
+		return (2);
+	}
+	memset(&p, 0, sizeof(t_printf));
+	buf_init(&p.out, 256);
+	p.args = args + 2;
+	start = NULL;
+	while (p.args != start && !p.stop)
+	{
+		start = p.args;
+		if (!format_once(&p, args[1]) || !*p.args)
+			break ;
+	}
+	if (name)
+		set_shell_value(name, p.out.data);
+	else
+		fwrite(p.out.data, 1, p.out.len, stdout);
+	free(p.out.data);
+	return (p.status);
+}
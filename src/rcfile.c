@@ -0,0 +1,268 @@
+#include "../include/minishell.h"
+
+/*
+ * ~/.minishellrc is compiled once and the program is cached on disk. The
+ * cache is a header followed by the code, segment and word tables, the
+ * rc path and the string pool. Programs hold indexes, not pointers, so a
+ * mapping of the file is used as it is and word templates are only linked
+ * as they run: startup cost doesn't grow with the size of the rc file.
+ */
+
+# define RC_MAGIC "MSHRC01"
+# define RC_BUILD_ID_MAX 32
+
+typedef struct s_rc_header
+{
+	char				magic[8];
+	unsigned char		build_id[RC_BUILD_ID_MAX];
+	long long			mtime_sec;
+	long long			mtime_nsec;
+	long long			size;
+	int					path_len;
+	int					len;
+	int					strings_len;
+	int					nsegs;
+	int					nwords;
+}	t_rc_header;
+
+#ifdef __linux__
+
+/* Copies the GNU build-id note of the executable, the first object */
+static int	find_build_id(struct dl_phdr_info *info, size_t size, void *data)
+{
+	ElfW(Nhdr)	*note;
+	char		*pos;
+	char		*end;
+	int			i;
+
+	(void)size;
+	i = -1;
+	while (++i < info->dlpi_phnum)
+	{
+		if (info->dlpi_phdr[i].p_type != PT_NOTE)
+			continue ;
+		pos = (char *)(info->dlpi_addr + info->dlpi_phdr[i].p_vaddr);
+		end = pos + info->dlpi_phdr[i].p_memsz;
+		while (pos + sizeof(ElfW(Nhdr)) <= end)
+		{
+			note = (ElfW(Nhdr) *)pos;
+			pos += sizeof(ElfW(Nhdr)) + ((note->n_namesz + 3) & ~3);
+			if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4)
+				memcpy(data, pos, note->n_descsz < RC_BUILD_ID_MAX
+					? note->n_descsz : RC_BUILD_ID_MAX);
+			pos += (note->n_descsz + 3) & ~3;
+		}
+	}
+	return (1);
+}
+#endif
+
+/* Identifies this binary, so a rebuilt shell never runs stale code */
+static void	get_build_id(unsigned char *id)
+{
+	memset(id, 0, RC_BUILD_ID_MAX);
+#ifdef __linux__
+	dl_iterate_phdr(find_build_id, id);
+#endif
+	if (id[0] == 0 && id[1] == 0)
+		strncpy((char *)id, __DATE__ " " __TIME__, RC_BUILD_ID_MAX);
+}
+
+/* $XDG_CACHE_HOME/minishell/rc-<hash of the rc path>, created as needed */
+static char	*cache_path(char *home, char *rc_path)
+{
+	char	*base;
+	char	*dir;
+	char	*path;
+
+	base = get_env_value("XDG_CACHE_HOME");
+	if (base && *base)
+		base = safe_strdup(base);
+	else
+		base = join_strings(home, "/.cache");
+	mkdir(base, 0700);
+	dir = join_strings(base, "/minishell");
+	mkdir(dir, 0700);
+	path = safe_malloc(strlen(dir) + 16);
+	sprintf(path, "%s/rc-%08x", dir, hash_string(rc_path));
+	free(base);
+	free(dir);
+	return (path);
+}
+
+static size_t	cache_size(t_rc_header *header)
+{
+	return (sizeof(t_rc_header) + sizeof(int) * ((size_t)header->len
+			+ header->nsegs * 3 + header->nwords * 2)
+		+ header->path_len + header->strings_len);
+}
+
+static void	fill_header(t_rc_header *header, char *rc_path, struct stat *st)
+{
+	memset(header, 0, sizeof(t_rc_header));
+	memcpy(header->magic, RC_MAGIC, sizeof(header->magic));
+	get_build_id(header->build_id);
+	header->mtime_sec = st->st_mtim.tv_sec;
+	header->mtime_nsec = st->st_mtim.tv_nsec;
+	header->size = st->st_size;
+	header->path_len = strlen(rc_path) + 1;
+}
+
+/* The cached program when the key in the header still matches */
+static t_program	*load_cache(char *path, char *rc_path, struct stat *st)
+{
+	t_rc_header	key;
+	t_rc_header	*header;
+	struct stat	cache_st;
+	t_program	*prog;
+	char		*map;
+	int			fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return (NULL);
+	map = MAP_FAILED;
+	if (fstat(fd, &cache_st) == 0
+		&& (size_t)cache_st.st_size >= sizeof(t_rc_header))
+		map = mmap(NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return (NULL);
+	header = (t_rc_header *)map;
+	fill_header(&key, rc_path, st);
+	if (memcmp(header, &key, offsetof(t_rc_header, len)) != 0
+		|| header->len < 1 || header->nsegs < 0 || header->nwords < 0
+		|| header->strings_len < 0
+		|| cache_size(header) != (size_t)cache_st.st_size)
+	{
+		munmap(map, cache_st.st_size);
+		return (NULL);
+	}
+	prog = safe_malloc(sizeof(t_program));
+	memset(prog, 0, sizeof(t_program));
+	prog->map = map;
+	prog->map_len = cache_st.st_size;
+	prog->refs = 1;
+	prog->len = header->len;
+	prog->nsegs = header->nsegs;
+	prog->nwords = header->nwords;
+	prog->strings_len = header->strings_len;
+	prog->code = (int *)(map + sizeof(t_rc_header));
+	prog->segs = prog->code + prog->len;
+	prog->words = prog->segs + prog->nsegs * 3;
+	map = (char *)(prog->words + prog->nwords * 2);
+	if (strcmp(map, rc_path) != 0)
+	{
+		release_program(prog);
+		return (NULL);
+	}
+	prog->strings = map + header->path_len;
+	link_program(prog);
+	return (prog);
+}
+
+/* Written to a temporary file and renamed, so concurrent shells only ever
+ * map complete caches. Failing to write it is not an error */
+static void	save_cache(char *path, char *rc_path, struct stat *st,
+	t_program *prog)
+{
+	t_rc_header	header;
+	t_buf		buf;
+	char		*tmp;
+	size_t		done;
+	ssize_t		n;
+	int			fd;
+
+	fill_header(&header, rc_path, st);
+	header.len = prog->len;
+	header.strings_len = prog->strings_len;
+	header.nsegs = prog->nsegs;
+	header.nwords = prog->nwords;
+	buf_init(&buf, cache_size(&header));
+	buf_add(&buf, (char *)&header, sizeof(header));
+	buf_add(&buf, (char *)prog->code, sizeof(int) * prog->len);
+	buf_add(&buf, (char *)prog->segs, sizeof(int) * prog->nsegs * 3);
+	buf_add(&buf, (char *)prog->words, sizeof(int) * prog->nwords * 2);
+	buf_add(&buf, rc_path, header.path_len);
+	buf_add(&buf, prog->strings, prog->strings_len);
+	tmp = safe_malloc(strlen(path) + 16);
+	sprintf(tmp, "%s.%d", path, (int)getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	done = 0;
+	while (fd != -1 && done < buf.len)
+	{
+		n = write(fd, buf.data + done, buf.len - done);
+		if (n == -1 && errno == EINTR)
+			continue ;
+		if (n <= 0)
+			break ;
+		done += n;
+	}
+	if (fd != -1 && close(fd) == 0 && done == buf.len)
+		rename(tmp, path);
+	else
+		unlink(tmp);
+	free(tmp);
+	free(buf.data);
+}
+
+static t_program	*compile_rc_file(char *rc_path)
+{
+	t_program	*prog;
+	t_node		*tree;
+	t_buf		buf;
+	int			fd;
+
+	fd = open(rc_path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		print_error(rc_path, strerror(errno));
+		return (NULL);
+	}
+	buf_init(&buf, 4096);
+	read_all(fd, &buf);
+	close(fd);
+	tree = parse_line(buf.data);
+	free(buf.data);
+	/* Syntax errors have been reported; such a file is never cached */
+	if (!tree)
+		return (NULL);
+	prog = compile_program(tree);
+	free_node(tree);
+	return (prog);
+}
+
+/* Runs ~/.minishellrc, from the cache when the file hasn't changed */
+void	load_rc_file(void)
+{
+	struct stat	st;
+	t_program	*prog;
+	char		*home;
+	char		*rc_path;
+	char		*path;
+
+	home = get_env_value("HOME");
+	if (!home || !*home)
+		return ;
+	rc_path = join_strings(home, "/.minishellrc");
+	if (stat(rc_path, &st) == -1 || !S_ISREG(st.st_mode))
+	{
+		free(rc_path);
+		return ;
+	}
+	path = cache_path(home, rc_path);
+	prog = load_cache(path, rc_path, &st);
+	if (!prog)
+	{
+		prog = compile_rc_file(rc_path);
+		if (prog)
+			save_cache(path, rc_path, &st, prog);
+	}
+	if (prog)
+	{
+		execute_program(prog);
+		release_program(prog);
+	}
+	free(path);
+	free(rc_path);
+}
@@ -0,0 +1,374 @@
+#include "../include/minishell.h"
+
+/*
+ * read [-r] [-a array] [-d delim] [-n nchars] [-p prompt] [-u fd] [name...]
+ * A seekable descriptor is read in blocks growing from READ_FIRST to
+ * READ_BLOCK bytes, so short lines copy little, and what lies past the
+ * line is given back with lseek(); a socket is peeked at and only
+ * the line taken off it. Pipes and terminals are read a byte at a time,
+ * the only way to leave the rest of the input to the next reader.
+ */
+
+# define READ_BLOCK 8192
+# define READ_FIRST 256
+
+/* How the input is read */
+# define INPUT_BYTE 0
+# define INPUT_SEEK 1
+# define INPUT_PEEK 2
+
+typedef struct s_input
+{
+	int					fd;
+	int					mode;
+	int					error;
+	size_t				block;
+	size_t				pos;
+	size_t				len;
+	char				data[READ_BLOCK];
+}	t_input;
+
+/* quoted flags the characters of line that were escaped with \ */
+typedef struct s_read
+{
+	t_buf				line;
+	t_buf				quoted;
+	int					raw;
+	char				delim;
+	long				limit;
+	char				*array;
+	char				*prompt;
+	t_input				in;
+}	t_read;
+
+static int	input_mode(int fd)
+{
+	struct stat	st;
+
+	if (lseek(fd, 0, SEEK_CUR) != -1)
+		return (INPUT_SEEK);
+	if (fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode))
+		return (INPUT_PEEK);
+	return (INPUT_BYTE);
+}
+
+/* Makes sure unread input is buffered, 0 at end of input or on error */
+static int	fill_input(t_input *in)
+{
+	ssize_t	n;
+
+	if (in->pos < in->len)
+		return (1);
+	/* Peeked bytes stay on the socket until they have all been used */
+	if (in->mode == INPUT_PEEK && in->len > 0)
+		recv(in->fd, in->data, in->len, 0);
+	in->pos = 0;
+	in->len = 0;
+	n = -1;
+	while (n == -1 && !g_shell.interrupted)
+	{
+		if (in->mode == INPUT_PEEK)
+			n = recv(in->fd, in->data, READ_BLOCK, MSG_PEEK);
+		else
+			n = read(in->fd, in->data, in->block);
+		if (n == -1 && errno != EINTR)
+		{
+			in->error = errno;
+			return (0);
+		}
+	}
+	in->len = (n > 0) ? n : 0;
+	if (in->mode == INPUT_SEEK && in->block < READ_BLOCK)
+		in->block *= 2;
+	return (n > 0);
+}
+
+/* Leaves the descriptor right after the last character used */
+static void	release_input(t_input *in)
+{
+	if (in->mode == INPUT_SEEK && in->pos < in->len)
+		lseek(in->fd, -(off_t)(in->len - in->pos), SEEK_CUR);
+	else if (in->mode == INPUT_PEEK && in->pos > 0)
+		recv(in->fd, in->data, in->pos, 0);
+}
+
+static void	add_chars(t_read *r, char *str, size_t len, int quoted)
+{
+	buf_add(&r->line, str, len);
+	if (r->raw)
+		return ;
+	buf_reserve(&r->quoted, len);
+	memset(r->quoted.data + r->quoted.len, quoted, len);
+	r->quoted.len += len;
+}
+
+/* Length of the buffered run, at most max bytes, that holds no delimiter,
+ * no NUL byte and, without -r, no backslash */
+static size_t	plain_run(t_read *r, size_t max)
+{
+	char	*start;
+	char	*end;
+	size_t	len;
+
+	start = r->in.data + r->in.pos;
+	len = r->in.len - r->in.pos;
+	if (len > max)
+		len = max;
+	end = memchr(start, r->delim, len);
+	if (end)
+		len = end - start;
+	if (!r->raw && (end = memchr(start, '\\', len)))
+		len = end - start;
+	if (r->delim && (end = memchr(start, '\0', len)))
+		len = end - start;
+	return (len);
+}
+
+/*
+ * Reads up to the delimiter or -n characters, 0 if the input ended first.
+ * Without -r a backslash escapes the next character and a backslash
+ * newline pair continues the line; NUL bytes are dropped.
+ */
+static int	read_line(t_read *r)
+{
+	size_t	len;
+	char	c;
+
+	while (r->limit < 0 || (long)r->line.len < r->limit)
+	{
+		if (!fill_input(&r->in))
+			return (0);
+		len = plain_run(r, r->limit < 0 ? r->in.len
+				: (size_t)r->limit - r->line.len);
+		if (len > 0)
+		{
+			add_chars(r, r->in.data + r->in.pos, len, 0);
+			r->in.pos += len;
+			continue ;
+		}
+		c = r->in.data[r->in.pos++];
+		if (c == r->delim)
+			return (1);
+		if (c == '\0')
+			continue ;
+		if (!fill_input(&r->in))
+			return (0);
+		c = r->in.data[r->in.pos++];
+		if (c != '\n')
+			add_chars(r, &c, 1, 1);
+	}
+	return (1);
+}
+
+/* Whether line[i] separates fields; an escaped character never does */
+static int	is_separator(t_read *r, char *ifs, size_t i)
+{
+	return (r->line.data[i] && strchr(ifs, r->line.data[i])
+		&& (r->raw || !r->quoted.data[i]));
+}
+
+static int	is_blank(t_read *r, char *ifs, size_t i)
+{
+	return (isspace(r->line.data[i]) && is_separator(r, ifs, i));
+}
+
+static size_t	field_end(t_read *r, char *ifs, size_t i)
+{
+	while (i < r->line.len && !is_separator(r, ifs, i))
+		i++;
+	return (i);
+}
+
+/* Skips IFS whitespace, then one other IFS character and the whitespace
+ * after it */
+static size_t	skip_separator(t_read *r, char *ifs, size_t i)
+{
+	while (i < r->line.len && is_blank(r, ifs, i))
+		i++;
+	if (i < r->line.len && is_separator(r, ifs, i))
+	{
+		i++;
+		while (i < r->line.len && is_blank(r, ifs, i))
+			i++;
+	}
+	return (i);
+}
+
+/* Sets name to line[start, end) */
+static void	set_field(t_read *r, char *name, size_t start, size_t end)
+{
+	char	saved;
+
+	saved = r->line.data[end];
+	r->line.data[end] = '\0';
+	set_shell_value(name, r->line.data + start);
+	r->line.data[end] = saved;
+}
+
+/* -a: every field becomes an element */
+static int	assign_array(t_read *r, char *ifs, size_t i)
+{
+	t_array	*arr;
+	size_t	end;
+	char	saved;
+
+	arr = make_array(r->array, 0);
+	if (arr->assoc)
+	{
+		print_error(r->array, "not an indexed array");
+		return (0);
+	}
+	clear_array(arr);
+	while (i < r->line.len)
+	{
+		end = field_end(r, ifs, i);
+		saved = r->line.data[end];
+		r->line.data[end] = '\0';
+		array_push(arr, safe_strdup(r->line.data + i));
+		r->line.data[end] = saved;
+		i = skip_separator(r, ifs, end);
+	}
+	return (1);
+}
+
+/*
+ * One field for each name; the last name takes the rest of the line less
+ * its trailing IFS whitespace, and less the separator after it when only
+ * one field is left.
+ */
+static int	assign_fields(t_read *r, char **names)
+{
+	char	*ifs;
+	size_t	i;
+	size_t	end;
+	size_t	field;
+
+	ifs = get_env_value("IFS");
+	if (!ifs)
+		ifs = " \t\n";
+	i = 0;
+	while (i < r->line.len && is_blank(r, ifs, i))
+		i++;
+	if (r->array)
+		return (assign_array(r, ifs, i));
+	while (names[0] && names[1])
+	{
+		end = field_end(r, ifs, i);
+		set_field(r, *names++, i, end);
+		i = skip_separator(r, ifs, end);
+	}
+	end = r->line.len;
+	while (end > i && is_blank(r, ifs, end - 1))
+		end--;
+	field = field_end(r, ifs, i);
+	if (field < end && skip_separator(r, ifs, field) >= end)
+		end = field;
+	set_field(r, *names, i, end);
+	return (1);
+}
+
+static int	valid_names(char **names)
+{
+	int	i;
+
+	while (*names)
+	{
+		i = 0;
+		while (isalnum((*names)[i]) || (*names)[i] == '_')
+			i++;
+		if ((*names)[i] || !i || isdigit((*names)[0]))
+		{
+			print_error("read", "not a valid identifier");
+			return (0);
+		}
+		names++;
+	}
+	return (1);
+}
+
+static int	read_option(t_read *r, char ***args, int *i)
+{
+	char	c;
+	char	*value;
+
+	c = (**args)[*i];
+	if (c == 'r')
+	{
+		r->raw = 1;
+		return (1);
+	}
+	if (!strchr("adnpu", c) || !(value = option_value(args, i)))
+		return (0);
+	if (c == 'a')
+		r->array = value;
+	else if (c == 'd')
+		r->delim = value[0];
+	else if (c == 'n')
+		r->limit = atol(value);
+	else if (c == 'p')
+		r->prompt = value;
+	else
+		r->in.fd = atoi(value);
+	return (c != 'n' || r->limit >= 0);
+}
+
+static int	parse_read(t_read *r, char ***args)
+{
+	int	i;
+
+	r->in.fd = STDIN_FILENO;
+	r->delim = '\n';
+	r->limit = -1;
+	while (*++(*args) && (**args)[0] == '-' && (**args)[1])
+	{
+		i = 0;
+		while ((**args)[++i])
+		{
+			if (!read_option(r, args, &i))
+			{
+				print_error("read", "usage: read [-r] [-a array] [-d delim] "
+					"[-n nchars] [-p prompt] [-u fd] [name ...]");
+				return (0);
+			}
+		}
+	}
+	return (1);
+}
+
+/* Status 0 when a whole line was read, 1 at end of input or on error */
+int	builtin_read(char **args)
+{
+	static char	*reply[] = {"REPLY", NULL};
+	t_read		*r;
+	int			status;
+
+	r = safe_malloc(sizeof(t_read));
+	/* The input block needs no clearing */
+	memset(r, 0, offsetof(t_read, in.data));
+	if (!parse_read(r, &args))
+		status = 2;
+	else if (!valid_names(args))
+		status = 1;
+	else
+	{
+		r->in.mode = input_mode(r->in.fd);
+		r->in.block = (r->in.mode == INPUT_SEEK) ? READ_FIRST : 1;
+		if (r->prompt && isatty(r->in.fd))
+			fputs(r->prompt, stderr);
+		buf_init(&r->line, 128);
+		buf_init(&r->quoted, r->raw ? 16 : 128);
+		status = !read_line(r);
+		release_input(&r->in);
+		if (r->in.error)
+			print_error("read", strerror(r->in.error));
+		/* REPLY keeps the line as it was read */
+		if (!*args && !r->array)
+			set_shell_value("REPLY", r->line.data);
+		else if (!assign_fields(r, *args ? args : reply))
+			status = 1;
+		free(r->line.data);
+		free(r->quoted.data);
+	}
+	free(r);
+	return (status);
+}
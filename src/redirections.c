@@ -0,0 +1,326 @@
+#include "../include/minishell.h"
+
+static int	parse_fd(char *str)
+{
+	int	fd;
+	int	i;
+
+	if (!str || !*str)
+		return (-1);
+	fd = 0;
+	i = 0;
+	while (str[i])
+	{
+		if (!isdigit(str[i]) || i >= 9)
+			return (-1);
+		fd = fd * 10 + (str[i] - '0');
+		i++;
+	}
+	return (fd);
+}
+
+static int	bad_fd_error(char *name)
+{
+	print_error(name, "Bad file descriptor");
+	return (0);
+}
+
+/* Remember what fd looked like before the first redirection touched it */
+static void	save_fd(int fd, t_fdsave **saves)
+{
+	t_fdsave	*save;
+
+	save = safe_malloc(sizeof(t_fdsave));
+	save->fd = fd;
+	save->saved = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_FD_BASE);
+	save->next = *saves;
+	*saves = save;
+}
+
+int	open_target(t_redir *redir)
+{
+	if (redir->type == REDIR_IN)
+		return (open(redir->target, O_RDONLY | O_CLOEXEC));
+	if (redir->type == REDIR_OUT)
+		return (open(redir->target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				0644));
+	if (redir->type == REDIR_APPEND)
+		return (open(redir->target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+				0644));
+	return (create_heredoc(redir->target));
+}
+
+static int	apply_dup(t_redir *redir)
+{
+	int	src;
+
+	/* N>&- closes the descriptor */
+	if (strcmp(redir->target, "-") == 0)
+	{
+		close(redir->fd);
+		return (1);
+	}
+	src = parse_fd(redir->target);
+	if (src < 0 || src >= SHELL_FD_BASE || fcntl(src, F_GETFD) == -1)
+		return (bad_fd_error(redir->target));
+	if (src != redir->fd && dup2(src, redir->fd) == -1)
+	{
+		print_error(redir->target, strerror(errno));
+		return (0);
+	}
+	return (1);
+}
+
+/*
+ * Applies redirections in order. With saves, every touched descriptor is
+ * recorded first so restore_redirections() can undo them (builtins run in
+ * the shell itself); with NULL the changes are permanent.
+ */
+int	apply_redirections(t_redir *redirs, t_fdsave **saves)
+{
+	char	num[12];
+	int		fd;
+
+	while (redirs)
+	{
+		if (redirs->fd >= SHELL_FD_BASE)
+		{
+			sprintf(num, "%d", redirs->fd);
+			return (bad_fd_error(num));
+		}
+		if (saves)
+			save_fd(redirs->fd, saves);
+		if (redirs->type == REDIR_DUP_IN || redirs->type == REDIR_DUP_OUT)
+		{
+			if (!apply_dup(redirs))
+				return (0);
+		}
+		else
+		{
+			fd = redirs->opened;
+			if (fd == -1)
+				fd = open_target(redirs);
+			if (fd == -1)
+			{
+				print_error(redirs->type == REDIR_HEREDOC ? "heredoc"
+					: redirs->target, strerror(errno));
+				return (0);
+			}
+			/* Targets open close-on-exec; the descriptor they land on
+			 * is passed on */
+			if (fd != redirs->fd)
+			{
+				dup2(fd, redirs->fd);
+				close(fd);
+			}
+			else
+				fcntl(fd, F_SETFD, 0);
+		}
+		redirs = redirs->next;
+	}
+	return (1);
+}
+
+void	restore_redirections(t_fdsave *saves)
+{
+	t_fdsave	*next;
+
+	/* Builtins write through stdio, flush before the fds move back */
+	fflush(stdout);
+	while (saves)
+	{
+		next = saves->next;
+		if (saves->saved == -1)
+			close(saves->fd);
+		else
+		{
+			dup2(saves->saved, saves->fd);
+			close(saves->saved);
+		}
+		free(saves);
+		saves = next;
+	}
+}
+
+void	close_user_fds(void)
+{
+	int	fd;
+
+	fd = 3;
+	while (fd < SHELL_FD_BASE)
+	{
+		if (g_shell.fd_table[fd] & FD_USER)
+			close(fd);
+		g_shell.fd_table[fd] = 0;
+		fd++;
+	}
+}
+
+/* Descriptors 3 to 9 the shell was started with stay the user's */
+void	adopt_user_fds(void)
+{
+	int	fd;
+
+	fd = 3;
+	while (fd < SHELL_FD_BASE)
+	{
+		if (fcntl(fd, F_GETFD) != -1)
+			g_shell.fd_table[fd] |= FD_USER;
+		fd++;
+	}
+}
+
+/*
+ * Moves fd to the shell's range and closes the original. The copy is
+ * close-on-exec unless inherit, which records it for prepare_exec().
+ */
+int	shell_fd(int fd, int inherit)
+{
+	t_fdset	*set;
+	int		*bigger;
+	int		moved;
+
+	moved = fcntl(fd, inherit ? F_DUPFD : F_DUPFD_CLOEXEC, SHELL_FD_BASE);
+	close(fd);
+	set = &g_shell.inherited;
+	if (moved == -1 || !inherit)
+		return (moved);
+	if (set->count == set->cap)
+	{
+		set->cap = set->cap ? set->cap * 2 : 8;
+		bigger = safe_malloc(sizeof(int) * set->cap);
+		if (set->count)
+			memcpy(bigger, set->fds, sizeof(int) * set->count);
+		free(set->fds);
+		set->fds = bigger;
+	}
+	set->fds[set->count++] = moved;
+	return (moved);
+}
+
+/* Closes a descriptor from shell_fd() */
+void	release_fd(int fd)
+{
+	t_fdset	*set;
+	int		i;
+
+	set = &g_shell.inherited;
+	i = 0;
+	while (i < set->count && set->fds[i] != fd)
+		i++;
+	if (i < set->count)
+		set->fds[i] = set->fds[--set->count];
+	close(fd);
+}
+
+#if defined(__linux__) && defined(CLOSE_RANGE_CLOEXEC)
+
+/* The lowest inherited descriptor from fd on, -1 if there is none */
+static int	next_inherited(int fd)
+{
+	int	lowest;
+	int	i;
+
+	lowest = -1;
+	i = -1;
+	while (++i < g_shell.inherited.count)
+		if (g_shell.inherited.fds[i] >= fd
+			&& (lowest == -1 || g_shell.inherited.fds[i] < lowest))
+			lowest = g_shell.inherited.fds[i];
+	return (lowest);
+}
+
+/*
+ * Everything in the shell's range is close-on-exec already; this catches
+ * what a library opened without it. Marking rather than closing leaves
+ * the shell whole should exec fail.
+ */
+static void	seal_shell_fds(void)
+{
+	int	from;
+	int	next;
+
+	from = SHELL_FD_BASE;
+	while (from != -1)
+	{
+		next = next_inherited(from);
+		if (next != from)
+			close_range(from, next == -1 ? ~0U : (unsigned int)next - 1,
+				CLOSE_RANGE_CLOEXEC);
+		from = (next == -1) ? -1 : next + 1;
+	}
+}
+
+#else
+
+static void	seal_shell_fds(void)
+{
+}
+
+#endif
+
+#ifdef __linux__
+
+static int	passed_on(int fd, t_cmd *cmd)
+{
+	t_redir	*redir;
+	int		i;
+
+	if (fd < SHELL_FD_BASE && (g_shell.fd_table[fd] & FD_USER))
+		return (1);
+	redir = cmd->redirs;
+	while (redir && redir->fd != fd)
+		redir = redir->next;
+	i = 0;
+	while (!redir && i < g_shell.inherited.count
+		&& g_shell.inherited.fds[i] != fd)
+		i++;
+	return (redir || i < g_shell.inherited.count);
+}
+
+/* --check-fds: names every descriptor exec would pass on by mistake */
+static void	report_leaks(t_cmd *cmd)
+{
+	struct dirent	*entry;
+	DIR				*dir;
+	char			path[64];
+	char			what[320];
+	char			target[256];
+	ssize_t			len;
+	int				fd;
+
+	dir = opendir("/proc/self/fd");
+	while (dir && (entry = readdir(dir)))
+	{
+		fd = atoi(entry->d_name);
+		if (fd < 3 || fd == dirfd(dir) || (fcntl(fd, F_GETFD) & FD_CLOEXEC)
+			|| passed_on(fd, cmd))
+			continue ;
+		sprintf(path, "/proc/self/fd/%d", fd);
+		len = readlink(path, target, sizeof(target) - 1);
+		target[len > 0 ? len : 0] = '\0';
+		snprintf(what, sizeof(what), "%s: descriptor %d leaked",
+			cmd->args[0], fd);
+		print_error(what, target);
+	}
+	if (dir)
+		closedir(dir);
+}
+
+#else
+
+static void	report_leaks(t_cmd *cmd)
+{
+	(void)cmd;
+}
+
+#endif
+
+/* In a child about to exec: only the user's descriptors, cmd's
+ * redirections and the process substitutions are passed on */
+void	prepare_exec(t_cmd *cmd)
+{
+	if (g_shell.check_fds)
+		report_leaks(cmd);
+	seal_shell_fds();
+}
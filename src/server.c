@@ -0,0 +1,385 @@
+#include "../include/minishell.h"
+
+/*
+ * minishell --server SOCKET keeps one started shell, its environment, rc
+ * functions and hashed commands, and runs the command lines of clients
+ * connecting to the Unix socket, each in a fork of it. A client sends a
+ * version byte carrying its standard input, output and error and its
+ * working directory as SCM_RIGHTS, then the command line, then shuts its
+ * side down; the server answers with the status as an int once the
+ * command has finished. minishell --client SOCKET command is the client.
+ */
+
+# define SERVER_VERSION 1
+# define SERVER_BACKLOG 128
+# define REQUEST_FDS 4
+
+/* A client being served: the fork running its command, and the
+ * connection its status goes back on */
+typedef struct s_handler
+{
+	pid_t				pid;
+	int					conn;
+	int					pidfd;
+}	t_handler;
+
+typedef struct s_server
+{
+	int					sock;
+	t_handler			*handlers;
+	int					count;
+	int					cap;
+	struct pollfd		*polls;
+}	t_server;
+
+static int	socket_address(struct sockaddr_un *addr, char *path)
+{
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return (0);
+	}
+	strcpy(addr->sun_path, path);
+	return (1);
+}
+
+/* A socket file nobody listens on is left over and may go */
+static int	stale_socket(struct sockaddr_un *addr)
+{
+	int	fd;
+	int	stale;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return (0);
+	stale = connect(fd, (struct sockaddr *)addr, sizeof(*addr)) == -1
+		&& errno == ECONNREFUSED;
+	close(fd);
+	return (stale);
+}
+
+/* The listening socket, only reachable by the user running the server */
+static int	listen_on(char *path)
+{
+	struct sockaddr_un	addr;
+	mode_t				mask;
+	int					fd;
+	int					bound;
+
+	if (!socket_address(&addr, path))
+		return (-1);
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return (-1);
+	mask = umask(077);
+	bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (bound == -1 && errno == EADDRINUSE && stale_socket(&addr)
+		&& unlink(path) == 0)
+		bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (bound == -1 || listen(fd, SERVER_BACKLOG) == -1)
+	{
+		close(fd);
+		return (-1);
+	}
+	return (fd);
+}
+
+/* The version byte and the descriptors attached to it; *count of them */
+static int	receive_fds(int conn, int *fds, int *count)
+{
+	char			space[CMSG_SPACE(sizeof(int) * REQUEST_FDS)];
+	struct msghdr	msg;
+	struct iovec	iov;
+	struct cmsghdr	*cmsg;
+	char			version;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &version;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = space;
+	msg.msg_controllen = sizeof(space);
+	if (recvmsg(conn, &msg, MSG_CMSG_CLOEXEC) != 1
+		|| version != SERVER_VERSION)
+		return (0);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET
+		|| cmsg->cmsg_type != SCM_RIGHTS)
+		return (0);
+	*count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * *count);
+	return (*count >= 3);
+}
+
+/* In the fork serving conn: takes over the client's descriptors and
+ * directory, then runs its command line */
+static void	serve(t_server *s, int conn)
+{
+	t_buf	command;
+	char	*cwd;
+	int		fds[REQUEST_FDS];
+	int		count;
+	int		i;
+
+	close(s->sock);
+	i = -1;
+	while (++i < s->count)
+		close(s->handlers[i].conn);
+	signal(SIGTERM, SIG_DFL);
+	g_shell.interrupted = 0;
+	if (!receive_fds(conn, fds, &count))
+		exit(2);
+	buf_init(&command, 256);
+	read_all(conn, &command);
+	close(conn);
+	i = -1;
+	while (++i < 3)
+		dup2(fds[i], i);
+	dup3(STDIN_FILENO, g_shell.stdin_backup, O_CLOEXEC);
+	dup3(STDOUT_FILENO, g_shell.stdout_backup, O_CLOEXEC);
+	if (count > 3 && fchdir(fds[3]) == 0 && (cwd = getcwd(NULL, 0)))
+	{
+		set_env_value("PWD", cwd);
+		free(cwd);
+	}
+	while (count-- > 0)
+		if (fds[count] > STDERR_FILENO)
+			close(fds[count]);
+	exit(execute_line(command.data));
+}
+
+#ifdef __linux__
+
+/* Only the user running the server is served */
+static int	same_user(int conn)
+{
+	struct ucred	cred;
+	socklen_t		len;
+
+	len = sizeof(cred);
+	return (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0
+		&& cred.uid == geteuid());
+}
+
+#else
+
+static int	same_user(int conn)
+{
+	(void)conn;
+	return (1);
+}
+
+#endif
+
+static void	add_handler(t_server *s, pid_t pid, int conn)
+{
+	t_handler	*bigger;
+
+	if (s->count == s->cap)
+	{
+		s->cap = s->cap ? s->cap * 2 : 16;
+		bigger = safe_malloc(sizeof(t_handler) * s->cap);
+		if (s->count)
+			memcpy(bigger, s->handlers, sizeof(t_handler) * s->count);
+		free(s->handlers);
+		s->handlers = bigger;
+		free(s->polls);
+		s->polls = safe_malloc(sizeof(struct pollfd) * (s->cap + 1));
+	}
+	s->handlers[s->count].pid = pid;
+	s->handlers[s->count].conn = conn;
+	s->handlers[s->count].pidfd = open_pidfd(pid);
+	s->count++;
+}
+
+static void	accept_client(t_server *s)
+{
+	pid_t	pid;
+	int		conn;
+
+	conn = accept4(s->sock, NULL, NULL, SOCK_CLOEXEC);
+	if (conn == -1)
+		return ;
+	if (!same_user(conn))
+	{
+		close(conn);
+		return ;
+	}
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0)
+		serve(s, conn);
+	if (pid == -1)
+	{
+		print_error("fork", strerror(errno));
+		close(conn);
+		return ;
+	}
+	add_handler(s, pid, conn);
+}
+
+/* Answers the clients whose commands have finished */
+static void	finish_clients(t_server *s)
+{
+	t_handler	*h;
+	int			status;
+	int			i;
+
+	i = 0;
+	while (i < s->count)
+	{
+		h = &s->handlers[i];
+		if (!reap_child(h->pid, &status))
+		{
+			i++;
+			continue ;
+		}
+		send(h->conn, &status, sizeof(int), MSG_NOSIGNAL);
+		close(h->conn);
+		if (h->pidfd != -1)
+			close(h->pidfd);
+		*h = s->handlers[--s->count];
+	}
+}
+
+/* The socket and a pidfd per fork; a fork without one is polled for */
+static int	poll_server(t_server *s)
+{
+	int	timeout;
+	int	i;
+
+	s->polls[0].fd = s->sock;
+	s->polls[0].events = POLLIN;
+	timeout = -1;
+	i = -1;
+	while (++i < s->count)
+	{
+		s->polls[i + 1].fd = s->handlers[i].pidfd;
+		s->polls[i + 1].events = POLLIN;
+		if (s->handlers[i].pidfd == -1)
+			timeout = 50;
+	}
+	return (poll(s->polls, s->count + 1, timeout));
+}
+
+static void	stop_server(int sig)
+{
+	(void)sig;
+	g_shell.interrupted = 1;
+}
+
+/* Serves until SIGINT or SIGTERM; the socket file is removed then */
+int	run_server(char *path)
+{
+	struct sigaction	sa;
+	t_server			s;
+	int					ready;
+
+	memset(&s, 0, sizeof(t_server));
+	s.sock = listen_on(path);
+	if (s.sock == -1)
+	{
+		print_error(path, strerror(errno));
+		return (1);
+	}
+	s.polls = safe_malloc(sizeof(struct pollfd));
+	sa.sa_handler = stop_server;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sigaction(SIGTERM, &sa, NULL);
+	g_shell.interrupted = 0;
+	while (!g_shell.interrupted)
+	{
+		ready = poll_server(&s);
+		if (ready > 0 && (s.polls[0].revents & POLLIN))
+			accept_client(&s);
+		if (ready >= 0)
+			finish_clients(&s);
+	}
+	unlink(path);
+	close(s.sock);
+	s.sock = -1;
+	while (s.count > 0)
+		if (poll_server(&s) >= 0)
+			finish_clients(&s);
+	free(s.handlers);
+	free(s.polls);
+	return (0);
+}
+
+static int	send_request(int fd, char *command)
+{
+	char			space[CMSG_SPACE(sizeof(int) * REQUEST_FDS)];
+	struct msghdr	msg;
+	struct iovec	iov;
+	struct cmsghdr	*cmsg;
+	int				fds[REQUEST_FDS];
+	int				sent;
+
+	fds[0] = STDIN_FILENO;
+	fds[1] = STDOUT_FILENO;
+	fds[2] = STDERR_FILENO;
+	fds[3] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	memset(&msg, 0, sizeof(msg));
+	memset(space, 0, sizeof(space));
+	iov.iov_base = (char []){SERVER_VERSION};
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = space;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * (3 + (fds[3] != -1)));
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (3 + (fds[3] != -1)));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (3 + (fds[3] != -1)));
+	sent = sendmsg(fd, &msg, MSG_NOSIGNAL) == 1
+		&& send(fd, command, strlen(command), MSG_NOSIGNAL)
+		== (ssize_t)strlen(command);
+	if (fds[3] != -1)
+		close(fds[3]);
+	return (sent && shutdown(fd, SHUT_WR) == 0);
+}
+
+/*
+ * minishell --client SOCKET word...: the words, joined by spaces, run on
+ * the server with this process's descriptors and directory; its status
+ * is the command's.
+ */
+int	run_client(char *path, char **words)
+{
+	struct sockaddr_un	addr;
+	t_buf				command;
+	int					status;
+	int					fd;
+
+	if (!path || !*words)
+	{
+		print_error("--client", "usage: minishell --client socket command");
+		return (2);
+	}
+	buf_init(&command, 256);
+	while (*words)
+	{
+		buf_add_str(&command, *words++);
+		if (*words)
+			buf_add_char(&command, ' ');
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	status = -1;
+	if (fd != -1 && socket_address(&addr, path)
+		&& connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0
+		&& send_request(fd, command.data)
+		&& recv(fd, &status, sizeof(int), MSG_WAITALL) != sizeof(int))
+		errno = ECONNRESET;
+	if (status == -1)
+		print_error(path, strerror(errno));
+	if (fd != -1)
+		close(fd);
+	free(command.data);
+	return (status == -1 ? 1 : status);
+}
@@ -10,8 +10,9 @@ void	handle_sigint(int sig)
 	rl_replace_line("", 0);
 	rl_redisplay();
 	
-	/* Set exit status */
+	/* Set exit status, running loops stop at their next check */
 	g_shell.exit_status = 130;
+	g_shell.interrupted = 1;
 }
 
 void	handle_sigquit(int sig)
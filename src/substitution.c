@@ -0,0 +1,237 @@
+#include "../include/minishell.h"
+
+static void	procsub_child(t_cmd *cmd, char *command, int output,
+	int pipe_fds[2])
+{
+	t_procsub	*other;
+
+	/* Only the pipe end for this substitution stays open */
+	other = cmd->procsubs;
+	while (other)
+	{
+		if (other->fd != -1)
+			release_fd(other->fd);
+		other = other->next;
+	}
+	if (output)
+		dup2(pipe_fds[0], STDIN_FILENO);
+	else
+		dup2(pipe_fds[1], STDOUT_FILENO);
+	/* The nested command line starts from the current descriptors */
+	dup3(STDIN_FILENO, g_shell.stdin_backup, O_CLOEXEC);
+	dup3(STDOUT_FILENO, g_shell.stdout_backup, O_CLOEXEC);
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+	exit(execute_line(command));
+}
+
+/*
+ * Starts the producer (<(cmd)) or consumer (>(cmd)) of a process
+ * substitution, wired through a pipe so it runs concurrently with cmd,
+ * and returns the /dev/fd path cmd gets instead.
+ */
+char	*start_procsub(t_cmd *cmd, char *command, int output)
+{
+	t_procsub	*procsub;
+	int			pipe_fds[2];
+	int			keep;
+	char		path[32];
+
+	if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+	{
+		print_error("pipe", strerror(errno));
+		return (NULL);
+	}
+	procsub = safe_malloc(sizeof(t_procsub));
+	fflush(stdout);
+	procsub->pid = fork();
+	if (procsub->pid == 0)
+		procsub_child(cmd, command, output, pipe_fds);
+	keep = output ? pipe_fds[1] : pipe_fds[0];
+	close(output ? pipe_fds[0] : pipe_fds[1]);
+	procsub->fd = -1;
+	/* Keep the end out of the user range so redirections can't clobber
+	 * it; it is inherited, the command opens it through /dev/fd */
+	if (procsub->pid == -1)
+	{
+		print_error("fork", strerror(errno));
+		close(keep);
+	}
+	else
+		procsub->fd = shell_fd(keep, 1);
+	procsub->next = cmd->procsubs;
+	cmd->procsubs = procsub;
+	if (procsub->fd == -1)
+		return (NULL);
+	sprintf(path, "/dev/fd/%d", procsub->fd);
+	return (safe_strdup(path));
+}
+
+/* Drops the shell's copy of the pipe ends once the command has them */
+void	close_procsubs(t_cmd *cmd)
+{
+	t_procsub	*procsub;
+
+	procsub = cmd->procsubs;
+	while (procsub)
+	{
+		if (procsub->fd != -1)
+			release_fd(procsub->fd);
+		procsub->fd = -1;
+		procsub = procsub->next;
+	}
+}
+
+/* Reaps the substitutions of the last execution of cmd */
+void	wait_procsubs(t_cmd *cmd)
+{
+	t_procsub	*procsub;
+
+	close_procsubs(cmd);
+	procsub = cmd->procsubs;
+	while (procsub)
+	{
+		if (procsub->pid > 0)
+			wait_children(&procsub->pid, 1);
+		procsub = procsub->next;
+	}
+	free_procsubs(cmd->procsubs);
+	cmd->procsubs = NULL;
+}
+
+void	free_procsubs(t_procsub *procsubs)
+{
+	t_procsub	*next;
+
+	while (procsubs)
+	{
+		next = procsubs->next;
+		if (procsubs->fd != -1)
+			close(procsubs->fd);
+		free(procsubs);
+		procsubs = next;
+	}
+}
+
+/* Builtins without side effects on the shell, safe to run in-process */
+static int	is_capture_builtin(char *name)
+{
+	static char	*names[] = {"echo", "pwd", "env", "printf", "cat", NULL};
+	int			i;
+
+	i = 0;
+	while (names[i])
+	{
+		if (strcmp(names[i], name) == 0)
+			return (1);
+		i++;
+	}
+	return (0);
+}
+
+/*
+ * Runs a lone capture-safe builtin with stdout pointed at an anonymous
+ * memory file, so $(pwd) costs no fork. Returns 0 when the command isn't
+ * eligible and has to go through a subshell.
+ */
+static int	capture_builtin(char *command, t_buf *buf)
+{
+	t_token	*tokens;
+	t_node	*tree;
+	t_cmd	*cmd;
+	int		mem_fd;
+	int		saved;
+	int		failed;
+
+	tokens = lexer(command);
+	tree = tokens ? parser(tokens) : NULL;
+	free_tokens(tokens);
+	cmd = (tree && tree->type == NODE_PIPELINE && !tree->negate)
+		? tree->pipeline : NULL;
+	/* Decided on the literal command name, before anything is expanded */
+	if (!cmd || cmd->next || cmd->redirs || cmd->assignments || !cmd->words
+		|| !cmd->words->literal || !is_capture_builtin(cmd->words->literal)
+		|| (cmd->words->next && cmd->words->next->literal
+			&& strcmp(cmd->words->next->literal, "-v") == 0))
+	{
+		free_node(tree);
+		return (0);
+	}
+#ifdef __linux__
+	mem_fd = memfd_create("minishell-cmdsub", MFD_CLOEXEC);
+#else
+	mem_fd = -1;
+#endif
+	if (mem_fd == -1)
+	{
+		free_node(tree);
+		return (0);
+	}
+	/* A failed expansion fails the substitution, as the subshell's exit
+	 * would, and nothing outside it */
+	failed = g_shell.expand_failed;
+	g_shell.expand_failed = 0;
+	expand_cmd(cmd);
+	fflush(stdout);
+	saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, SHELL_FD_BASE);
+	dup2(mem_fd, STDOUT_FILENO);
+	if (g_shell.expand_failed)
+		g_shell.exit_status = 1;
+	else
+		g_shell.exit_status = execute_builtin(cmd);
+	g_shell.expand_failed = failed;
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+	lseek(mem_fd, 0, SEEK_SET);
+	read_all(mem_fd, buf);
+	close(mem_fd);
+	wait_procsubs(cmd);
+	free_node(tree);
+	return (1);
+}
+
+static void	capture_subshell(char *command, t_buf *buf)
+{
+	int		pipe_fds[2];
+	pid_t	pid;
+
+	if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+	{
+		print_error("pipe", strerror(errno));
+		return ;
+	}
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0)
+	{
+		close(pipe_fds[0]);
+		dup2(pipe_fds[1], STDOUT_FILENO);
+		dup3(STDIN_FILENO, g_shell.stdin_backup, O_CLOEXEC);
+		dup3(STDOUT_FILENO, g_shell.stdout_backup, O_CLOEXEC);
+		close(pipe_fds[1]);
+		exit(execute_line(command));
+	}
+	close(pipe_fds[1]);
+	if (pid == -1)
+		print_error("fork", strerror(errno));
+	else
+		read_all(pipe_fds[0], buf);
+	close(pipe_fds[0]);
+	if (pid > 0)
+		g_shell.exit_status = wait_children(&pid, 1);
+}
+
+/* Output of command, trailing newlines removed */
+char	*command_substitution(char *command)
+{
+	t_buf	buf;
+
+	buf_init(&buf, 256);
+	if (!capture_builtin(command, &buf))
+		capture_subshell(command, &buf);
+	while (buf.len > 0 && buf.data[buf.len - 1] == '\n')
+		buf.len--;
+	buf.data[buf.len] = '\0';
+	return (buf.data);
+}
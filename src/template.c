@@ -0,0 +1,296 @@
+#include "../include/minishell.h"
+
+/* Compilation state: pending literal text and the segment list tail */
+typedef struct s_compiler
+{
+	t_word				*word;
+	t_segment			**tail;
+	t_buf				literal;
+	int					literal_quoted;
+	int					has_literal;
+}	t_compiler;
+
+static void	add_segment(t_compiler *c, t_seg_type type, int quoted,
+	char *text)
+{
+	t_segment	*seg;
+
+	seg = safe_malloc(sizeof(t_segment));
+	seg->type = type;
+	seg->quoted = quoted;
+	seg->text = text;
+	seg->next = NULL;
+	*c->tail = seg;
+	c->tail = &seg->next;
+}
+
+static void	flush_literal(t_compiler *c)
+{
+	if (!c->has_literal)
+		return ;
+	add_segment(c, SEG_LITERAL, c->literal_quoted,
+		safe_strdup(c->literal.data));
+	c->literal.len = 0;
+	c->literal.data[0] = '\0';
+	c->literal_quoted = 0;
+	c->has_literal = 0;
+}
+
+static void	add_literal(t_compiler *c, char *str, size_t len, int quoted)
+{
+	/* Quoted text matches literally in patterns, keep it apart */
+	if (c->has_literal && c->literal_quoted != quoted)
+		flush_literal(c);
+	buf_add(&c->literal, str, len);
+	c->literal_quoted = quoted;
+	c->has_literal = 1;
+}
+
+static char	*substring(char *str, int start, int end)
+{
+	char	*sub;
+
+	sub = safe_malloc(end - start + 1);
+	strncpy(sub, str + start, end - start);
+	sub[end - start] = '\0';
+	return (sub);
+}
+
+/* Compiles the $ construct at raw[*i], returns 0 if it is a plain $ */
+static int	compile_dollar(t_compiler *c, char *raw, int *i, int quoted)
+{
+	char	*text;
+	int		start;
+	int		end;
+
+	start = *i + 1;
+	if (raw[start] == '(' && (text = extract_arithmetic(raw, &start)) != NULL)
+	{
+		flush_literal(c);
+		add_segment(c, SEG_ARITH, quoted, text);
+		*i = start;
+		return (1);
+	}
+	if (raw[start] == '(' || raw[start] == '{')
+	{
+		end = (raw[start] == '(') ? skip_parens(raw, start)
+			: skip_braces(raw, start);
+		if (end == -1)
+			return (0);
+		flush_literal(c);
+		add_segment(c, raw[start] == '(' ? SEG_COMMAND : SEG_PARAM, quoted,
+			substring(raw, start + 1, end));
+		*i = end + 1;
+		return (1);
+	}
+	end = start;
+	if (raw[end] && (strchr("?#@*", raw[end]) || isdigit(raw[end])))
+		end++;
+	else
+		while (isalnum(raw[end]) || raw[end] == '_')
+			end++;
+	if (end == start)
+		return (0);
+	flush_literal(c);
+	add_segment(c, SEG_VAR, quoted, substring(raw, start, end));
+	*i = end;
+	return (1);
+}
+
+/* Handles a backslash at raw[*i], in or out of double quotes */
+static void	compile_escape(t_compiler *c, char *raw, int *i, int in_dquote)
+{
+	if (!raw[*i + 1])
+		add_literal(c, "\\", 1, 1);
+	else if (!in_dquote || strchr("$\"\\`", raw[*i + 1]))
+		add_literal(c, raw + *i + 1, 1, 1);
+	else
+		add_literal(c, raw + *i, 2, 1);
+	*i += raw[*i + 1] ? 2 : 1;
+}
+
+static void	compile_segments(t_compiler *c, char *raw)
+{
+	int	in_dquote;
+	int	end;
+	int	i;
+
+	in_dquote = 0;
+	i = 0;
+	if (raw[0] == '~' && (raw[1] == '/' || raw[1] == '\0'))
+	{
+		add_segment(c, SEG_TILDE, 1, NULL);
+		i = 1;
+	}
+	while (raw[i])
+	{
+		if (raw[i] == '\'' && !in_dquote
+			&& (end = skip_quoted(raw, i)) != -1)
+		{
+			add_literal(c, raw + i + 1, end - i - 1, 1);
+			i = end + 1;
+		}
+		else if (raw[i] == '"')
+		{
+			/* Even "" leaves a (quoted, empty) literal behind */
+			add_literal(c, "", 0, 1);
+			in_dquote = !in_dquote;
+			i++;
+		}
+		else if (raw[i] == '\\')
+			compile_escape(c, raw, &i, in_dquote);
+		else if (raw[i] != '$' || !compile_dollar(c, raw, &i, in_dquote))
+			add_literal(c, raw + i++, 1, in_dquote);
+	}
+}
+
+static void	start_word(t_compiler *c, char *raw)
+{
+	c->word = safe_malloc(sizeof(t_word));
+	c->word->segments = NULL;
+	c->word->literal = NULL;
+	c->word->next = NULL;
+	c->tail = &c->word->segments;
+	buf_init(&c->literal, strlen(raw) + 1);
+	c->literal_quoted = 0;
+	c->has_literal = 0;
+}
+
+static t_word	*finish_word(t_compiler *c)
+{
+	t_segment	*seg;
+
+	flush_literal(c);
+	free(c->literal.data);
+	seg = c->word->segments;
+	if (seg && seg->type == SEG_LITERAL && !seg->next)
+		c->word->literal = seg->text;
+	return (c->word);
+}
+
+/*
+ * Compiles a raw word into literal, variable, ${...}, $(...), $((...)) and
+ * ~ segments, each flagged with its quote context. Single quotes suppress
+ * every expansion, double quotes only field splitting.
+ */
+static t_word	*compile_from(char *raw, int start)
+{
+	t_compiler	c;
+
+	start_word(&c, raw);
+	if (start > 0)
+	{
+		add_literal(&c, raw, start, 0);
+		flush_literal(&c);
+	}
+	compile_segments(&c, raw + start);
+	return (finish_word(&c));
+}
+
+t_word	*compile_word(char *raw)
+{
+	return (compile_from(raw, 0));
+}
+
+/* NAME=value: the value is compiled like a word of its own, so x=~/bin
+ * gets tilde expansion */
+t_word	*compile_assignment(char *raw)
+{
+	return (compile_from(raw, strchr(raw, '=') - raw + 1));
+}
+
+/* <(cmd) and >(cmd) become a word made of a single substitution */
+t_word	*compile_procsub(t_token *token)
+{
+	t_word		*word;
+	t_segment	*seg;
+
+	word = safe_malloc(sizeof(t_word));
+	seg = safe_malloc(sizeof(t_segment));
+	seg->type = (token->type == TOKEN_PROCSUB_IN) ? SEG_PROCSUB_IN
+		: SEG_PROCSUB_OUT;
+	seg->quoted = 1;
+	seg->text = safe_strdup(token->value);
+	seg->next = NULL;
+	word->segments = seg;
+	word->literal = NULL;
+	word->next = NULL;
+	return (word);
+}
+
+/*
+ * A heredoc body: taken as it is after a quoted delimiter, else expanded as
+ * between double quotes, except that quotes are plain text and a backslash
+ * only escapes $, ` and \ or joins lines.
+ */
+t_word	*compile_heredoc(char *body, int quoted)
+{
+	t_compiler	c;
+	int			i;
+
+	start_word(&c, body);
+	i = 0;
+	if (quoted)
+		add_literal(&c, body, strlen(body), 1);
+	while (!quoted && body[i])
+	{
+		if (body[i] == '\\' && body[i + 1] == '\n')
+			i += 2;
+		else if (body[i] == '\\' && body[i + 1]
+			&& strchr("$`\\", body[i + 1]))
+		{
+			add_literal(&c, body + i + 1, 1, 1);
+			i += 2;
+		}
+		else if (body[i] != '$' || !compile_dollar(&c, body, &i, 1))
+			add_literal(&c, body + i++, 1, 1);
+	}
+	return (finish_word(&c));
+}
+
+void	free_words(t_word *words)
+{
+	t_word		*next;
+	t_segment	*seg;
+	t_segment	*next_seg;
+
+	while (words)
+	{
+		next = words->next;
+		seg = words->segments;
+		while (seg)
+		{
+			next_seg = seg->next;
+			free(seg->text);
+			free(seg);
+			seg = next_seg;
+		}
+		free(words);
+		words = next;
+	}
+}
+
+/* Quote removal without expansion, as for heredoc delimiters */
+char	*remove_quotes(char *raw)
+{
+	t_buf	buf;
+	char	quote;
+	int		i;
+
+	buf_init(&buf, strlen(raw) + 1);
+	quote = 0;
+	i = 0;
+	while (raw[i])
+	{
+		if (!quote && (raw[i] == '\'' || raw[i] == '"'))
+			quote = raw[i];
+		else if (quote && raw[i] == quote)
+			quote = 0;
+		else if (raw[i] == '\\' && quote != '\'' && raw[i + 1])
+			buf_add_char(&buf, raw[++i]);
+		else
+			buf_add_char(&buf, raw[i]);
+		i++;
+	}
+	return (buf.data);
+}
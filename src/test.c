@@ -0,0 +1,306 @@
+#include "../include/minishell.h"
+
+/*
+ * test and [: up to four arguments are decided by their number as POSIX
+ * says, so [ ! = x ] compares strings; longer expressions go through a
+ * recursive descent with -a, -o, ! and parentheses. Every file test costs
+ * one stat() (lstat() for -h and -L) or one access check; errors have
+ * status 2.
+ */
+
+typedef struct s_test
+{
+	char				**args;
+	int					pos;
+	int					end;
+	int					error;
+}	t_test;
+
+static int	test_or(t_test *t);
+
+static int	test_error(t_test *t, char *arg, char *msg)
+{
+	t_buf	buf;
+
+	if (t->error)
+		return (0);
+	buf_init(&buf, 32);
+	buf_add_str(&buf, "test");
+	if (arg)
+	{
+		buf_add_str(&buf, ": ");
+		buf_add_str(&buf, arg);
+	}
+	print_error(buf.data, msg);
+	free(buf.data);
+	t->error = 1;
+	return (0);
+}
+
+static int	is_binary_op(char *op)
+{
+	static char	*ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt",
+		"-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL};
+	int			i;
+
+	i = 0;
+	while (ops[i] && strcmp(ops[i], op) != 0)
+		i++;
+	return (ops[i] != NULL);
+}
+
+static int	is_unary_op(char *op)
+{
+	return (op[0] == '-' && op[1] && !op[2]
+		&& strchr("bcdefghknprstuvwxzGLOS", op[1]));
+}
+
+/* Whether args[pos + 1] is a binary operator with an operand after it */
+static int	binary_ahead(t_test *t)
+{
+	return (t->pos + 2 < t->end && is_binary_op(t->args[t->pos + 1]));
+}
+
+/* A whole decimal integer, blanks around it allowed */
+static int	parse_integer(t_test *t, char *str, long long *value)
+{
+	char	*end;
+
+	errno = 0;
+	*value = strtoll(str, &end, 10);
+	while (isspace(*end))
+		end++;
+	if (errno || end == str || *end || !*str)
+		return (test_error(t, str, "integer expression expected"));
+	return (1);
+}
+
+static int	file_type(struct stat *st, char op)
+{
+	if (op == 'b')
+		return (S_ISBLK(st->st_mode));
+	if (op == 'c')
+		return (S_ISCHR(st->st_mode));
+	if (op == 'd')
+		return (S_ISDIR(st->st_mode));
+	if (op == 'f')
+		return (S_ISREG(st->st_mode));
+	if (op == 'p')
+		return (S_ISFIFO(st->st_mode));
+	if (op == 'S')
+		return (S_ISSOCK(st->st_mode));
+	if (op == 'h' || op == 'L')
+		return (S_ISLNK(st->st_mode));
+	if (op == 's')
+		return (st->st_size > 0);
+	if (op == 'g')
+		return ((st->st_mode & S_ISGID) != 0);
+	if (op == 'u')
+		return ((st->st_mode & S_ISUID) != 0);
+	if (op == 'k')
+		return ((st->st_mode & S_ISVTX) != 0);
+	if (op == 'O')
+		return (st->st_uid == geteuid());
+	if (op == 'G')
+		return (st->st_gid == getegid());
+	return (1);
+}
+
+static int	unary_test(t_test *t, char op, char *arg)
+{
+	struct stat	st;
+	long long	fd;
+
+	if (op == 'z' || op == 'n')
+		return ((*arg == '\0') == (op == 'z'));
+	if (op == 'v')
+		return (get_env_value(arg) != NULL);
+	if (op == 't')
+		return (parse_integer(t, arg, &fd) && fd >= 0 && fd <= INT_MAX
+			&& isatty(fd));
+	if (op == 'r' || op == 'w' || op == 'x')
+		return (faccessat(AT_FDCWD, arg, op == 'r' ? R_OK : op == 'w' ? W_OK
+				: X_OK, AT_EACCESS) == 0);
+	if ((op == 'h' || op == 'L') ? lstat(arg, &st) : stat(arg, &st))
+		return (0);
+	return (file_type(&st, op));
+}
+
+/* -nt -ot -ef: a missing file is older than any existing one */
+static int	file_compare(char *left, char *op, char *right)
+{
+	struct stat	a;
+	struct stat	b;
+	int			has_a;
+	int			has_b;
+
+	has_a = (stat(left, &a) == 0);
+	has_b = (stat(right, &b) == 0);
+	if (op[1] == 'e')
+		return (has_a && has_b && a.st_dev == b.st_dev
+			&& a.st_ino == b.st_ino);
+	if (!has_a || !has_b)
+		return (op[1] == 'n' ? has_a : has_b);
+	if (a.st_mtim.tv_sec != b.st_mtim.tv_sec)
+		return (op[1] == 'n' ? a.st_mtim.tv_sec > b.st_mtim.tv_sec
+			: a.st_mtim.tv_sec < b.st_mtim.tv_sec);
+	return (op[1] == 'n' ? a.st_mtim.tv_nsec > b.st_mtim.tv_nsec
+		: a.st_mtim.tv_nsec < b.st_mtim.tv_nsec);
+}
+
+static int	binary_test(t_test *t, char *left, char *op, char *right)
+{
+	long long	a;
+	long long	b;
+
+	if (op[0] == '<' || op[0] == '>')
+		return (op[0] == '<' ? strcmp(left, right) < 0
+			: strcmp(left, right) > 0);
+	if (op[0] != '-')
+		return ((strcmp(left, right) == 0) == (op[0] != '!'));
+	if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0
+		|| strcmp(op, "-ef") == 0)
+		return (file_compare(left, op, right));
+	if (!parse_integer(t, left, &a) || !parse_integer(t, right, &b))
+		return (0);
+	if (op[1] == 'e')
+		return (a == b);
+	if (op[1] == 'n')
+		return (a != b);
+	if (op[1] == 'l')
+		return (op[2] == 't' ? a < b : a <= b);
+	return (op[2] == 't' ? a > b : a >= b);
+}
+
+static int	test_primary(t_test *t)
+{
+	char	**args;
+	int		result;
+
+	args = t->args + t->pos;
+	if (t->pos >= t->end)
+		return (test_error(t, NULL, "argument expected"));
+	if (binary_ahead(t))
+	{
+		t->pos += 3;
+		return (binary_test(t, args[0], args[1], args[2]));
+	}
+	if (strcmp(args[0], "(") == 0 && t->pos + 1 < t->end)
+	{
+		t->pos++;
+		result = test_or(t);
+		if (t->pos >= t->end || strcmp(t->args[t->pos], ")") != 0)
+			return (test_error(t, NULL, "`)' expected"));
+		t->pos++;
+		return (result);
+	}
+	if (is_unary_op(args[0]) && t->pos + 1 < t->end)
+	{
+		t->pos += 2;
+		return (unary_test(t, args[0][1], args[1]));
+	}
+	t->pos++;
+	return (args[0][0] != '\0');
+}
+
+static int	test_not(t_test *t)
+{
+	if (t->pos < t->end && strcmp(t->args[t->pos], "!") == 0
+		&& t->pos + 1 < t->end && !binary_ahead(t))
+	{
+		t->pos++;
+		return (!test_not(t));
+	}
+	return (test_primary(t));
+}
+
+static int	test_and(t_test *t)
+{
+	int	result;
+
+	result = test_not(t);
+	while (t->pos < t->end && strcmp(t->args[t->pos], "-a") == 0)
+	{
+		t->pos++;
+		result = test_not(t) && result;
+	}
+	return (result);
+}
+
+static int	test_or(t_test *t)
+{
+	int	result;
+
+	result = test_and(t);
+	while (t->pos < t->end && strcmp(t->args[t->pos], "-o") == 0)
+	{
+		t->pos++;
+		result = test_and(t) || result;
+	}
+	return (result);
+}
+
+/* The POSIX rules for n = 1 to 4 arguments */
+static int	test_count(t_test *t, int n)
+{
+	char	**a;
+
+	a = t->args + t->pos;
+	if (n == 1 || (n == 3 && strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0))
+	{
+		t->pos = t->end;
+		return (a[n == 3][0] != '\0');
+	}
+	if (n == 3 && (strcmp(a[1], "-a") == 0 || strcmp(a[1], "-o") == 0))
+	{
+		t->pos = t->end;
+		if (a[1][1] == 'a')
+			return (a[0][0] && a[2][0]);
+		return (a[0][0] || a[2][0]);
+	}
+	if (n == 3 && is_binary_op(a[1]))
+		return (test_or(t));
+	if (n > 1 && strcmp(a[0], "!") == 0)
+	{
+		t->pos++;
+		return (!test_count(t, n - 1));
+	}
+	if (n == 4 && strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0)
+	{
+		t->pos++;
+		t->end--;
+		return (test_count(t, 2));
+	}
+	if (n == 2 && !is_unary_op(a[0]))
+		return (test_error(t, a[0], "unary operator expected"));
+	return (test_or(t));
+}
+
+/* test expr and [ expr ], status 0 for true, 1 for false, 2 on error */
+int	builtin_test(char **args)
+{
+	t_test	t;
+	int		result;
+
+	t.args = args + 1;
+	t.end = array_length(t.args);
+	t.pos = 0;
+	t.error = 0;
+	if (strcmp(args[0], "[") == 0)
+	{
+		if (t.end == 0 || strcmp(t.args[t.end - 1], "]") != 0)
+		{
+			print_error("[", "missing `]'");
+			return (2);
+		}
+		t.end--;
+	}
+	if (t.end == 0)
+		return (1);
+	result = (t.end <= 4) ? test_count(&t, t.end) : test_or(&t);
+	if (!t.error && t.pos < t.end)
+		test_error(&t, t.args[t.pos], "too many arguments");
+	if (t.error)
+		return (2);
+	return (!result);
+}
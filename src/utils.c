@@ -134,6 +134,33 @@ char	**split_string(char *str, char delimiter)
 	return (result);
 }
 
+/* The directories of a PATH value; an empty entry is the current one */
+char	**split_path(char *path)
+{
+	char	**dirs;
+	char	*end;
+	int		count;
+	int		i;
+
+	count = 1;
+	end = path;
+	while ((end = strchr(end, ':')))
+	{
+		count++;
+		end++;
+	}
+	dirs = safe_malloc(sizeof(char *) * (count + 1));
+	i = 0;
+	while (i < count)
+	{
+		end = strchrnul(path, ':');
+		dirs[i++] = end > path ? strndup(path, end - path) : safe_strdup(".");
+		path = end + (*end == ':');
+	}
+	dirs[i] = NULL;
+	return (dirs);
+}
+
 char	*trim_whitespace(char *str)
 {
 	char	*start;
@@ -193,6 +220,128 @@ int	array_length(char **array)
 	return (len);
 }
 
+/* The value of option letter (**args)[*i], attached or the next word;
+ * *i is moved to the end of the word */
+char	*option_value(char ***args, int *i)
+{
+	char	*value;
+
+	value = **args + *i + 1;
+	if (!*value)
+	{
+		if (!(*args)[1])
+			return (NULL);
+		value = *++(*args);
+	}
+	*i = strlen(**args) - 1;
+	return (value);
+}
+
+/* djb2, for the shell's hash tables */
+unsigned int	hash_string(char *str)
+{
+	unsigned int	hash;
+
+	hash = 5381;
+	while (*str)
+		hash = hash * 33 + (unsigned char)*str++;
+	return (hash);
+}
+
+void	buf_init(t_buf *buf, size_t cap)
+{
+	if (cap < 16)
+		cap = 16;
+	buf->data = safe_malloc(cap);
+	buf->data[0] = '\0';
+	buf->len = 0;
+	buf->cap = cap;
+}
+
+/* Makes room for extra more bytes plus the terminator, doubling the size */
+void	buf_reserve(t_buf *buf, size_t extra)
+{
+	size_t	cap;
+
+	if (buf->len + extra + 1 <= buf->cap)
+		return ;
+	cap = buf->cap;
+	while (buf->len + extra + 1 > cap)
+		cap *= 2;
+	buf->data = realloc(buf->data, cap);
+	if (!buf->data)
+		exit_error("realloc failed");
+	buf->cap = cap;
+}
+
+void	buf_add(t_buf *buf, char *str, size_t len)
+{
+	buf_reserve(buf, len);
+	memcpy(buf->data + buf->len, str, len);
+	buf->len += len;
+	buf->data[buf->len] = '\0';
+}
+
+void	buf_add_str(t_buf *buf, char *str)
+{
+	buf_add(buf, str, strlen(str));
+}
+
+void	buf_add_char(t_buf *buf, char c)
+{
+	buf_reserve(buf, 1);
+	buf->data[buf->len++] = c;
+	buf->data[buf->len] = '\0';
+}
+
+/* Appends everything readable from fd with large reads */
+void	read_all(int fd, t_buf *buf)
+{
+	ssize_t	n;
+
+	while (1)
+	{
+		buf_reserve(buf, 65536);
+		n = read(fd, buf->data + buf->len, buf->cap - buf->len - 1);
+		if (n == -1 && errno == EINTR)
+			continue ;
+		if (n <= 0)
+			break ;
+		buf->len += n;
+	}
+	buf->data[buf->len] = '\0';
+}
+
+void	argv_init(t_argv *argv, int cap)
+{
+	if (cap < 4)
+		cap = 4;
+	argv->items = safe_malloc(sizeof(char *) * cap);
+	argv->items[0] = NULL;
+	argv->count = 0;
+	argv->cap = cap;
+}
+
+/* Makes room for extra more strings with a single reallocation */
+void	argv_reserve(t_argv *argv, int extra)
+{
+	if (argv->count + extra + 1 <= argv->cap)
+		return ;
+	while (argv->count + extra + 1 > argv->cap)
+		argv->cap *= 2;
+	argv->items = realloc(argv->items, sizeof(char *) * argv->cap);
+	if (!argv->items)
+		exit_error("realloc failed");
+}
+
+/* Appends str (taking ownership), keeping the vector NULL-terminated */
+void	argv_push(t_argv *argv, char *str)
+{
+	argv_reserve(argv, 1);
+	argv->items[argv->count++] = str;
+	argv->items[argv->count] = NULL;
+}
+
 void	print_error(char *cmd, char *msg)
 {
 	write(STDERR_FILENO, "minishell: ", 11);
@@ -224,9 +373,16 @@ int	syntax_error(char *token)
 
 void	cleanup_shell(void)
 {
+	save_history();
 	free_env();
+	free_arithmetic_cache();
+	free_functions();
+	forget_paths();
+	free_builtins();
 	if (g_shell.pids)
 		free(g_shell.pids);
+	close_user_fds();
+	free(g_shell.inherited.fds);
 	close(g_shell.stdin_backup);
 	close(g_shell.stdout_backup);
 }
@@ -0,0 +1,820 @@
+#include "../include/minishell.h"
+
+/* Control stack entries, popped in order by break, continue and return */
+typedef enum e_entry_type
+{
+	ENTRY_LOOP,
+	ENTRY_CASE,
+	ENTRY_REDIR
+}	t_entry_type;
+
+typedef struct s_entry
+{
+	t_entry_type		type;
+	int					brk;
+	int					cont;
+	int					status;
+	char				**items;
+	int					count;
+	int					next;
+	char				*subject;
+	t_fdsave			*saves;
+	t_procsub			*procsubs;
+}	t_entry;
+
+/*
+ * Machine state of one vm_execute() call. cmd, args and assigns are the
+ * command being assembled by BEGIN/ASSIGN/EXPAND/REDIRECT; forked is set
+ * in pipeline stages and subshells, which end with EXIT.
+ */
+typedef struct s_vm
+{
+	t_program			*prog;
+	int					*code;
+	int					pc;
+	t_cmd				cmd;
+	t_argv				args;
+	t_argv				assigns;
+	t_entry				*stack;
+	int					depth;
+	int					cap;
+	int					forked;
+	int					prev_fd;
+	int					stage;
+	pid_t				*pids;
+	int					pids_cap;
+	t_plan				*plan;
+	t_stage				*planned;
+}	t_vm;
+
+typedef int				(*t_handler)(t_vm *vm);
+
+static t_entry	*push_entry(t_vm *vm, t_entry_type type)
+{
+	t_entry	*bigger;
+
+	if (vm->depth == vm->cap)
+	{
+		vm->cap *= 2;
+		bigger = safe_malloc(sizeof(t_entry) * vm->cap);
+		memcpy(bigger, vm->stack, sizeof(t_entry) * vm->depth);
+		free(vm->stack);
+		vm->stack = bigger;
+	}
+	memset(&vm->stack[vm->depth], 0, sizeof(t_entry));
+	vm->stack[vm->depth].type = type;
+	return (&vm->stack[vm->depth++]);
+}
+
+static void	pop_entry(t_vm *vm)
+{
+	t_entry	*entry;
+	t_cmd	owner;
+
+	entry = &vm->stack[--vm->depth];
+	if (entry->type == ENTRY_LOOP)
+	{
+		free_string_array(entry->items);
+		g_shell.loop_depth--;
+	}
+	else if (entry->type == ENTRY_CASE)
+		free(entry->subject);
+	else
+	{
+		restore_redirections(entry->saves);
+		owner.procsubs = entry->procsubs;
+		wait_procsubs(&owner);
+	}
+}
+
+static void	clear_argv(t_argv *argv)
+{
+	int	i;
+
+	i = 0;
+	while (i < argv->count)
+		free(argv->items[i++]);
+	argv->count = 0;
+	argv->items[0] = NULL;
+}
+
+/* Drops the command being assembled */
+static void	clear_command(t_vm *vm)
+{
+	clear_argv(&vm->args);
+	clear_argv(&vm->assigns);
+	free_string_array(vm->cmd.args);
+	vm->cmd.args = NULL;
+	free_string_array(vm->cmd.assigns);
+	vm->cmd.assigns = NULL;
+	vm->cmd.substituted = 0;
+	free_redirs(vm->cmd.redirs);
+	vm->cmd.redirs = NULL;
+	vm->cmd.arith = NULL;
+}
+
+/*
+ * Called once break, continue, return or Ctrl-C is pending: unwinds the
+ * control stack to the loop concerned and jumps there. Returns 0 when
+ * vm_execute() itself has to return.
+ */
+static int	unwind(t_vm *vm)
+{
+	t_entry	*loop;
+	int		n;
+
+	if (g_shell.interrupted || g_shell.returning)
+	{
+		while (vm->depth > 0)
+			pop_entry(vm);
+		return (0);
+	}
+	n = g_shell.breaking ? g_shell.breaking : g_shell.continuing;
+	while (vm->depth > 0 && !(vm->stack[vm->depth - 1].type == ENTRY_LOOP
+			&& --n == 0))
+		pop_entry(vm);
+	if (vm->depth > 0)
+	{
+		loop = &vm->stack[vm->depth - 1];
+		loop->status = g_shell.exit_status;
+		vm->pc = g_shell.breaking ? loop->brk : loop->cont;
+	}
+	g_shell.breaking = 0;
+	g_shell.continuing = 0;
+	return (1);
+}
+
+static int	check_unwind(t_vm *vm)
+{
+	if (g_shell.breaking || g_shell.continuing || g_shell.returning
+		|| g_shell.interrupted || timeout_stops())
+		return (unwind(vm));
+	return (1);
+}
+
+/*
+ * An expansion of the command failed: it isn't run, and as in bash that
+ * ends a shell that isn't interactive, and the rest of the command line
+ * in one that is.
+ */
+static int	expansion_failed(t_vm *vm)
+{
+	g_shell.expand_failed = 0;
+	g_shell.exit_status = 1;
+	clear_command(vm);
+	if (g_shell.interactive != getpid())
+	{
+		fflush(stdout);
+		cleanup_shell();
+		exit(1);
+	}
+	g_shell.interrupted = 1;
+	return (unwind(vm));
+}
+
+/* SPAWN, BUILTIN and ARITH: runs the assembled command. The last command
+ * of a forked stage replaces the process instead of forking again */
+static int	run(t_vm *vm, int builtin)
+{
+	if (g_shell.expand_failed)
+		return (expansion_failed(vm));
+	if (vm->args.count > 0)
+	{
+		vm->cmd.args = vm->args.items;
+		argv_init(&vm->args, 8);
+	}
+	if (vm->assigns.count > 0)
+	{
+		vm->cmd.assigns = vm->assigns.items;
+		argv_init(&vm->assigns, 4);
+	}
+	if (vm->forked && vm->code[vm->pc] == OP_EXIT && vm->planned)
+		g_shell.exit_status = exec_planned(&vm->cmd, vm->planned);
+	else if (vm->forked && vm->code[vm->pc] == OP_EXIT)
+		g_shell.exit_status = exec_command(&vm->cmd);
+	else
+		g_shell.exit_status = run_command(&vm->cmd, builtin);
+	if (g_shell.expand_failed)
+		return (expansion_failed(vm));
+	clear_command(vm);
+	return (check_unwind(vm));
+}
+
+static int	op_halt(t_vm *vm)
+{
+	(void)vm;
+	return (0);
+}
+
+static int	op_jump(t_vm *vm)
+{
+	vm->pc = vm->code[vm->pc];
+	return (1);
+}
+
+static int	op_branch_ok(t_vm *vm)
+{
+	vm->pc = (g_shell.exit_status == 0) ? vm->code[vm->pc] : vm->pc + 1;
+	return (1);
+}
+
+static int	op_branch_fail(t_vm *vm)
+{
+	vm->pc = (g_shell.exit_status != 0) ? vm->code[vm->pc] : vm->pc + 1;
+	return (1);
+}
+
+static int	op_not(t_vm *vm)
+{
+	(void)vm;
+	g_shell.exit_status = !g_shell.exit_status;
+	return (1);
+}
+
+static int	op_status(t_vm *vm)
+{
+	g_shell.exit_status = vm->code[vm->pc++];
+	return (1);
+}
+
+static int	op_begin(t_vm *vm)
+{
+	clear_command(vm);
+	g_shell.expand_failed = 0;
+	return (1);
+}
+
+static int	op_expand(t_vm *vm)
+{
+	expand_word(program_word(vm->prog, vm->code[vm->pc++]), &vm->args,
+		&vm->cmd);
+	return (1);
+}
+
+/* NAME=value, expanded without field splitting. NAME+=value becomes
+ * NAME=value with the current value in front */
+/*
+ * Assignments are expanded left to right, each with the ones before it in
+ * effect, as x=1 y=$x wants; they are only in effect for that, and the
+ * command's words are expanded without them.
+ */
+static int	op_assign(t_vm *vm)
+{
+	t_local	*earlier;
+	char	*assign;
+	char	*equals;
+	t_buf	buf;
+
+	earlier = push_assignments(vm->assigns.items, 0);
+	assign = expand_word_string(program_word(vm->prog, vm->code[vm->pc++]),
+			&vm->cmd);
+	equals = strchr(assign, '=');
+	if (equals[-1] == '+')
+	{
+		equals[-1] = '\0';
+		buf_init(&buf, strlen(assign) + strlen(equals) + 1);
+		buf_add_str(&buf, assign);
+		buf_add_char(&buf, '=');
+		if (get_env_value(assign))
+			buf_add_str(&buf, get_env_value(assign));
+		buf_add_str(&buf, equals + 1);
+		free(assign);
+		assign = buf.data;
+	}
+	restore_locals(earlier);
+	argv_push(&vm->assigns, assign);
+	return (1);
+}
+
+/* a=(...) clears the array first, a+=(...) and a[key]=value don't */
+static int	op_array(t_vm *vm)
+{
+	t_array	*arr;
+
+	arr = make_array(vm->prog->strings + vm->code[vm->pc], 0);
+	if (!vm->code[vm->pc + 1])
+		clear_array(arr);
+	vm->pc += 2;
+	return (1);
+}
+
+/* A plain element of a=(...): expanded into fields like an argument */
+static int	op_array_add(t_vm *vm)
+{
+	t_array	*arr;
+	t_argv	fields;
+	char	*name;
+	int		i;
+
+	name = vm->prog->strings + vm->code[vm->pc];
+	argv_init(&fields, 4);
+	expand_word(program_word(vm->prog, vm->code[vm->pc + 1]), &fields,
+		&vm->cmd);
+	vm->pc += 2;
+	arr = make_array(name, 0);
+	if (arr->assoc && fields.count > 0)
+		print_error(name, "must use subscript when assigning associative array");
+	i = 0;
+	while (i < fields.count)
+	{
+		if (arr->assoc)
+			free(fields.items[i++]);
+		else
+			array_push(arr, fields.items[i++]);
+	}
+	free(fields.items);
+	return (1);
+}
+
+/* [key]=value and [key]+=value */
+static int	op_array_key(t_vm *vm)
+{
+	t_array	*arr;
+	char	*name;
+	char	*key;
+	char	*value;
+	char	*old;
+	char	*joined;
+
+	name = vm->prog->strings + vm->code[vm->pc];
+	key = expand_word_string(program_word(vm->prog, vm->code[vm->pc + 1]),
+			&vm->cmd);
+	value = expand_word_string(program_word(vm->prog, vm->code[vm->pc + 2]),
+			&vm->cmd);
+	arr = make_array(name, 0);
+	if (vm->code[vm->pc + 3])
+	{
+		old = array_value(name, key, 0);
+		if (old)
+		{
+			joined = join_strings(old, value);
+			free(old);
+			free(value);
+			value = joined;
+		}
+	}
+	vm->pc += 4;
+	/* A bad subscript fails the assignment command */
+	if (!array_store(arr, key, value))
+	{
+		g_shell.exit_status = 1;
+		vm->cmd.substituted = 1;
+	}
+	free(key);
+	return (1);
+}
+
+static int	op_redirect(t_vm *vm)
+{
+	t_redir	*redir;
+	t_redir	**tail;
+	t_word	*word;
+
+	redir = create_redir(vm->code[vm->pc], vm->code[vm->pc + 1], NULL);
+	word = program_word(vm->prog, vm->code[vm->pc + 2]);
+	vm->pc += 3;
+	redir->target = expand_word_string(word, &vm->cmd);
+	tail = &vm->cmd.redirs;
+	while (*tail)
+		tail = &(*tail)->next;
+	*tail = redir;
+	return (1);
+}
+
+static int	op_spawn(t_vm *vm)
+{
+	return (run(vm, -1));
+}
+
+static int	op_builtin(t_vm *vm)
+{
+	int	builtin;
+
+	builtin = vm->code[vm->pc];
+	vm->pc += 2;
+	return (run(vm, builtin));
+}
+
+static int	op_arith(t_vm *vm)
+{
+	vm->cmd.arith = vm->prog->strings + vm->code[vm->pc++];
+	return (run(vm, -1));
+}
+
+
+/* A forked child leaves the parent's loops and pipeline behind */
+static void	enter_child(t_vm *vm)
+{
+	vm->depth = 0;
+	vm->forked = 1;
+	vm->prev_fd = -1;
+	vm->stage = 0;
+	vm->planned = NULL;
+	g_shell.loop_depth = 0;
+}
+
+/* A byte count with an optional k, m or g suffix, -1 if it isn't one */
+long	parse_size(char *str)
+{
+	char	*end;
+	long	size;
+	long	unit;
+
+	errno = 0;
+	size = strtol(str, &end, 10);
+	if (end == str || errno || size < 0)
+		return (-1);
+	unit = 1;
+	if (*end == 'k' || *end == 'K')
+		unit = 1024;
+	else if (*end == 'm' || *end == 'M')
+		unit = 1048576;
+	else if (*end == 'g' || *end == 'G')
+		unit = 1073741824;
+	end += (unit > 1);
+	if (*end || size > LONG_MAX / unit)
+		return (-1);
+	return (size * unit);
+}
+
+/*
+ * Capacity of the pipes between pipeline stages: $PIPESIZE, else the
+ * --pipe-size default, capped at /proc/sys/fs/pipe-max-size. 0 leaves the
+ * kernel's 64 KiB.
+ */
+static long	pipe_capacity(void)
+{
+	static long	max_size;
+	char		buf[32];
+	char		*value;
+	long		size;
+	int			fd;
+
+	value = get_env_value("PIPESIZE");
+	size = g_shell.pipe_size;
+	if (value && *value && (size = parse_size(value)) < 0)
+		print_error("PIPESIZE", "invalid size");
+	if (size <= 0)
+		return (0);
+	if (max_size == 0)
+	{
+		max_size = 1048576;
+		fd = open("/proc/sys/fs/pipe-max-size", O_RDONLY | O_CLOEXEC);
+		if (fd != -1 && read(fd, buf, sizeof(buf) - 1) > 0 && atol(buf) > 0)
+			max_size = atol(buf);
+		if (fd != -1)
+			close(fd);
+	}
+	return (size < max_size ? size : max_size);
+}
+
+/* Records the pid of a stage, -1 when it could not be forked */
+static void	add_stage(t_vm *vm, pid_t pid)
+{
+	pid_t	*bigger;
+
+	if (vm->stage == vm->pids_cap)
+	{
+		vm->pids_cap = vm->pids_cap ? vm->pids_cap * 2 : 8;
+		bigger = safe_malloc(sizeof(pid_t) * vm->pids_cap);
+		if (vm->stage)
+			memcpy(bigger, vm->pids, sizeof(pid_t) * vm->stage);
+		free(vm->pids);
+		vm->pids = bigger;
+	}
+	vm->pids[vm->stage++] = pid;
+}
+
+/*
+ * Forks one stage: the child runs on into the stage, the parent goes to
+ * the next PIPE. Only the last stage (followed by WAIT) gets no pipe. The
+ * first PIPE plans the whole pipeline; a stage that failed in planning
+ * isn't forked, its pipe is closed as if it had exited.
+ */
+static int	op_pipe(t_vm *vm)
+{
+	t_stage	*stage;
+	int		fds[2];
+	int		next;
+	int		last;
+	long	capacity;
+	pid_t	pid;
+
+	if (vm->stage == 0)
+	{
+		free_plan(vm->plan);
+		vm->plan = plan_pipeline(vm->prog, vm->pc - 1);
+	}
+	stage = &vm->plan->stages[vm->stage];
+	next = vm->code[vm->pc++];
+	last = (vm->code[next] == OP_WAIT);
+	if (!last && pipe2(fds, O_CLOEXEC) == -1)
+	{
+		print_error("pipe", strerror(errno));
+		last = 1;
+	}
+	capacity = last ? 0 : pipe_capacity();
+	if (capacity > 0)
+		fcntl(fds[1], F_SETPIPE_SZ, capacity);
+	fflush(stdout);
+	pid = stage->status ? -1 : fork();
+	if (pid == 0)
+	{
+		place_stage(vm->stage);
+		keep_stage(vm->plan, vm->stage);
+		if (vm->prev_fd != -1)
+		{
+			dup2(vm->prev_fd, STDIN_FILENO);
+			close(vm->prev_fd);
+		}
+		if (!last)
+		{
+			dup2(fds[1], STDOUT_FILENO);
+			close(fds[1]);
+			close(fds[0]);
+		}
+		enter_child(vm);
+		vm->planned = stage->planned ? stage : NULL;
+		return (1);
+	}
+	if (pid == -1 && !stage->status)
+		print_error("fork", strerror(errno));
+	close_stage(stage);
+	if (vm->prev_fd != -1)
+		close(vm->prev_fd);
+	vm->prev_fd = -1;
+	if (!last)
+	{
+		close(fds[1]);
+		vm->prev_fd = fds[0];
+	}
+	add_stage(vm, pid);
+	vm->pc = next;
+	return (1);
+}
+
+/* All the stages are waited for together, $? is the last one's */
+static int	op_wait(t_vm *vm)
+{
+	g_shell.exit_status = wait_children(vm->pids, vm->stage);
+	if (vm->plan && vm->plan->stages[vm->plan->count - 1].status)
+		g_shell.exit_status = vm->plan->stages[vm->plan->count - 1].status;
+	free_plan(vm->plan);
+	vm->plan = NULL;
+	vm->stage = 0;
+	return (check_unwind(vm));
+}
+
+static int	op_exit(t_vm *vm)
+{
+	(void)vm;
+	fflush(stdout);
+	exit(g_shell.exit_status);
+}
+
+static int	op_subshell(t_vm *vm)
+{
+	pid_t	pid;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0)
+	{
+		vm->pc++;
+		enter_child(vm);
+		return (1);
+	}
+	vm->pc = vm->code[vm->pc];
+	g_shell.exit_status = 1;
+	if (pid == -1)
+		print_error("fork", strerror(errno));
+	else
+		g_shell.exit_status = wait_children(&pid, 1);
+	return (check_unwind(vm));
+}
+
+/* Redirections of a compound command stay applied until POP_REDIR */
+static int	op_push_redir(t_vm *vm)
+{
+	t_entry	*entry;
+
+	if (g_shell.expand_failed)
+		return (expansion_failed(vm));
+	entry = push_entry(vm, ENTRY_REDIR);
+	entry->procsubs = vm->cmd.procsubs;
+	vm->cmd.procsubs = NULL;
+	if (!apply_redirections(vm->cmd.redirs, &entry->saves))
+	{
+		pop_entry(vm);
+		g_shell.exit_status = 1;
+		vm->pc = vm->code[vm->pc];
+	}
+	else
+		vm->pc++;
+	clear_command(vm);
+	return (1);
+}
+
+static int	op_pop_redir(t_vm *vm)
+{
+	pop_entry(vm);
+	return (1);
+}
+
+/* The expanded words (for loops) become the list to iterate over */
+static int	op_loop(t_vm *vm)
+{
+	t_entry	*entry;
+
+	if (g_shell.expand_failed)
+		return (expansion_failed(vm));
+	entry = push_entry(vm, ENTRY_LOOP);
+	entry->brk = vm->code[vm->pc];
+	entry->cont = vm->code[vm->pc + 1];
+	vm->pc += 2;
+	entry->items = vm->args.items;
+	entry->count = vm->args.count;
+	argv_init(&vm->args, 8);
+	g_shell.loop_depth++;
+	return (1);
+}
+
+static int	op_for_next(t_vm *vm)
+{
+	t_entry	*loop;
+
+	loop = &vm->stack[vm->depth - 1];
+	if (loop->next < loop->count)
+	{
+		set_shell_value(vm->prog->strings + vm->code[vm->pc],
+			loop->items[loop->next++]);
+		vm->pc += 2;
+	}
+	else
+		vm->pc = vm->code[vm->pc + 1];
+	return (1);
+}
+
+static int	op_loop_body(t_vm *vm)
+{
+	vm->stack[vm->depth - 1].status = g_shell.exit_status;
+	return (1);
+}
+
+static int	op_loop_end(t_vm *vm)
+{
+	g_shell.exit_status = vm->stack[vm->depth - 1].status;
+	pop_entry(vm);
+	return (1);
+}
+
+static int	op_case(t_vm *vm)
+{
+	t_entry	*entry;
+	char	*subject;
+
+	subject = expand_word_string(program_word(vm->prog, vm->code[vm->pc++]),
+			NULL);
+	if (g_shell.expand_failed)
+	{
+		free(subject);
+		return (expansion_failed(vm));
+	}
+	entry = push_entry(vm, ENTRY_CASE);
+	entry->subject = subject;
+	g_shell.exit_status = 0;
+	return (1);
+}
+
+static int	op_match(t_vm *vm)
+{
+	char	*pattern;
+	int		matched;
+
+	pattern = expand_pattern(program_word(vm->prog, vm->code[vm->pc]));
+	matched = match_pattern(vm->stack[vm->depth - 1].subject, pattern);
+	free(pattern);
+	vm->pc = matched ? vm->code[vm->pc + 1] : vm->pc + 2;
+	return (1);
+}
+
+static int	op_case_end(t_vm *vm)
+{
+	pop_entry(vm);
+	return (1);
+}
+
+static int	op_defun(t_vm *vm)
+{
+	define_function(vm->prog->strings + vm->code[vm->pc], vm->prog,
+		vm->pc + 2);
+	vm->pc = vm->code[vm->pc + 1];
+	g_shell.exit_status = 0;
+	return (1);
+}
+
+static int	op_return(t_vm *vm)
+{
+	(void)vm;
+	return (0);
+}
+
+static const t_handler	g_handlers[] = {
+	[OP_HALT] = op_halt,
+	[OP_JUMP] = op_jump,
+	[OP_BRANCH_OK] = op_branch_ok,
+	[OP_BRANCH_FAIL] = op_branch_fail,
+	[OP_NOT] = op_not,
+	[OP_STATUS] = op_status,
+	[OP_BEGIN] = op_begin,
+	[OP_EXPAND] = op_expand,
+	[OP_ASSIGN] = op_assign,
+	[OP_ARRAY] = op_array,
+	[OP_ARRAY_ADD] = op_array_add,
+	[OP_ARRAY_KEY] = op_array_key,
+	[OP_REDIRECT] = op_redirect,
+	[OP_SPAWN] = op_spawn,
+	[OP_BUILTIN] = op_builtin,
+	[OP_ARITH] = op_arith,
+	[OP_PIPE] = op_pipe,
+	[OP_WAIT] = op_wait,
+	[OP_EXIT] = op_exit,
+	[OP_SUBSHELL] = op_subshell,
+	[OP_PUSH_REDIR] = op_push_redir,
+	[OP_POP_REDIR] = op_pop_redir,
+	[OP_LOOP] = op_loop,
+	[OP_FOR_NEXT] = op_for_next,
+	[OP_LOOP_BODY] = op_loop_body,
+	[OP_LOOP_END] = op_loop_end,
+	[OP_CASE] = op_case,
+	[OP_MATCH] = op_match,
+	[OP_CASE_END] = op_case_end,
+	[OP_DEFUN] = op_defun,
+	[OP_RETURN] = op_return
+};
+
+/*
+ * Runs prog from pc until HALT, or RETURN for a function body, and
+ * returns the last status. Every handler moves pc past its operands.
+ */
+int	vm_execute(t_program *prog, int pc)
+{
+	t_vm	vm;
+
+	prog->refs++;
+	memset(&vm, 0, sizeof(t_vm));
+	vm.prog = prog;
+	vm.code = prog->code;
+	vm.pc = pc;
+	argv_init(&vm.args, 8);
+	argv_init(&vm.assigns, 4);
+	vm.cap = 8;
+	vm.stack = safe_malloc(sizeof(t_entry) * vm.cap);
+	vm.prev_fd = -1;
+	while (g_handlers[vm.code[vm.pc++]](&vm))
+		;
+	while (vm.depth > 0)
+		pop_entry(&vm);
+	clear_command(&vm);
+	free(vm.args.items);
+	free(vm.assigns.items);
+	free(vm.stack);
+	free(vm.pids);
+	free_plan(vm.plan);
+	release_program(prog);
+	return (g_shell.exit_status);
+}
+
+/* Loop count argument of break and continue, 0 when invalid */
+static int	loop_count(char **args, char *name)
+{
+	char	*end;
+	long	n;
+
+	if (g_shell.loop_depth == 0)
+	{
+		print_error(name, "only meaningful in a `for', `while', or `until' loop");
+		return (0);
+	}
+	if (!args[1])
+		return (1);
+	n = strtol(args[1], &end, 10);
+	if (*end || end == args[1] || n < 1)
+	{
+		print_error(name, "loop count out of range");
+		return (0);
+	}
+	return (n > g_shell.loop_depth ? g_shell.loop_depth : n);
+}
+
+int	builtin_break(char **args)
+{
+	g_shell.breaking = loop_count(args, "break");
+	return (0);
+}
+
+int	builtin_continue(char **args)
+{
+	g_shell.continuing = loop_count(args, "continue");
+	return (0);
+}
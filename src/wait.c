@@ -0,0 +1,393 @@
+#include "../include/minishell.h"
+
+/*
+ * Waiting for children. Each child waited for gets a pidfd and a single
+ * poll() covers all of them together with the deadline of a running
+ * timeout, so a whole pipeline is reaped, or signalled, stage by stage and
+ * no other child is reaped along with it. Without pidfd_open() a waitpid()
+ * loop does the same.
+ */
+
+# define DEFAULT_SIGNAL SIGTERM
+# define TIMEOUT_STATUS 124
+# define TIMEOUT_FAILED 125
+
+/* Signals timeout -s knows by name */
+typedef struct s_signame
+{
+	char				*name;
+	int					number;
+}	t_signame;
+
+static const t_signame	g_signals[] = {
+	{"HUP", SIGHUP},
+	{"INT", SIGINT},
+	{"QUIT", SIGQUIT},
+	{"KILL", SIGKILL},
+	{"USR1", SIGUSR1},
+	{"USR2", SIGUSR2},
+	{"ALRM", SIGALRM},
+	{"TERM", SIGTERM},
+	{NULL, 0}
+};
+
+long long	now_ms(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+#ifdef __linux__
+
+/* A descriptor that polls readable once pid has exited, -1 without
+ * pidfd support */
+int	open_pidfd(pid_t pid)
+{
+	return (syscall(SYS_pidfd_open, pid, 0));
+}
+
+static int	pidfd_kill(int fd, int sig)
+{
+	return (syscall(SYS_pidfd_send_signal, fd, sig, NULL, 0));
+}
+
+#else
+
+int	open_pidfd(pid_t pid)
+{
+	(void)pid;
+	errno = ENOSYS;
+	return (-1);
+}
+
+static int	pidfd_kill(int fd, int sig)
+{
+	(void)fd;
+	(void)sig;
+	return (-1);
+}
+
+#endif
+
+/*
+ * Milliseconds until the running timeout acts next, -1 without one or
+ * when this wait already signalled for it, which is what *sent records.
+ */
+int	time_left(long long sent)
+{
+	long long	left;
+
+	if (!g_shell.timeout.at || g_shell.timeout.at == sent)
+		return (-1);
+	left = g_shell.timeout.at - now_ms();
+	if (left < 0)
+		return (0);
+	return (left > INT_MAX ? INT_MAX : left);
+}
+
+/*
+ * The deadline passed: its signal is due, and SIGKILL -k later. The
+ * deadline stays past so children started after it are signalled at once.
+ */
+int	expired_signal(long long *sent)
+{
+	int	sig;
+
+	sig = g_shell.timeout.signal;
+	g_shell.timeout.expired++;
+	*sent = g_shell.timeout.at;
+	if (g_shell.timeout.kill_after > 0)
+	{
+		g_shell.timeout.at = now_ms() + g_shell.timeout.kill_after;
+		g_shell.timeout.kill_after = 0;
+		g_shell.timeout.signal = SIGKILL;
+	}
+	return (sig);
+}
+
+/*
+ * Whether the deadline passed for code running in the shell, functions and
+ * loops of builtins, which no wait sees: it is then interrupted, and the
+ * timeout that set the deadline takes the interrupt back.
+ */
+int	timeout_stops(void)
+{
+	if (!g_shell.timeout.at
+		|| (!g_shell.timeout.expired && now_ms() < g_shell.timeout.at))
+		return (0);
+	if (!g_shell.timeout.expired)
+		g_shell.timeout.expired = 1;
+	g_shell.timeout.stopped = 1;
+	g_shell.interrupted = 1;
+	return (1);
+}
+
+static int	status_of(siginfo_t *info)
+{
+	if (info->si_code == CLD_EXITED)
+		return (info->si_status);
+	return (128 + info->si_status);
+}
+
+/* Reaps pid if it has exited, without waiting; 1 with *status set then */
+int	reap_child(pid_t pid, int *status)
+{
+	siginfo_t	info;
+
+	memset(&info, 0, sizeof(siginfo_t));
+	if (waitid(P_PID, pid, &info, WEXITED | WNOHANG) == -1 || !info.si_pid)
+		return (0);
+	*status = status_of(&info);
+	return (1);
+}
+
+/* The fallback without pidfds: waitid() polled while a timeout runs */
+static int	wait_plain(pid_t *pids, int count)
+{
+	siginfo_t	info;
+	long long	sent;
+	int			status;
+	int			sig;
+	int			i;
+	int			j;
+
+	status = 1;
+	sent = 0;
+	i = -1;
+	while (++i < count)
+	{
+		memset(&info, 0, sizeof(siginfo_t));
+		while (pids[i] > 0 && !info.si_pid)
+		{
+			if (waitid(P_PID, pids[i], &info, WEXITED
+					| (time_left(sent) >= 0 ? WNOHANG : 0)) == -1)
+			{
+				if (errno != EINTR)
+					break ;
+			}
+			else if (!info.si_pid && time_left(sent) == 0)
+			{
+				sig = expired_signal(&sent);
+				j = i;
+				while (j < count)
+					if (pids[j++] > 0)
+						kill(pids[j - 1], sig);
+			}
+			else if (!info.si_pid)
+				usleep(10000);
+		}
+		if (i == count - 1 && info.si_pid)
+			status = status_of(&info);
+	}
+	return (status);
+}
+
+static void	signal_all(struct pollfd *fds, int count, int sig)
+{
+	int	i;
+
+	i = -1;
+	while (++i < count)
+		if (fds[i].fd != -1)
+			pidfd_kill(fds[i].fd, sig);
+}
+
+/* Reaps the children that poll() found done; *status takes the last one's */
+static int	reap_ready(struct pollfd *fds, int count, int *status)
+{
+	siginfo_t	info;
+	int			reaped;
+	int			i;
+
+	reaped = 0;
+	i = -1;
+	while (++i < count)
+	{
+		if (fds[i].fd == -1 || !fds[i].revents)
+			continue ;
+		memset(&info, 0, sizeof(siginfo_t));
+		if (waitid(P_PIDFD, fds[i].fd, &info, WEXITED) == -1 && errno == EINTR)
+			continue ;
+		if (i == count - 1 && info.si_pid)
+			*status = status_of(&info);
+		close(fds[i].fd);
+		fds[i].fd = -1;
+		reaped++;
+	}
+	return (reaped);
+}
+
+/*
+ * Waits for every pid of pids (-1 entries are skipped) and returns $? of
+ * the last one, 1 if it never started. A timeout that runs out on the way
+ * signals all the children still running.
+ */
+int	wait_children(pid_t *pids, int count)
+{
+	struct pollfd	*fds;
+	long long		sent;
+	int				status;
+	int				alive;
+	int				i;
+
+	fds = safe_malloc(sizeof(struct pollfd) * (count + 1));
+	alive = 0;
+	i = -1;
+	while (++i < count)
+	{
+		fds[i].events = POLLIN;
+		fds[i].fd = -1;
+		if (pids[i] > 0 && (fds[i].fd = open_pidfd(pids[i])) == -1)
+			break ;
+		alive += (fds[i].fd != -1);
+	}
+	if (i < count)
+	{
+		while (i-- > 0)
+			if (fds[i].fd != -1)
+				close(fds[i].fd);
+		free(fds);
+		return (wait_plain(pids, count));
+	}
+	status = 1;
+	sent = 0;
+	while (alive > 0)
+	{
+		i = poll(fds, count, time_left(sent));
+		if (i == 0)
+			signal_all(fds, count, expired_signal(&sent));
+		else if (i > 0)
+			alive -= reap_ready(fds, count, &status);
+	}
+	free(fds);
+	return (status);
+}
+
+static int	signal_number(char *name)
+{
+	char	*end;
+	long	number;
+	int		i;
+
+	if (isdigit(name[0]))
+	{
+		number = strtol(name, &end, 10);
+		return ((*end || number < 1 || number >= NSIG) ? -1 : number);
+	}
+	if (strncmp(name, "SIG", 3) == 0)
+		name += 3;
+	i = 0;
+	while (g_signals[i].name && strcmp(g_signals[i].name, name) != 0)
+		i++;
+	return (g_signals[i].name ? g_signals[i].number : -1);
+}
+
+/* Seconds with an optional fraction and s, m, h or d suffix, in
+ * milliseconds; -1 if it isn't a duration */
+static long long	parse_duration(char *str)
+{
+	char	*end;
+	double	value;
+	double	unit;
+
+	errno = 0;
+	value = strtod(str, &end);
+	if (end == str || errno || !(value >= 0) || !isdigit(str[0]))
+		return (-1);
+	unit = 1000;
+	if (*end == 'm')
+		unit = 60000;
+	else if (*end == 'h')
+		unit = 3600000;
+	else if (*end == 'd')
+		unit = 86400000;
+	end += (*end && strchr("smhd", *end) != NULL);
+	if (*end || value * unit > 1e15)
+		return (-1);
+	if (value > 0 && value * unit < 1)
+		return (1);
+	return ((long long)(value * unit));
+}
+
+static int	timeout_usage(void)
+{
+	print_error("timeout", "usage: timeout [-s signal] [-k duration] "
+		"duration command [args]");
+	return (TIMEOUT_FAILED);
+}
+
+/* -s and -k into t, then the duration; *args is left on the command */
+static int	parse_timeout(t_timeout *t, char ***args, long long *duration)
+{
+	char	*value;
+	char	c;
+	int		i;
+
+	while (*++(*args) && (**args)[0] == '-' && (**args)[1])
+	{
+		if (strcmp(**args, "--") == 0 && ++(*args))
+			break ;
+		i = 1;
+		c = (**args)[i];
+		if (!strchr("sk", c) || !(value = option_value(args, &i)))
+			return (0);
+		if (c == 's' && (t->signal = signal_number(value)) == -1)
+			return (0);
+		if (c == 'k' && (t->kill_after = parse_duration(value)) == -1)
+			return (0);
+	}
+	if (!**args || !(*args)[1])
+		return (0);
+	*duration = parse_duration(*(*args)++);
+	return (*duration >= 0);
+}
+
+/*
+ * timeout [-s signal] [-k duration] duration command [args] runs the
+ * command in the shell under a deadline that every wait for a child
+ * honours, so all the stages of the pipelines it starts are signalled
+ * together when it passes, and that the VM checks between commands, so
+ * functions and loops in the shell stop there too. An enclosing timeout
+ * that ends sooner stays in charge, and a duration of 0 sets none. 124
+ * after a timeout, 137 when the command had to be killed.
+ */
+int	builtin_timeout(t_cmd *cmd)
+{
+	t_timeout	saved;
+	t_timeout	t;
+	long long	duration;
+	char		**command;
+	char		**args;
+	int			owned;
+	int			status;
+
+	memset(&t, 0, sizeof(t_timeout));
+	t.signal = DEFAULT_SIGNAL;
+	command = cmd->args;
+	if (!parse_timeout(&t, &command, &duration))
+		return (timeout_usage());
+	saved = g_shell.timeout;
+	t.at = now_ms() + duration;
+	owned = duration > 0 && (!saved.at || t.at < saved.at);
+	if (owned)
+		g_shell.timeout = t;
+	/* The command takes over the argument array, as a function owns it */
+	args = cmd->args;
+	while (args < command)
+		free(*args++);
+	memmove(cmd->args, command, sizeof(char *) * (array_length(command) + 1));
+	status = run_command(cmd, -1);
+	if (!owned)
+		return (status);
+	if (g_shell.timeout.stopped)
+		g_shell.interrupted = 0;
+	if (g_shell.timeout.expired > 1 || (g_shell.timeout.expired
+			&& t.signal == SIGKILL))
+		status = 128 + SIGKILL;
+	else if (g_shell.timeout.expired)
+		status = TIMEOUT_STATUS;
+	g_shell.timeout = saved;
+	return (status);
+}